@@ -0,0 +1,72 @@
+import itertools
+import unittest
+
+import videoloader
+from videoloader import Video, DatasetLoader
+
+
+class TestDatasetLoader(unittest.TestCase):
+    def setUp(self):
+        self.videos = [Video('tests/test_video.mp4') for _ in range(4)]
+
+    def test_schedule(self):
+        schedule = [
+            [(self.videos[0], [0, 1]), (self.videos[1], [2, 3, 4])],
+            [(self.videos[2], range(5))],
+        ]
+        batches = list(DatasetLoader(schedule, max_threads=2))
+        self.assertEqual(len(batches), 2)
+        self.assertEqual([clip.shape[0] for clip in batches[0]], [2, 3])
+        self.assertEqual([clip.shape[0] for clip in batches[1]], [5])
+
+    def test_prefetch(self):
+        schedule = [[(self.videos[0], [0, 1]), (self.videos[1], [5])]]
+        batches = list(DatasetLoader(schedule, max_threads=2, prefetch_threads=2))
+        self.assertEqual([clip.shape[0] for clip in batches[0]], [2, 1])
+
+    def test_generator(self):
+        def schedule():
+            for i in itertools.count():
+                yield [(self.videos[i % len(self.videos)], [i % 8])]
+
+        loader = DatasetLoader(schedule(), preload_batches=2, max_preload_bytes=1)
+        for _, batch in zip(range(10), loader):
+            self.assertEqual(len(batch), 1)
+        loader.stop()
+
+    def test_schedule_raise(self):
+        class TestError(RuntimeError):
+            pass
+
+        def schedule():
+            yield [(self.videos[0], [0])]
+            raise TestError()
+
+        loader = DatasetLoader(schedule())
+        next(loader)
+        with self.assertRaises(TestError):
+            next(loader)
+
+    def test_invalid_item(self):
+        with self.assertRaises(TypeError):
+            next(DatasetLoader([[(123, [0])]]))
+
+    def test_locality_shuffle(self):
+        videos = videoloader.open_video_tar('tests/tar/test_videos.tar')
+        clips = [(v, [i, i + 1]) for v in reversed(videos) for i in range(4)]
+        schedule = videoloader.locality_shuffle(clips, batch_size=3, window_size=2,
+                                                block_size=2, seed=1)
+        self.assertEqual([len(b) for b in schedule], [3, 3, 3, 3])
+        flat = [clip for batch in schedule for clip in batch]
+        self.assertCountEqual(map(id, flat), map(id, clips))
+        self.assertEqual(schedule, videoloader.locality_shuffle(
+            clips, batch_size=3, window_size=2, block_size=2, seed=1))
+        # Without shuffling, clips are read in tar order.
+        in_order = videoloader.locality_shuffle(clips, batch_size=4, window_size=1,
+                                                shuffle_windows=False)
+        self.assertEqual([[v is videos[i] for v, _ in b] for i, b in enumerate(in_order)],
+                         [[True] * 4] * 3)
+        self.assertEqual([idx for _, idx in in_order[0]], [[0, 1], [1, 2], [2, 3], [3, 4]])
+        # Clips of a video are in adjacent batches, which are loaded at the same time.
+        batches = list(DatasetLoader(schedule, max_threads=4))
+        self.assertEqual(len(batches), 4)
@@ -1,5 +1,12 @@
+import asyncio
+import concurrent.futures
+import json
+import os
+import pickle
+import tempfile
 import unittest
 
+import videoloader
 from videoloader import Video, _ext
 
 class TestVideo(unittest.TestCase):
@@ -13,6 +20,157 @@ class TestVideo(unittest.TestCase):
         video = Video('tests/test_video.mp4')
         self.assertIsInstance(video, Video)
 
+    def test_open_videos(self):
+        videos = videoloader.open_videos(
+            ['tests/test_video.mp4', 'tests/not_exist.mp4', 'tests/test_video.mp4'],
+            max_threads=2)
+        self.assertEqual(len(videos), 3)
+        self.assertIsInstance(videos[0], Video)
+        self.assertTrue(videos[0].is_sleeping())
+        self.assertIsInstance(videos[1], FileNotFoundError)
+        self.assertEqual(videos[2].get_batch([0, 1]).shape[0], 2)
+
+    def test_get_batches(self):
+        videos = [Video('tests/test_video.mp4') for _ in range(3)]
+        requests = [(videos[0], [0, 1]), (videos[1], range(5)), (videos[0], [10]),
+                    (videos[2], [3])]
+        batches = videoloader.get_batches(requests, threads=2)
+        self.assertEqual([b.shape[0] for b in batches], [2, 5, 1, 1])
+        self.assertTrue((batches[0][0] == videos[2].get_batch([0])[0]).all())
+        self.assertTrue(all(v.is_sleeping() for v in videos))
+        with videos[0].keep_awake():
+            videoloader.get_batches([(videos[0], [0])])
+            self.assertFalse(videos[0].is_sleeping())
+        with self.assertRaises(IndexError):
+            videoloader.get_batches([(videos[0], [0]), (videos[1], [100000])])
+        with self.assertRaisesRegex(TypeError, 'instance of Video'):
+            videoloader.get_batches([(videos[0], [0]), (123, [0])])
+        with self.assertRaisesRegex(ValueError, r'\(video, frame_indices\)'):
+            videoloader.get_batches([(videos[0], [0]), (videos[1],)])
+        self.assertTrue(all(v.is_sleeping() for v in videos))
+
+    def test_pickle(self):
+        video = Video('tests/test_video.mp4', data_container=None)
+        restored = pickle.loads(pickle.dumps(video))
+        self.assertIsInstance(restored, Video)
+        self.assertTrue(restored.is_sleeping())
+        self.assertEqual(restored.num_frames(), video.num_frames())
+        self.assertIsInstance(restored.get_batch([0]), _ext.Tensor)
+        tar_videos = videoloader.open_video_tar('tests/tar/test_videos.tar', memory_map=True)
+        restored = pickle.loads(pickle.dumps(tar_videos[1]))
+        self.assertTrue((restored.get_batch([0, 3]) == tar_videos[1].get_batch([0, 3])).all())
+
+    def test_video_collection(self):
+        videos = videoloader.open_video_tar('tests/tar/test_videos.tar')
+        collection = videoloader.VideoCollection(videos + [Video('tests/test_video.mp4')])
+        self.assertEqual(len(collection), 4)
+        self.assertEqual(collection.path(3), 'tests/test_video.mp4')
+        self.assertEqual(collection.num_frames(0), videos[0].num_frames())
+        self.assertEqual(collection.path(-1), 'tests/test_video.mp4')
+        self.assertEqual(collection.num_frames(-4), videos[0].num_frames())
+        with self.assertRaises(IndexError):
+            collection.path(-5)
+        restored = pickle.loads(pickle.dumps(collection))
+        self.assertIsInstance(restored, videoloader.VideoCollection)
+        self.assertEqual(restored.to_bytes(), collection.to_bytes())
+        self.assertTrue((restored[-1].get_batch([1]) ==
+                         Video('tests/test_video.mp4').get_batch([1])).all())
+        self.assertEqual([v.num_frames() for v in restored], [v.num_frames() for v in collection])
+        with self.assertRaises(IndexError):
+            collection[4]
+        with self.assertRaises(ValueError):
+            videoloader.VideoCollection.from_bytes(b'not a collection')
+        with self.assertRaises(TypeError):
+            videoloader.VideoCollection([123])
+
+    def test_dataset_catalog(self):
+        with tempfile.TemporaryDirectory() as d:
+            catalog_path = os.path.join(d, 'catalog.vlcol')
+            count = videoloader.write_dataset_catalog(
+                catalog_path, ['tests/test_video.mp4', 'tests/tar/test_videos.tar'])
+            self.assertEqual(count, 4)
+            catalog = videoloader.VideoCollection.open_catalog(catalog_path)
+            self.assertEqual(len(catalog), 4)
+            self.assertEqual(catalog.path(0), os.path.abspath('tests/test_video.mp4'))
+            restored = pickle.loads(pickle.dumps(catalog))
+            self.assertLess(len(pickle.dumps(catalog)), 1024)
+            self.assertEqual(restored.to_bytes(), catalog.to_bytes())
+            self.assertEqual(restored[3].get_batch([0, 1]).shape[0], 2)
+
+            # Opened by a relative path, unpickled in another working directory.
+            relative = videoloader.VideoCollection.open_catalog(os.path.relpath(catalog_path))
+            state = pickle.dumps(relative)
+            cwd = os.getcwd()
+            os.chdir(d)
+            try:
+                self.assertEqual(len(pickle.loads(state)), 4)
+            finally:
+                os.chdir(cwd)
+            del catalog, restored, relative
+
+    def test_get_batch_async(self):
+        videos = [Video('tests/test_video.mp4') for _ in range(2)]
+        futures = [v.get_batch_async([i, i + 1]) for i in range(4) for v in videos]
+        for f in futures:
+            self.assertEqual(f.result(timeout=10).shape[0], 2)
+        self.assertTrue((futures[0].result() == videos[0].get_batch([0, 1])).all())
+        with self.assertRaises(IndexError):
+            videos[0].get_batch_async([100000]).result(timeout=10)
+
+        # Requests of a video are decoded in order, so later ones are still pending.
+        pending = [videos[1].get_batch_async(range(50)) for _ in range(4)]
+        cancelled = pending[-1].cancel()
+        concurrent.futures.wait(pending[:-1], timeout=10)
+        self.assertEqual(pending[-1].cancelled(), cancelled)
+
+        async def read():
+            return await asyncio.wrap_future(videos[0].get_batch_async([3]))
+        loop = asyncio.new_event_loop()
+        try:
+            self.assertEqual(loop.run_until_complete(read()).shape[0], 1)
+        finally:
+            loop.close()
+
     def test_video_type_check(self):
         with self.assertRaises(TypeError):
             _ext._Video(123)
+
+    def test_stage_stats(self):
+        videoloader.reset_stage_stats()
+        Video('tests/test_video.mp4').get_batch([0, 1])
+        stats = videoloader.stage_stats()
+        if _ext.STAGE_STATS_ENABLED:
+            self.assertEqual(stats['get_batch']['count'], 1)
+        self.assertIsInstance(videoloader.stage_stats(per_thread=True), list)
+
+    def test_trace(self):
+        videoloader.start_trace()
+        Video('tests/test_video.mp4').get_batch([0, 1])
+        videoloader.stop_trace()
+        with tempfile.TemporaryDirectory() as d:
+            path = os.path.join(d, 'trace.json')
+            videoloader.write_trace(path)
+            with open(path) as f:
+                trace = json.load(f)
+        names = {e['name'] for e in trace['traceEvents']}
+        if _ext.STAGE_STATS_ENABLED:
+            self.assertIn('get_batch', names)
+
+    def test_memory_stats(self):
+        video = Video('tests/test_video.mp4')
+        video.sleep()
+        self.assertEqual(video.memory_usage()['io_buffer_bytes'], 0)
+        self.assertGreater(video.memory_usage()['index_bytes'], 0)
+        stats = videoloader.memory_stats()
+        self.assertGreaterEqual(stats['sleeping_videos']['count'], 1)
+        self.assertGreaterEqual(stats['sleeping_videos']['index_bytes'],
+                                video.memory_usage()['index_bytes'])
+
+    def test_fd_cache(self):
+        video = Video('tests/test_video.mp4')
+        video.sleep()
+        hits = videoloader.fd_cache_stats()['hits']
+        video.get_batch([0])
+        self.assertEqual(videoloader.fd_cache_stats()['hits'], hits + 1)
+        with self.assertRaises(ValueError):
+            videoloader.set_fd_cache_capacity(-1)
@@ -26,8 +26,28 @@ class TestGetBatchBasic(unittest.TestCase):
         self.batch = self.video.get_batch([0, 1])
 
     def test_type(self):
-        self.assertRegex(repr(self.batch),
-                         '<capsule object "dltensor" at 0x[0-9a-f]+>')
+        self.assertIsInstance(self.batch, videoloader._ext.Tensor)
+        self.assertEqual(self.batch.shape, (2, 456, 256, 3))
+        self.assertEqual(self.batch.__dlpack_device__(), (1, 0))
+
+    def test_dlpack(self):
+        array = np.from_dlpack(self.batch)
+        tensor = torch.from_dlpack(self.batch)
+        self.assertEqual(array.shape, (2, 456, 256, 3))
+        self.assertEqual(array.dtype, np.uint8)
+        # Both share the data of the batch.
+        self.assertEqual(array.ctypes.data, tensor.data_ptr())
+        del self.batch
+        numpy.testing.assert_array_equal(array, tensor.numpy())
+
+    def test_index_arrays(self):
+        expected = np.from_dlpack(self.video.get_batch([3, 0, 3]))
+        for indices in [np.array([3, 0, 3]), np.array([3, 0, 3], dtype=np.uint16),
+                        np.array([9, 3, 9, 0, 9, 3])[1::2], torch.tensor([3, 0, 3])]:
+            numpy.testing.assert_array_equal(np.from_dlpack(self.video.get_batch(indices)),
+                                             expected)
+        with self.assertRaises(OverflowError):
+            self.video.get_batch(np.array([-1]))
 
     def test_len(self):
         self.assertEqual(self.video.num_frames(), 300)
@@ -52,6 +72,45 @@ class TestGetBatch(unittest.TestCase):
         self.assertIsInstance(batch, np.ndarray)
         self.assertEqual(batch.shape, (2, 456, 256, 3))
 
+    def test_get_batches(self):
+        clips = [[10, 11, 12], np.array([12, 13]), range(200, 202)]
+        batches = self.video.get_batches(clips)
+        self.assertEqual(len(batches), 3)
+        for clip, batch in zip(clips, batches):
+            self.assertIsInstance(batch, np.ndarray)
+            numpy.testing.assert_array_equal(batch, self.video.get_batch(clip))
+        with self.assertRaises(ValueError):
+            self.video.get_batches([[0], []])
+        with self.assertRaises(IndexError):
+            self.video.get_batches([[0], [9999]])
+
+    def test_get_batch_outputs(self):
+        outputs = [(0, 0), (114, -1), (57, 32, 'gray')]
+        full, small, gray = self.video.get_batch_outputs([5, 0], outputs)
+        numpy.testing.assert_array_equal(full, self.video.get_batch([5, 0]))
+        self.assertEqual(small.shape, (2, 114, 64, 3))
+        self.assertEqual(gray.shape, (2, 57, 32, 1))
+        with self.assertRaises(ValueError):
+            self.video.get_batch_outputs([0], [(0, 0, 'not-a-format')])
+        with self.assertRaises(ValueError):
+            self.video.get_batch_outputs([0], [(0, 0, 'yuv420p')])
+        with self.assertRaises(ValueError):
+            self.video.get_batch_outputs([0], [])
+
+    def test_read_frames(self):
+        chunks = list(self.video.read_frames(start_frame=290, chunk_size=4))
+        self.assertEqual([c.shape[0] for c in chunks], [4, 4, 2])
+        numpy.testing.assert_array_equal(np.concatenate(chunks),
+                                         self.video.get_batch(range(290, 300)))
+        self.assertTrue(self.video.is_sleeping())
+        expected = self.video.get_batch([100, 101])
+        with self.video.read_frames(chunk_size=2) as reader:
+            reader.seek(100)
+            numpy.testing.assert_array_equal(next(reader), expected)
+            self.assertEqual(reader.tell(), 102)
+        with self.assertRaises(ValueError):
+            reader.tell()
+
 
 class TestGetBatchPytorch(unittest.TestCase):
     def setUp(self):
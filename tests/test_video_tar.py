@@ -1,3 +1,6 @@
+import os
+import shutil
+import tempfile
 import unittest
 
 import videoloader
@@ -24,6 +27,77 @@ class TestOpen(unittest.TestCase):
         with self.assertRaises(TestError):
             videoloader.open_video_tar('./tests/tar/test_videos.tar', filter)
 
+    def test_native_filter(self):
+        tar = './tests/tar/test_videos.tar'
+        self.assertEqual(len(videoloader.open_video_tar(tar, extensions=['.MP4'])), 3)
+        self.assertEqual(len(videoloader.open_video_tar(tar, extensions='.mkv')), 0)
+        self.assertEqual(len(videoloader.open_video_tar(tar, glob='*/-g3*')), 1)
+        self.assertEqual(len(videoloader.open_video_tar(tar, regex='_0001[0-9]{2}_')), 2)
+        self.assertEqual(len(videoloader.open_video_tar(tar, max_size=445000)), 2)
+        self.assertEqual(len(videoloader.open_video_tar(tar, min_size=445000, max_threads=2)), 1)
+        with self.assertRaises(ValueError):
+            videoloader.open_video_tar(tar, regex='(')
+
+    def test_native_and_python_filter(self):
+        seen = []
+        def filter(entry):
+            seen.append(entry.path)
+            return True
+        videos = videoloader.open_video_tar('./tests/tar/test_videos.tar', filter,
+                                            regex='_0001[0-9]{2}_')
+        self.assertEqual(len(videos), 2)
+        self.assertEqual(len(seen), 2)
+
     def test_multi_thread(self):
         videos = videoloader.open_video_tar('./tests/tar/test_videos.tar', max_threads=4)
         self.assertEqual(len(videos), 3)
+
+    def test_memory_map(self):
+        videos = videoloader.open_video_tar('./tests/tar/test_videos.tar', memory_map=True)
+        self.assertEqual(len(videos), 3)
+        self.assertEqual(videos[0].get_batch([0, 1]).shape[0], 2)
+
+    def test_direct_io(self):
+        for max_threads in [-1, 2]:
+            videos = videoloader.open_video_tar('./tests/tar/test_videos.tar',
+                                                max_threads=max_threads, direct_io=True)
+            self.assertEqual(len(videos), 3)
+            self.assertEqual(videos[0].get_batch([0, 1]).shape[0], 2)
+
+    def test_sidecar_index(self):
+        with tempfile.TemporaryDirectory() as tmp:
+            tar_path = os.path.join(tmp, 'test_videos.tar')
+            shutil.copyfile('./tests/tar/test_videos.tar', tar_path)
+            scanned = videoloader.open_video_tar(tar_path, sidecar_index=True)
+            self.assertTrue(os.path.exists(tar_path + '.vlidx'))
+            reopened = videoloader.open_video_tar(tar_path, max_threads=2, sidecar_index=True)
+            self.assertEqual(len(reopened), 3)
+            for a, b in zip(scanned, reopened):
+                self.assertEqual(a.num_frames(), b.num_frames())
+                self.assertTrue((a.get_batch([0, 3]) == b.get_batch([0, 3])).all())
+
+
+class TestIter(unittest.TestCase):
+    def test_in_order(self):
+        expected = videoloader.open_video_tar('./tests/tar/test_videos.tar')
+        videos = list(videoloader.iter_video_tar('./tests/tar/test_videos.tar', max_threads=2))
+        self.assertEqual(len(videos), 3)
+        self.assertEqual([v.num_frames() for v in videos],
+                         [v.num_frames() for v in expected])
+        self.assertTrue(isinstance(videos[0], videoloader.Video))
+
+    def test_filter_raise(self):
+        class TestError(RuntimeError):
+            pass
+        def filter(entry):
+            if entry.path == 'answering_questions/-g3JhkJRVY4_000333_000343.mp4':
+                raise TestError()
+            return True
+        with self.assertRaises(TestError):
+            list(videoloader.iter_video_tar('./tests/tar/test_videos.tar', filter, max_threads=2))
+
+    def test_stop(self):
+        videos = videoloader.iter_video_tar('./tests/tar/test_videos.tar')
+        next(videos)
+        videos.stop()
+        self.assertEqual(list(videos), [])
@@ -1,4 +1,5 @@
 from typing import Union, Iterable, Callable, Optional
+import concurrent.futures
 import os
 import contextlib
 
@@ -6,19 +7,242 @@ from . import _ext
 
 
 def _data_convert_to_numpy(batch):
-    return _ext.dltensor_to_numpy(batch)
+    return _ext.dltensor_to_numpy(batch.__dlpack__())
 
 
 def _data_convert_to_pytorch(batch):
     import torch.utils.dlpack
-    return torch.utils.dlpack.from_dlpack(batch)
+    return torch.utils.dlpack.from_dlpack(batch.__dlpack__())
+
+
+def _get_data_convert(data_container):
+    data_convert = {
+        None: lambda x: x,
+        'numpy': _data_convert_to_numpy,
+        'pytorch': _data_convert_to_pytorch,
+    }.get(data_container)
+    if data_convert is None:
+        raise ValueError(f'Unsupported data container "{data_container}"')
+    return data_convert
 
 
 def open_video_tar(
         tar_path: Union[os.PathLike, str, bytes],
         entry_filter: Optional[Callable[[_ext.TarEntry], bool]] = None,
-        max_threads=-1):
-    return _ext.open_video_tar(Video, tar_path, entry_filter, max_threads)
+        max_threads=-1,
+        memory_map=False,
+        sidecar_index=False,
+        extensions: Union[str, Iterable[str], None] = None,
+        glob: Union[str, Iterable[str], None] = None,
+        regex: Optional[str] = None,
+        min_size=0,
+        max_size: Optional[int] = None,
+        direct_io=False):
+    ''' Open all videos in a tar file.
+
+    * entry_filter: Only open entries for which it returns True. Called only
+        for entries selected by the filters below, which are evaluated
+        natively without GIL. Prefer those on tars with many members.
+    * extensions: Only open entries with one of these case-insensitive file
+        extensions, e.g. `['.mp4', '.mkv']`.
+    * glob: Only open entries whose path matches one of these `fnmatch`
+        patterns, e.g. `'train/*.mp4'`. `*` also matches '/'.
+    * regex: Only open entries whose path contains a match of this
+        ECMAScript regular expression.
+    * min_size, max_size: Only open entries of size in this range, in bytes.
+    * direct_io: Read with O_DIRECT, bypassing page cache. The tar is still
+        read sequentially, each selected entry once into a bounded set of
+        buffers. Avoids evicting useful page cache when streaming large
+        shards from HDD. Ignored with memory_map.
+    * max_threads: Open videos in parallel with up to this many threads.
+    * memory_map: Map the whole tar into memory once and read all videos
+        from it. Useful when the tar is in page cache. Sleeping videos keep
+        only a reference to the mapping.
+    * sidecar_index: Open from `<tar_path>.vlidx` if it is up to date with the
+        tar, without scanning the tar or demuxing videos. Otherwise the tar is
+        scanned and the index is written, if its directory is writable.
+    '''
+    return _ext.open_video_tar(Video, tar_path, entry_filter, max_threads, memory_map,
+                               sidecar_index, extensions, glob, regex, min_size,
+                               -1 if max_size is None else max_size, direct_io)
+
+def iter_video_tar(
+        tar_path: Union[os.PathLike, str, bytes],
+        entry_filter: Optional[Callable[[_ext.TarEntry], bool]] = None,
+        max_threads=1,
+        memory_map=False,
+        sidecar_index=False,
+        extensions: Union[str, Iterable[str], None] = None,
+        glob: Union[str, Iterable[str], None] = None,
+        regex: Optional[str] = None,
+        min_size=0,
+        max_size: Optional[int] = None,
+        direct_io=False):
+    ''' Open videos in a tar file in background threads, and iterate over them
+    in tar order as soon as each is opened. Training can start before the
+    whole tar is indexed.
+
+    Arguments are the same as `open_video_tar`. `entry_filter` is called from
+    a background thread. Call `stop()` on the returned iterator to stop early.
+    '''
+    return _ext.iter_video_tar(Video, tar_path, entry_filter, max_threads, memory_map,
+                               sidecar_index, extensions, glob, regex, min_size,
+                               -1 if max_size is None else max_size, direct_io)
+
+def open_videos(
+        paths: Iterable[Union[os.PathLike, str, bytes]],
+        max_threads=4,
+        memory_map=False) -> list:
+    ''' Open many video files in parallel.
+
+    Returns a list in the order of `paths`. Each item is a sleeping `Video`,
+    or the exception raised opening that file, so one bad file does not fail
+    the others.
+
+    * max_threads: Open files in parallel with up to this many threads.
+    * memory_map: Same as `Video(..., memory_map=True)`.
+    '''
+    return _ext.open_videos(Video, paths, max_threads, memory_map)
+
+def _sleep_requested_videos(requests):
+    ''' Sleep videos woken up by `get_batches`, skipping malformed requests
+    so the error raised for them is not replaced. '''
+    videos = {}
+    for request in requests:
+        try:
+            video, _ = request
+        except (TypeError, ValueError):
+            continue
+        if isinstance(video, _ext._Video):
+            videos[id(video)] = video
+    for video in videos.values():
+        if getattr(video, '_kept_awake', 0) == 0:
+            video.sleep()
+
+def get_batches(requests, threads=4, data_container='numpy') -> list:
+    ''' Get frames of many videos at once, decoded in parallel without GIL.
+
+    Faster than calling `Video.get_batch` in a loop: requests are parsed
+    once and decoded on an internal thread pool together with the calling
+    thread. Requests of the same video are decoded one after another.
+
+    * requests: Sequence of `(video, frame_indices)`.
+    * threads: Max number of threads decoding.
+    * data_container ('numpy' | 'pytorch' | None): Set the output format
+
+    Returns a list of batches in the order of `requests`. If any request
+    fails, the first error is raised.
+    '''
+    requests = list(requests)
+    data_convert = _get_data_convert(data_container)
+    try:
+        batches = _ext.get_batches(requests, threads)
+    finally:
+        _sleep_requested_videos(requests)
+    return [data_convert(b) for b in batches]
+
+def locality_shuffle(clips, batch_size: int, window_size=64, block_size=1,
+                     shuffle_windows=True, seed=0) -> list:
+    ''' Shuffle clips while keeping reads mostly sequential, for videos
+    opened from large tars, especially on HDD.
+
+    Clips are sorted by where their videos are stored, e.g. the offset in
+    the tar, and grouped into blocks of `block_size` adjacent clips, which
+    are read in order. Blocks are shuffled within windows of `window_size`
+    contiguous blocks, then windows are shuffled unless `shuffle_windows`
+    is False.
+
+    * clips: Sequence of `(video, frame_indices)`.
+    * window_size: Larger is more random, but seeks further. 0 to shuffle
+        all blocks like a plain shuffle.
+    * seed: Same seed and clips give the same order, e.g. pass the epoch
+        number to shuffle differently every epoch.
+
+    Returns a schedule for `DatasetLoader`: a list of batches of
+    `batch_size` clips, the last one may be smaller.
+    '''
+    return _ext.locality_shuffle(clips, batch_size, block_size, window_size,
+                                 shuffle_windows, seed)
+
+def stage_stats(per_thread=False):
+    ''' Timing statistics of each loading stage, to find out where time goes.
+
+    Returns a dict from stage name to a dict with "count", "total_ns",
+    "max_ns" and "histogram_log2_ns", where the i-th histogram bucket counts
+    durations in [2^i, 2^(i+1)) nanoseconds. Stages nest, e.g. "file_read" is
+    counted in "demux" too.
+
+    * per_thread: If True, return a list of (thread_name, stats) instead of
+        the sum. Exited threads are summed in an entry with empty name.
+
+    All zero if videoloader is built without WITH_STAGE_STATS.
+    '''
+    return _ext.stage_stats(per_thread=per_thread)
+
+
+def reset_stage_stats():
+    ''' Reset all stage timing statistics to zero.
+    '''
+    _ext.reset_stage_stats()
+
+
+def start_trace(events_per_thread=65536):
+    ''' Start recording a timeline of loading stages, worker scheduling and waits.
+
+    Every thread keeps its latest `events_per_thread` events. Previously
+    recorded events are discarded.
+    '''
+    _ext.start_trace(events_per_thread=events_per_thread)
+
+
+def stop_trace():
+    ''' Stop recording timeline events.
+    '''
+    _ext.stop_trace()
+
+
+def write_trace(path: Union[os.PathLike, str, bytes]):
+    ''' Write recorded events as Chrome trace event JSON.
+
+    Open it in https://ui.perfetto.dev or chrome://tracing. Call `stop_trace()`
+    first.
+    '''
+    _ext.write_trace(path)
+
+
+def memory_stats():
+    ''' Memory held by videoloader in this process, in bytes.
+
+    Cheap enough to be polled frequently, e.g. every second.
+
+    Returns a dict with:
+    * "open_videos", "sleeping_videos": dict with "count", "index_bytes",
+        "demuxer_bytes" and "io_buffer_bytes" summed over videos in that
+        state. Demuxer bytes are estimated.
+    * "dlpack_pool_bytes": Tensors kept in pools for reuse.
+    * "tensor_bytes": Tensors handed out and not yet freed.
+    * "loader_preload_bytes": Predicted size of clips loaded ahead by all
+        `DatasetLoader`.
+    '''
+    return _ext.memory_stats()
+
+
+def set_fd_cache_capacity(capacity: int):
+    ''' Set how many files are kept open to be reused when videos wake up.
+
+    Videos share open files by path, least recently used files are closed
+    when more than `capacity` are open. 0 disables the cache, so every wake
+    up opens the file again. Defaults to 128.
+    '''
+    _ext.set_fd_cache_capacity(capacity)
+
+
+def fd_cache_stats():
+    ''' Returns a dict with "capacity", "size", "hits" and "misses" of the
+    open file cache.
+    '''
+    return _ext.fd_cache_stats()
+
 
 class Video(_ext._Video):
     ''' An opened video file.
@@ -32,21 +256,32 @@ class Video(_ext._Video):
 
     * url: URL to the file to be opened.
         Only local file path supported currently
-    * data_container ('numpy' | 'pytorch' | None): Set the output format
+    * data_container ('numpy' | 'pytorch' | None): Set the output format.
+        None returns `_ext.Tensor`, which any framework supporting DLPack
+        imports without copy, e.g. `numpy.from_dlpack(t)`.
+    * memory_map: Read the file through a memory mapping, which is kept while
+        sleeping instead of a file descriptor.
+    * direct_io: Read with O_DIRECT in aligned chunks, bypassing page cache.
     '''
 
-    def __init__(self, url: Union[os.PathLike, str, bytes], data_container='numpy'):
-        super().__init__(url)
+    # Defaults of videos not created by `__init__`, e.g. opened from a tar.
+    _data_container = 'numpy'
+    _data_convert = staticmethod(_data_convert_to_numpy)
+    _kept_awake = 0
+
+    def __init__(self, url: Union[os.PathLike, str, bytes], data_container='numpy',
+                 memory_map=False, direct_io=False):
+        super().__init__(url, memory_map=memory_map, direct_io=direct_io)
+        self._set_data_container(data_container)
 
-        self._data_convert = {
-            None: lambda x: x,
-            'numpy': _data_convert_to_numpy,
-            'pytorch': _data_convert_to_pytorch,
-        }.get(data_container)
-        if self._data_convert is None:
-            raise ValueError(f'Unsupported data container "{data_container}"')
+    def _set_data_container(self, data_container):
+        self._data_convert = _get_data_convert(data_container)
+        self._data_container = data_container
 
-        self._kept_awake = 0
+    def __reduce__(self):
+        # File location and frame index only, reopened without demuxing. Memory mapped videos
+        # map their file again, so the file should be at the same path when unpickled.
+        return _restore_video, (type(self), self._state(), self._data_container)
 
     def get_batch(self, frame_indices: Iterable[int]):
         ''' Get arbitrary number of frames in this video
@@ -54,13 +289,74 @@ class Video(_ext._Video):
         Pixel format is RGB24
 
         * frame_indices (Iterable[int]): Arbitrary number of frame indices.
-            Can be repeated, out of order, sparse.
+            Can be repeated, out of order, sparse. 1-D integer numpy arrays
+            and CPU tensors are read directly, without per-index overhead.
 
         Returns: numpy.ndarray or torch.Tensor. shape (frame, width, height, channel)
         '''
         with self.keep_awake():
             return self._data_convert(super().get_batch(frame_indices))
 
+    def get_batches(self, batches: Iterable[Iterable[int]]) -> list:
+        ''' Get several batches of frames in this video, e.g. clips of a sample
+
+        Faster than calling `get_batch` for each batch: frames of all batches
+        are decoded in one pass, so a GOP shared by batches is decoded once.
+
+        * batches (Iterable[Iterable[int]]): Frame indices of each batch, as
+            accepted by `get_batch`. Batches may overlap, but not be empty.
+
+        Returns: list of what `get_batch` returns, one for each batch.
+        '''
+        with self.keep_awake():
+            return [self._data_convert(b) for b in super().get_batches(batches)]
+
+    def get_batch_outputs(self, frame_indices: Iterable[int], outputs: Iterable[tuple]) -> list:
+        ''' Get frames at several sizes or pixel formats, e.g. for multi-scale models
+
+        Each frame is decoded once, then scaled and converted to each output
+        directly, which is faster and sharper than resizing `get_batch` output.
+
+        * frame_indices (Iterable[int]): As accepted by `get_batch`.
+        * outputs (Iterable[tuple]): `(width, height)` or `(width, height, pix_fmt)`
+            for each output. A size of 0 keeps that of the video, -1 keeps its
+            aspect ratio. `pix_fmt` is a FFmpeg name of a packed format with 8
+            bits per channel, 'rgb24' by default, e.g. 'bgr24' or 'gray'.
+
+        Returns: list of what `get_batch` returns, one for each output, with
+            as many channels as the output pixel format.
+        '''
+        with self.keep_awake():
+            batches = super().get_batch_outputs(frame_indices, outputs)
+            return [self._data_convert(b) for b in batches]
+
+    def get_batch_async(self, frame_indices: Iterable[int]) -> concurrent.futures.Future:
+        ''' Decode frames in a native background thread, without blocking.
+
+        Returns a `concurrent.futures.Future` of what `get_batch` returns.
+        Cancelling it skips decoding if it has not started. Await it in
+        asyncio with `await asyncio.wrap_future(future)`.
+
+        Requests of the same video are decoded one after another, in order,
+        and those of different videos in parallel. Do not call `get_batch` on
+        this video until its pending requests are done. The video sleeps
+        after its last pending request, unless kept awake.
+        '''
+        future = concurrent.futures.Future()
+        _ext.get_batch_async(self, frame_indices, future, self._data_convert,
+                             self._kept_awake == 0)
+        return future
+
+    def read_frames(self, start_frame=0, chunk_size=16) -> 'FrameReader':
+        ''' Iterate over frames from `start_frame` to the end, in chunks.
+
+        Unlike `get_batch`, memory does not grow with the number of frames,
+        and the first chunk is ready after decoding at most one GOP. Each
+        chunk is like the output of `get_batch` with up to `chunk_size`
+        frames. Do not read this video otherwise until the reader is closed.
+        '''
+        return FrameReader(self, start_frame, chunk_size)
+
     @contextlib.contextmanager
     def keep_awake(self):
         ''' Keep this video active to perform multiple read in a row
@@ -93,3 +389,202 @@ class Video(_ext._Video):
         ''' Whether this video is in sleeping state
         '''
         return super().is_sleeping()
+
+    def memory_usage(self) -> dict:
+        ''' Bytes held by this video
+
+        Returns a dict with "index_bytes", "demuxer_bytes" (estimated) and
+        "io_buffer_bytes". Updated when the video sleeps or wakes up.
+        '''
+        return super().memory_usage()
+
+
+class FrameReader(_ext._FrameReader):
+    ''' Decode consecutive frames of a video, see `Video.read_frames`.
+
+    The decoder is kept until the last chunk is read or `close()` is called,
+    then the video sleeps unless kept awake.
+    '''
+
+    def __init__(self, video: Video, start_frame=0, chunk_size=16):
+        self._video = video
+        self._data_convert = video._data_convert
+
+    def __next__(self):
+        try:
+            return self._data_convert(super().__next__())
+        except StopIteration:
+            self.close()
+            raise
+
+    def seek(self, frame_index: int):
+        ''' Continue from this frame. Frames ahead in the same GOP are
+        reached by decoding on, without seeking.
+        '''
+        super().seek(frame_index)
+
+    def tell(self) -> int:
+        ''' Index of the next frame to be returned.
+        '''
+        return super().tell()
+
+    def close(self):
+        ''' Free the decoder. The reader can not be used afterwards.
+
+        Raises ValueError while another thread is reading from it.
+        '''
+        super().close()
+        if self._video._kept_awake == 0:
+            self._video.sleep()
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc_info):
+        self.close()
+
+
+def _restore_video(video_type, state, data_container):
+    video = _ext._VideoCollection.from_bytes(state).open(video_type, 0)
+    video._set_data_container(data_container)
+    return video
+
+
+class VideoCollection(_ext._VideoCollection):
+    ''' Metadata of many videos in one flat buffer, to reopen any of them
+    without demuxing.
+
+    Cheaper than a list of `Video` to pickle, e.g. to send to `DataLoader`
+    worker processes, and to keep in memory shared by forked workers: it is
+    a single object, so reference counting does not touch a page per video.
+
+    * videos: Iterable of opened `Video`, e.g. from `open_video_tar`.
+
+    `collection[i]` opens the i-th video as a sleeping `Video`, reading only
+    its header. Files must stay at the same paths.
+    '''
+
+    # Set if mapped from a catalog file, which is pickled by path.
+    _catalog_path = None
+
+    def __getitem__(self, i: int):
+        return self.open(Video, i)
+
+    def __iter__(self):
+        return (self[i] for i in range(len(self)))
+
+    def __reduce__(self):
+        if self._catalog_path is not None:
+            return _restore_video_collection_catalog, (type(self), self._catalog_path)
+        return _restore_video_collection, (type(self), self.to_bytes())
+
+    @classmethod
+    def open_catalog(cls, path: Union[os.PathLike, str, bytes]):
+        ''' Map a catalog file written by `write_dataset_catalog`.
+
+        Processes opening the same catalog share one copy of it in page
+        cache. Pickling the returned collection only sends the path, so
+        each worker process maps the catalog itself.
+        '''
+        collection = super().open_catalog(path)
+        # Unpickled in workers which may have another working directory.
+        collection._catalog_path = os.path.abspath(os.fsdecode(path))
+        return collection
+
+    @classmethod
+    def from_bytes(cls, data):
+        ''' Use a buffer returned by `to_bytes()`, e.g. `bytes` or `mmap`,
+        without copying it.
+        '''
+        return super().from_bytes(data)
+
+    def to_bytes(self) -> bytes:
+        ''' The whole buffer, in native byte order.
+        '''
+        return super().to_bytes()
+
+    def path(self, i: int) -> str:
+        ''' Path of the file holding the i-th video, e.g. its tar.
+        '''
+        return super().path(i)
+
+    def num_frames(self, i: int) -> int:
+        ''' Number of frames of the i-th video, without opening it.
+        '''
+        return super().num_frames(i)
+
+
+def _restore_video_collection(collection_type, data):
+    return collection_type.from_bytes(data)
+
+
+def _restore_video_collection_catalog(collection_type, path):
+    return collection_type.open_catalog(path)
+
+
+def write_dataset_catalog(
+        catalog_path: Union[os.PathLike, str, bytes],
+        sources: Iterable[Union[os.PathLike, str, bytes]],
+        max_threads=4,
+        memory_map=False,
+        extensions: Union[str, Iterable[str], None] = None,
+        glob: Union[str, Iterable[str], None] = None,
+        regex: Optional[str] = None,
+        min_size=0,
+        max_size: Optional[int] = None) -> int:
+    ''' Open all videos of the sources once, and write their locations and
+    frame indices to a catalog file for `VideoCollection.open_catalog`.
+
+    * sources: Video files, tar files and directories. Directories are
+        walked recursively, tar files found in them are opened as tars. Files
+        of directories that fail to open are skipped with a warning.
+    * memory_map: Videos opened from the catalog read through a memory
+        mapping of their file.
+    * extensions, glob, regex, min_size, max_size: Same as `open_video_tar`,
+        select entries of tars and files of directories, by their whole path.
+
+    Paths are stored as absolute paths. The catalog file is replaced
+    atomically. Returns the number of videos in the catalog.
+    '''
+    return _ext.write_dataset_catalog(catalog_path, sources, max_threads, memory_map,
+                                      extensions, glob, regex, min_size,
+                                      -1 if max_size is None else max_size)
+
+
+class DatasetLoader(_ext._DatasetLoader):
+    ''' Load batches of clips in background threads.
+
+    Iterate over this object to get batches. Each batch is a list of clips, in
+    the same order as scheduled. Loading starts on construction.
+
+    * schedule: Iterable of batches. Each batch is a list of
+        `(video, frame_indices)`. Batches are pulled on demand, so it can be a
+        generator of unbounded length.
+    * max_threads: Max number of loading threads. Threads are paused
+        automatically if the consumer is slower.
+    * preload_batches: Max number of batches loaded ahead.
+    * max_preload: Max number of clips loaded ahead.
+    * max_preload_bytes: Max bytes of decoded clips loaded ahead. 0 for unlimited.
+    * max_preload_decode_time: Max predicted decoding time in seconds of clips
+        loaded ahead. 0 for unlimited.
+    * prefetch_threads: Read the byte ranges of each batch into page cache
+        ahead of decoding, with io_uring if available, otherwise with this
+        many threads. 0 to disable. Helps when IO latency is high, e.g.
+        network storage or HDD.
+    * data_container ('numpy' | 'pytorch' | None): Set the output format
+    '''
+
+    def __init__(self, schedule, max_threads=1, preload_batches=512, max_preload=512,
+                 max_preload_bytes=0, max_preload_decode_time=0., prefetch_threads=0,
+                 data_container='numpy'):
+        self._data_convert = _get_data_convert(data_container)
+        super().__init__(schedule, max_threads, preload_batches, max_preload,
+                         max_preload_bytes, max_preload_decode_time, prefetch_threads)
+
+    def __next__(self):
+        return [self._data_convert(clip) for clip in super().__next__()]
+
+    def stop(self):
+        ''' Stop all loading threads. Batches not yet returned are discarded.
+        '''
+        return super().stop()
@@ -0,0 +1,36 @@
+find_package(PkgConfig QUIET)
+if(PKG_CONFIG_FOUND)
+    pkg_check_modules(PC_LibUring QUIET liburing)
+    if(PC_LibUring_FOUND)
+        set(LibUring_VERSION_STRING ${PC_LibUring_VERSION})
+    endif()
+endif()
+
+find_path(LibUring_INCLUDE_DIR
+    NAMES liburing.h
+    HINTS ${PC_LibUring_INCLUDE_DIRS}
+)
+
+find_library(LibUring_LIBRARY
+    NAMES uring
+    HINTS ${PC_LibUring_LIBRARY_DIRS}
+)
+
+mark_as_advanced(LibUring_INCLUDE_DIR LibUring_LIBRARY)
+
+if(LibUring_INCLUDE_DIR AND LibUring_LIBRARY)
+    if(NOT TARGET LibUring::LibUring)
+        add_library(LibUring::LibUring UNKNOWN IMPORTED)
+        set_target_properties(LibUring::LibUring PROPERTIES
+            IMPORTED_LOCATION "${LibUring_LIBRARY}"
+            INTERFACE_COMPILE_OPTIONS "${PC_LibUring_CFLAGS_OTHER}"
+            INTERFACE_INCLUDE_DIRECTORIES "${LibUring_INCLUDE_DIR}"
+        )
+    endif()
+endif()
+
+include(FindPackageHandleStandardArgs)
+find_package_handle_standard_args(LibUring
+    REQUIRED_VARS LibUring_LIBRARY LibUring_INCLUDE_DIR
+    VERSION_VAR LibUring_VERSION_STRING
+)
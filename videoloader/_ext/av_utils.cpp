@@ -2,6 +2,10 @@
 
 #include <sstream>
 
+extern "C" {
+#include <libavutil/pixdesc.h>
+}
+
 namespace huww {
 namespace videoloader {
 
@@ -18,5 +22,24 @@ std::string get_message(int error_code, std::string message) {
 av_error::av_error(int error_code, std::string message)
     : std::runtime_error(get_message(error_code, message)), _code(error_code) {}
 
+int packed_pixel_size(AVPixelFormat pix_fmt) {
+    auto desc = av_pix_fmt_desc_get(pix_fmt);
+    constexpr auto unsupported_flags = AV_PIX_FMT_FLAG_PLANAR | AV_PIX_FMT_FLAG_PAL |
+                                       AV_PIX_FMT_FLAG_BITSTREAM | AV_PIX_FMT_FLAG_HWACCEL;
+    bool supported = desc && !(desc->flags & unsupported_flags) && desc->log2_chroma_w == 0 &&
+                     desc->log2_chroma_h == 0;
+    for (int c = 0; supported && c < desc->nb_components; c++) {
+        supported = desc->comp[c].depth == 8 && desc->comp[c].step == desc->comp[0].step;
+    }
+    if (!supported) {
+        auto name = av_get_pix_fmt_name(pix_fmt);
+        std::ostringstream msg;
+        msg << "Unsupported output pixel format " << (name ? name : "unknown")
+            << ", should be packed with 8 bits per channel";
+        throw std::invalid_argument(msg.str());
+    }
+    return desc->comp[0].step;
+}
+
 } // namespace videoloader
 } // namespace huww
@@ -8,6 +8,7 @@
 extern "C" {
 #include <libavutil/error.h>
 #include <libavutil/frame.h>
+#include <libavutil/pixfmt.h>
 }
 
 namespace huww {
@@ -46,5 +47,13 @@ inline auto new_avframe() {
     return avframe_ptr(CHECK_AV(av_frame_alloc(), "alloc AVFrame failed"));
 }
 
+/**
+ * Bytes of a pixel in a packed format with 8 bits per channel, e.g. 3 for RGB24, which is the
+ * number of channels of its tensors.
+ *
+ * \throw std::invalid_argument if the format is planar, subsampled or not 8 bits per channel.
+ */
+int packed_pixel_size(AVPixelFormat pix_fmt);
+
 } // namespace videoloader
 } // namespace huww
@@ -2,6 +2,8 @@
 
 #include <assert.h>
 #include <memory>
+#include <stdexcept>
+#include <string>
 
 extern "C" {
 #include <libavcodec/avcodec.h>
@@ -19,8 +21,15 @@ auto new_avfilter_graph() {
     return ffavgraph_ptr(CHECK_AV(avfilter_graph_alloc(), "failed to alloc avfilter_graph"));
 }
 
-avfilter_graph::avfilter_graph(AVCodecContext &decode_context, AVRational time_base)
-    : graph(new_avfilter_graph()), filtered_frame(new_avframe()) {
+avfilter_graph::avfilter_graph(AVCodecContext &decode_context, AVRational time_base,
+                               const std::vector<output_spec> &outputs)
+    : graph(new_avfilter_graph()) {
+    if (outputs.empty()) {
+        throw std::invalid_argument("At least one output is required");
+    }
+    for (auto &spec : outputs) {
+        packed_pixel_size(spec.pix_fmt);
+    }
 
     graph->thread_type = 0;
     avfilter_graph_set_auto_convert(graph.get(), AVFILTER_AUTO_CONVERT_NONE);
@@ -41,34 +50,59 @@ avfilter_graph::avfilter_graph(AVCodecContext &decode_context, AVRational time_b
              "failed to set buffer source parameters");
     CHECK_AV(avfilter_init_str(buffersrc_ctx, nullptr), "failed to initialize buffer source");
 
-    CHECK_AV(avfilter_graph_create_filter(&buffersink_ctx, buffersink, "out", nullptr, nullptr,
-                                          graph.get()),
-             "failed to create buffer sink");
-
-    static AVPixelFormat pix_fmts[] = {AV_PIX_FMT_RGB24, AV_PIX_FMT_NONE};
-    CHECK_AV(av_opt_set_int_list(buffersink_ctx, "pix_fmts", pix_fmts, AV_PIX_FMT_NONE,
-                                 AV_OPT_SEARCH_CHILDREN),
-             "failed to set output pixel format");
+    auto split_ctx = buffersrc_ctx;
+    if (outputs.size() > 1) {
+        auto split = avfilter_get_by_name("split");
+        CHECK_AV(avfilter_graph_create_filter(&split_ctx, split, "split",
+                                              std::to_string(outputs.size()).c_str(), nullptr,
+                                              graph.get()),
+                 "create split filter failed");
+        CHECK_AV(avfilter_link(buffersrc_ctx, 0, split_ctx, 0), "link split failed");
+    }
 
     auto scale = avfilter_get_by_name("scale");
-    AVFilterContext *scale_ctx;
-    CHECK_AV(
-        avfilter_graph_create_filter(&scale_ctx, scale, "scale", nullptr, nullptr, graph.get()),
-        "create scale filter failed");
-
-    CHECK_AV(avfilter_link(buffersrc_ctx, 0, scale_ctx, 0), "link buffersrc failed");
-    CHECK_AV(avfilter_link(scale_ctx, 0, buffersink_ctx, 0), "link buffersink failed");
+    for (size_t i = 0; i < outputs.size(); i++) {
+        auto &spec = outputs[i];
+        auto suffix = std::to_string(i);
+        AVFilterContext *buffersink_ctx;
+        CHECK_AV(avfilter_graph_create_filter(&buffersink_ctx, buffersink, ("out" + suffix).c_str(),
+                                              nullptr, nullptr, graph.get()),
+                 "failed to create buffer sink");
+
+        AVPixelFormat pix_fmts[] = {spec.pix_fmt, AV_PIX_FMT_NONE};
+        CHECK_AV(av_opt_set_int_list(buffersink_ctx, "pix_fmts", pix_fmts, AV_PIX_FMT_NONE,
+                                     AV_OPT_SEARCH_CHILDREN),
+                 "failed to set output pixel format");
+
+        // Scale and convert pixel format in one pass.
+        auto scale_args = "w=" + std::to_string(spec.width) + ":h=" + std::to_string(spec.height);
+        AVFilterContext *scale_ctx;
+        CHECK_AV(avfilter_graph_create_filter(&scale_ctx, scale, ("scale" + suffix).c_str(),
+                                              scale_args.c_str(), nullptr, graph.get()),
+                 "create scale filter failed");
+
+        CHECK_AV(avfilter_link(split_ctx, split_ctx == buffersrc_ctx ? 0 : i, scale_ctx, 0),
+                 "link buffersrc failed");
+        CHECK_AV(avfilter_link(scale_ctx, 0, buffersink_ctx, 0), "link buffersink failed");
+        buffersink_ctxs.push_back(buffersink_ctx);
+        filtered_frames.push_back(new_avframe());
+    }
 
     CHECK_AV(avfilter_graph_config(graph.get(), nullptr), "avfilter_graph_config failed");
 }
 
 AVFrame *avfilter_graph::process_frame(AVFrame *src) {
+    for (auto &frame : filtered_frames) {
+        av_frame_unref(frame.get());
+    }
     // assume one frame output per input frame.
     CHECK_AV(av_buffersrc_add_frame(this->buffersrc_ctx, src),
              "Error while feeding the filtergraph");
-    CHECK_AV(av_buffersink_get_frame(this->buffersink_ctx, this->filtered_frame.get()),
-             "Error while getting frame from the filtergraph");
-    return this->filtered_frame.get();
+    for (size_t i = 0; i < buffersink_ctxs.size(); i++) {
+        CHECK_AV(av_buffersink_get_frame(buffersink_ctxs[i], filtered_frames[i].get()),
+                 "Error while getting frame from the filtergraph");
+    }
+    return filtered_frames[0].get();
 }
 
 } // namespace videoloader
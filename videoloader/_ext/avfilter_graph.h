@@ -1,6 +1,7 @@
 #pragma once
 
 #include <memory>
+#include <vector>
 
 extern "C" {
 #include <libavcodec/avcodec.h>
@@ -18,16 +19,37 @@ struct avfilter_graph_deleter {
 
 using ffavgraph_ptr = std::unique_ptr<::AVFilterGraph, avfilter_graph_deleter>;
 
+/** Size and pixel format of frames output by a filter graph. */
+struct output_spec {
+    int width = 0;  /**< 0 for the width of the video, -1 to keep its aspect ratio */
+    int height = 0; /**< 0 for the height of the video, -1 to keep its aspect ratio */
+    /** Packed with 8 bits per channel, see `packed_pixel_size()` */
+    AVPixelFormat pix_fmt = AV_PIX_FMT_RGB24;
+};
+
 class avfilter_graph {
   private:
     ffavgraph_ptr graph;
     AVFilterContext *buffersrc_ctx;
-    AVFilterContext *buffersink_ctx;
-    avframe_ptr filtered_frame;
+    std::vector<AVFilterContext *> buffersink_ctxs;
+    std::vector<avframe_ptr> filtered_frames;
 
   public:
-    avfilter_graph(AVCodecContext &decode_context, AVRational time_base);
+    /**
+     * Convert decoded frames to each of `outputs`. With several outputs, decoded frames are split
+     * without copying, and each output is scaled and converted from them in one pass.
+     *
+     * \throw std::invalid_argument if `outputs` is empty or has an unsupported pixel format.
+     */
+    avfilter_graph(AVCodecContext &decode_context, AVRational time_base,
+                   const std::vector<output_spec> &outputs = {output_spec{}});
+    /**
+     * Filter a frame, return its first output. Outputs of the previous frame are unreferenced.
+     */
     AVFrame *process_frame(AVFrame *src);
+    /** The i-th output of the last processed frame */
+    AVFrame *output(size_t i) noexcept { return filtered_frames[i].get(); }
+    size_t num_outputs() const noexcept { return filtered_frames.size(); }
 };
 
 } // namespace videoloader
@@ -1,6 +1,7 @@
 #include "avformat.h"
 
 #include "av_utils.h"
+#include "stage_stats.h"
 
 namespace huww {
 namespace videoloader {
@@ -34,7 +35,7 @@ void avformat::dispose() {
     avformat_close_input(&this->fmt_ctx);
 }
 
-file_io &get_file_io(avio_context_ptr &ctx) { return *static_cast<file_io *>(ctx->opaque); }
+file_io &get_file_io(const avio_context_ptr &ctx) { return *static_cast<file_io *>(ctx->opaque); }
 
 void avformat::sleep() {
     if (!is_sleeping()) {
@@ -47,6 +48,7 @@ void avformat::sleep() {
 
 void avformat::wake_up() {
     if (this->is_sleeping()) {
+        VIDEOLOADER_STAGE_TIMER(wake_up);
         get_file_io(this->io_context).wake_up();
         io_context->buffer = (uint8_t *)av_malloc(IO_BUFFER_SIZE);
         io_context->buffer_size = io_context->orig_buffer_size = IO_BUFFER_SIZE;
@@ -56,5 +58,40 @@ void avformat::wake_up() {
 
 bool avformat::is_sleeping() { return get_file_io(this->io_context).is_sleeping(); }
 
+static int num_index_entries(AVStream *stream) {
+#if LIBAVFORMAT_VERSION_INT >= AV_VERSION_INT(58, 78, 100)
+    return avformat_index_get_entries_count(stream);
+#else
+    return stream->nb_index_entries;
+#endif
+}
+
+size_t avformat::demuxer_memory_usage() noexcept {
+    size_t size = sizeof(AVFormatContext) + sizeof(AVIOContext);
+    for (unsigned i = 0; i < this->fmt_ctx->nb_streams; i++) {
+        auto stream = this->fmt_ctx->streams[i];
+        size += sizeof(AVStream) + sizeof(AVCodecParameters) + stream->codecpar->extradata_size +
+                num_index_entries(stream) * sizeof(AVIndexEntry);
+    }
+    return size;
+}
+
+void avformat::will_need(int64_t pos, int64_t size) noexcept {
+    get_file_io(this->io_context).will_need(pos, size);
+}
+
+file_range avformat::input_range(int64_t pos, int64_t size) const {
+    return get_file_io(this->io_context).absolute_range(pos, size);
+}
+
+file_io::file_spec avformat::input_spec() const {
+    return get_file_io(this->io_context).reopen_spec();
+}
+
+size_t avformat::io_buffer_size() noexcept {
+    return (this->io_context->buffer ? this->io_context->buffer_size : 0) +
+           get_file_io(this->io_context).buffer_size();
+}
+
 } // namespace videoloader
 } // namespace huww
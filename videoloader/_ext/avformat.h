@@ -28,6 +28,18 @@ class avformat {
     void sleep();
     void wake_up();
     bool is_sleeping();
+    /**
+     * Estimated bytes held by the format context and its streams. Private data of demuxer is not
+     * included.
+     */
+    size_t demuxer_memory_usage() noexcept;
+    size_t io_buffer_size() noexcept;
+    /** Hint that the byte range of the input will be read soon. */
+    void will_need(int64_t pos, int64_t size) noexcept;
+    /** Locate a byte range of the input in the underlying file. Thread safe. */
+    file_range input_range(int64_t pos, int64_t size) const;
+    /** Spec to open the same input again, see `file_io::reopen_spec()`. Thread safe. */
+    file_io::file_spec input_spec() const;
     AVFormatContext *format_context() { return this->fmt_ctx; }
 };
 
@@ -0,0 +1,62 @@
+#include "benchmark_options.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <system_error>
+
+namespace huww {
+namespace videoloader {
+namespace benchmark {
+
+namespace fs = std::filesystem;
+
+std::string argument_parser::value() {
+    if (i + 1 >= argc) {
+        throw std::invalid_argument(arg() + " requires a value");
+    }
+    return argv[++i];
+}
+
+bool common_options::parse(argument_parser &args) {
+    auto arg = args.arg();
+    if (arg == "--output") {
+        output = args.value();
+    } else if (arg == "--work-dir") {
+        work_dir = args.value();
+        keep_work_dir = true;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+void common_options::create_work_dir() {
+    if (!work_dir.empty()) {
+        fs::create_directories(work_dir);
+        return;
+    }
+    std::string dir = (fs::temp_directory_path() / "videoloader_benchmark_XXXXXX").string();
+    if (!mkdtemp(dir.data())) {
+        throw std::system_error(errno, std::system_category(), "mkdtemp failed");
+    }
+    work_dir = dir;
+}
+
+void common_options::finish(const benchmark_report &report) const {
+    if (output.empty()) {
+        report.write(std::cout);
+    } else {
+        std::ofstream out(output);
+        report.write(out);
+    }
+    if (!keep_work_dir) {
+        fs::remove_all(work_dir);
+    }
+}
+
+} // namespace benchmark
+} // namespace videoloader
+} // namespace huww
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <filesystem>
+#include <string>
+
+#include "benchmark_report.h"
+
+namespace huww {
+namespace videoloader {
+namespace benchmark {
+
+/** Walk the command line arguments of a benchmark. */
+class argument_parser {
+    int argc;
+    char const **argv;
+    int i = 0;
+
+  public:
+    argument_parser(int argc, char const *argv[]) : argc(argc), argv(argv) {}
+
+    /** Move to the next argument, return false after the last one. */
+    bool next() { return ++i < argc; }
+    std::string arg() const { return argv[i]; }
+    /**
+     * Take the value following the current argument.
+     *
+     * \throw std::invalid_argument if there is none.
+     */
+    std::string value();
+};
+
+/**
+ * Options shared by benchmarks: `--output <json>` and `--work-dir <dir>`.
+ *
+ * `--work-dir` keeps generated files there to be reused by later runs, otherwise they are written
+ * to a temporary directory and removed.
+ */
+struct common_options {
+    std::string output; /**< Write the report to stdout if empty */
+    std::filesystem::path work_dir;
+    bool keep_work_dir = false;
+
+    /** Parse the current argument if it is a shared option, return false otherwise. */
+    bool parse(argument_parser &args);
+    /** Create `work_dir`, or a temporary directory if it is not given. */
+    void create_work_dir();
+    /** Write `report` to `output`, then remove `work_dir` unless it is kept. */
+    void finish(const benchmark_report &report) const;
+};
+
+} // namespace benchmark
+} // namespace videoloader
+} // namespace huww
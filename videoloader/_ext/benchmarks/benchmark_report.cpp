@@ -0,0 +1,148 @@
+#include "benchmark_report.h"
+
+#include <algorithm>
+#include <ctime>
+#include <iomanip>
+#include <numeric>
+#include <thread>
+
+extern "C" {
+#include <libavutil/avutil.h>
+}
+
+namespace huww {
+namespace videoloader {
+namespace benchmark {
+
+double timing::mean() const {
+    return seconds.empty() ? 0 : std::accumulate(seconds.begin(), seconds.end(), 0.) / seconds.size();
+}
+
+double timing::min() const {
+    return seconds.empty() ? 0 : *std::min_element(seconds.begin(), seconds.end());
+}
+
+double timing::median() const {
+    if (seconds.empty()) {
+        return 0;
+    }
+    auto sorted = seconds;
+    std::sort(sorted.begin(), sorted.end());
+    auto n = sorted.size();
+    return n % 2 ? sorted[n / 2] : (sorted[n / 2 - 1] + sorted[n / 2]) / 2;
+}
+
+benchmark_report::benchmark_report() {
+    auto now = std::time(nullptr);
+    std::tm tm;
+    gmtime_r(&now, &tm);
+    char date[32];
+    std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", &tm);
+    add_context("date", std::string(date));
+    add_context("num_cpus", int64_t(std::thread::hardware_concurrency()));
+    add_context("ffmpeg_version", std::string(av_version_info()));
+#ifdef NDEBUG
+    add_context("build_type", std::string("release"));
+#else
+    add_context("build_type", std::string("debug"));
+#endif
+}
+
+void benchmark_report::add_context(std::string key, value v) {
+    context.emplace_back(std::move(key), std::move(v));
+}
+
+void benchmark_report::add(std::string name, fields f) {
+    f.insert(f.begin(), {"name", std::move(name)});
+    results.push_back(std::move(f));
+}
+
+void benchmark_report::add(std::string name, fields f, const timing &t) {
+    f.emplace_back("iterations", int64_t(t.seconds.size()));
+    f.emplace_back("mean_ms", t.mean() * 1e3);
+    f.emplace_back("min_ms", t.min() * 1e3);
+    f.emplace_back("median_ms", t.median() * 1e3);
+    add(std::move(name), std::move(f));
+}
+
+void benchmark_report::skip(std::string name, std::string reason) {
+    skipped.push_back({{"name", std::move(name)}, {"reason", std::move(reason)}});
+}
+
+static void write_string(std::ostream &out, const std::string &s) {
+    out << '"';
+    for (auto c : s) {
+        switch (c) {
+        case '"':
+            out << "\\\"";
+            break;
+        case '\\':
+            out << "\\\\";
+            break;
+        case '\n':
+            out << "\\n";
+            break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20) {
+                out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << int(c)
+                    << std::dec << std::setfill(' ');
+            } else {
+                out << c;
+            }
+        }
+    }
+    out << '"';
+}
+
+static void write_fields(std::ostream &out, const benchmark_report::fields &f) {
+    out << '{';
+    for (size_t i = 0; i < f.size(); i++) {
+        if (i > 0) {
+            out << ", ";
+        }
+        write_string(out, f[i].first);
+        out << ": ";
+        std::visit(
+            [&out](auto &v) {
+                using T = std::decay_t<decltype(v)>;
+                if constexpr (std::is_same_v<T, std::string>) {
+                    write_string(out, v);
+                } else if constexpr (std::is_same_v<T, std::vector<double>>) {
+                    out << '[';
+                    for (size_t j = 0; j < v.size(); j++) {
+                        out << (j > 0 ? ", " : "") << v[j];
+                    }
+                    out << ']';
+                } else {
+                    out << v;
+                }
+            },
+            f[i].second);
+    }
+    out << '}';
+}
+
+static void write_list(std::ostream &out, const std::vector<benchmark_report::fields> &list) {
+    out << '[';
+    for (size_t i = 0; i < list.size(); i++) {
+        out << (i > 0 ? ",\n    " : "\n    ");
+        write_fields(out, list[i]);
+    }
+    out << (list.empty() ? "]" : "\n  ]");
+}
+
+void benchmark_report::write(std::ostream &out) const {
+    auto precision = out.precision(6);
+    out << "{\n  \"context\": ";
+    write_fields(out, context);
+    out << ",\n  \"benchmarks\": ";
+    write_list(out, results);
+    out << ",\n  \"skipped\": ";
+    write_list(out, skipped);
+    out << "\n}\n";
+    out.precision(precision);
+}
+
+} // namespace benchmark
+} // namespace videoloader
+} // namespace huww
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <variant>
+#include <vector>
+
+namespace huww {
+namespace videoloader {
+namespace benchmark {
+
+/** Durations of repeated runs, in seconds. */
+struct timing {
+    std::vector<double> seconds;
+
+    double mean() const;
+    double min() const;
+    double median() const;
+};
+
+/** Run `f` once to warm up, then `repeat` times. */
+template <typename F> timing measure(int repeat, F &&f) {
+    using clock = std::chrono::steady_clock;
+    f();
+    timing result;
+    for (int i = 0; i < repeat; i++) {
+        auto start = clock::now();
+        f();
+        result.seconds.push_back(std::chrono::duration<double>(clock::now() - start).count());
+    }
+    return result;
+}
+
+/**
+ * Results of a benchmark run, written as JSON for regression tracking:
+ *
+ *     {"context": {...}, "benchmarks": [{"name": ..., <fields>}, ...], "skipped": [...]}
+ */
+class benchmark_report {
+  public:
+    using value = std::variant<int64_t, double, std::string, std::vector<double>>;
+    using fields = std::vector<std::pair<std::string, value>>;
+
+  private:
+    fields context;
+    std::vector<fields> results;
+    std::vector<fields> skipped;
+
+  public:
+    /** Fill context with the date, CPU count and library versions. */
+    benchmark_report();
+
+    void add_context(std::string key, value v);
+    /** Add a result. `timing` adds its iteration count, mean, min and median in milliseconds. */
+    void add(std::string name, fields f);
+    void add(std::string name, fields f, const timing &t);
+    void skip(std::string name, std::string reason);
+
+    void write(std::ostream &out) const;
+};
+
+} // namespace benchmark
+} // namespace videoloader
+} // namespace huww
@@ -0,0 +1,102 @@
+/**
+ * Compare per-read overhead of `std::ifstream` seek + read against `pread` on a shared descriptor.
+ *
+ * Reads are of `IO_BUFFER_SIZE`, the size requested by AVIOContext. Run it twice so that the file
+ * is in page cache and only the per-read overhead is measured.
+ *
+ * Usage: file_read_benchmark <file> [num_reads] [num_threads]
+ */
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "file_descriptor.h"
+#include "file_io.h"
+
+using namespace huww::videoloader;
+
+using bench_clock = std::chrono::steady_clock;
+
+static std::vector<int64_t> make_offsets(int64_t file_size, size_t num_reads, bool random) {
+    std::vector<int64_t> offsets(num_reads);
+    auto max_offset = std::max<int64_t>(file_size - IO_BUFFER_SIZE, 1);
+    std::mt19937_64 rng(42);
+    for (size_t i = 0; i < num_reads; i++) {
+        offsets[i] = random ? rng() % max_offset : (i * IO_BUFFER_SIZE) % max_offset;
+    }
+    return offsets;
+}
+
+/** Each thread reads with its own stream, as `open_video_tar` did. */
+static double bench_ifstream(const std::string &path, const std::vector<int64_t> &offsets,
+                             int num_threads) {
+    std::vector<std::thread> threads;
+    auto start = bench_clock::now();
+    for (int t = 0; t < num_threads; t++) {
+        threads.emplace_back([&] {
+            std::ifstream stream(path, std::ios::binary);
+            std::vector<char> buf(IO_BUFFER_SIZE);
+            for (auto offset : offsets) {
+                stream.seekg(offset);
+                stream.read(buf.data(), buf.size());
+                if (!stream) {
+                    stream.clear();
+                }
+            }
+        });
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+    return std::chrono::duration<double>(bench_clock::now() - start).count();
+}
+
+/** All threads share one descriptor. */
+static double bench_pread(const std::string &path, const std::vector<int64_t> &offsets,
+                          int num_threads) {
+    auto fd = std::make_shared<const file_descriptor>(path);
+    std::vector<std::thread> threads;
+    auto start = bench_clock::now();
+    for (int t = 0; t < num_threads; t++) {
+        threads.emplace_back([&] {
+            std::vector<uint8_t> buf(IO_BUFFER_SIZE);
+            for (auto offset : offsets) {
+                if (fd->pread(buf.data(), buf.size(), offset) < 0) {
+                    throw std::system_error(errno, std::system_category(), "pread failed");
+                }
+            }
+        });
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+    return std::chrono::duration<double>(bench_clock::now() - start).count();
+}
+
+int main(int argc, char const *argv[]) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <file> [num_reads] [num_threads]" << std::endl;
+        return 1;
+    }
+    std::string path = argv[1];
+    size_t num_reads = argc > 2 ? std::stoul(argv[2]) : 100000;
+    int num_threads = argc > 3 ? std::stoi(argv[3]) : 1;
+
+    auto file_size = file_descriptor(path).size();
+    for (bool random : {false, true}) {
+        auto offsets = make_offsets(file_size, num_reads, random);
+        auto total_reads = static_cast<double>(num_reads * num_threads);
+        auto ifstream_time = bench_ifstream(path, offsets, num_threads);
+        auto pread_time = bench_pread(path, offsets, num_threads);
+        std::cout << (random ? "random" : "sequential") << " reads, " << num_threads
+                  << " threads:\n"
+                  << "  ifstream: " << ifstream_time / total_reads * 1e9 << " ns/read\n"
+                  << "  pread:    " << pread_time / total_reads * 1e9 << " ns/read\n";
+    }
+    return 0;
+}
@@ -0,0 +1,307 @@
+/**
+ * Drive `video_dataset_loader` with a synthetic consumer, to see whether its worker controller
+ * reaches peak throughput and how stable it is.
+ *
+ * First the consumer takes batches as fast as possible with each thread count, which shows how
+ * throughput scales. Then, with all threads, it takes batches at fractions of that peak, like a
+ * training step of fixed length, where the loader should run just enough workers to keep up.
+ *
+ * For each run, reports throughput, tail latency of `get_next_batch()`, and a timeline of active
+ * workers and preloaded clips sampled from `video_dataset_loader::status()`. Frequent changes of
+ * active workers mean the controller oscillates.
+ *
+ * Usage: loader_scaling_benchmark [--output <json>] [--work-dir <dir>] [--threads <n,...>]
+ *            [--consume-rates <batches per second,...>] [--relative-rates <fraction,...>]
+ *            [--duration <seconds>] [--warmup <seconds>] [--batch-size <n>] [--max-preload <n>]
+ */
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <filesystem>
+#include <numeric>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "benchmark_options.h"
+#include "benchmark_report.h"
+#include "synthetic_video.h"
+#include "video.h"
+#include "video_dataset_loader.h"
+
+using namespace huww::videoloader;
+using namespace huww::videoloader::benchmark;
+namespace fs = std::filesystem;
+using bench_clock = std::chrono::steady_clock;
+
+constexpr size_t num_files = 8;
+constexpr size_t frames_per_clip = 16;
+constexpr size_t preload_batches = 8;
+constexpr auto sample_interval = std::chrono::milliseconds(50);
+
+struct options : common_options {
+    std::vector<int> threads;
+    std::vector<double> consume_rates;
+    std::vector<double> relative_rates = {0.25, 0.5, 0.75};
+    double duration = 10;
+    double warmup = 2;
+    size_t batch_size = 8;
+    size_t max_preload = 64;
+};
+
+template <typename T> static std::vector<T> parse_list(const std::string &s) {
+    std::vector<T> list;
+    std::istringstream in(s);
+    std::string item;
+    while (std::getline(in, item, ',')) {
+        list.push_back(static_cast<T>(std::stod(item)));
+    }
+    return list;
+}
+
+static options parse_options(int argc, char const *argv[]) {
+    options opts;
+    argument_parser args(argc, argv);
+    while (args.next()) {
+        auto arg = args.arg();
+        if (opts.parse(args)) {
+            continue;
+        }
+        if (arg == "--threads") {
+            opts.threads = parse_list<int>(args.value());
+        } else if (arg == "--consume-rates") {
+            opts.consume_rates = parse_list<double>(args.value());
+        } else if (arg == "--relative-rates") {
+            opts.relative_rates = parse_list<double>(args.value());
+        } else if (arg == "--duration") {
+            opts.duration = std::stod(args.value());
+        } else if (arg == "--warmup") {
+            opts.warmup = std::stod(args.value());
+        } else if (arg == "--batch-size") {
+            opts.batch_size = std::stoul(args.value());
+        } else if (arg == "--max-preload") {
+            opts.max_preload = std::stoul(args.value());
+        } else {
+            throw std::invalid_argument("Unknown argument " + arg);
+        }
+    }
+    if (opts.threads.empty()) {
+        int max_threads = std::max(1u, std::thread::hardware_concurrency());
+        for (int t = 1; t < max_threads; t *= 2) {
+            opts.threads.push_back(t);
+        }
+        opts.threads.push_back(max_threads);
+    }
+    return opts;
+}
+
+/** Generate videos, return their paths. */
+static std::vector<std::string> prepare_videos(const fs::path &work_dir) {
+    synthetic_video_spec spec;
+    if (!has_encoder(spec.codec)) {
+        spec.codec = "mpeg4";
+    }
+    std::vector<std::string> paths;
+    for (size_t i = 0; i < num_files; i++) {
+        auto path = (work_dir / (spec.name() + "_" + std::to_string(i) + ".mp4")).string();
+        if (!fs::exists(path)) {
+            std::cerr << "Generating " << path << std::endl;
+            write_synthetic_video(path, spec);
+        }
+        paths.push_back(path);
+    }
+    return paths;
+}
+
+/**
+ * Clips cycled through by the producer. A video can not be read by two workers at once, so there
+ * are enough video objects that one is reused only after its previous clip is consumed.
+ */
+static std::vector<video> open_video_pool(const std::vector<std::string> &paths, size_t size) {
+    std::vector<video> pool;
+    pool.reserve(size);
+    std::vector<video> originals;
+    for (auto &path : paths) {
+        originals.emplace_back(path).sleep();
+    }
+    for (size_t i = 0; i < size; i++) {
+        auto &original = originals[i % originals.size()];
+        pool.emplace_back(file_io::file_spec{.path = paths[i % paths.size()]},
+                          original.video_stream_index(), original.frame_index());
+        pool.back().sleep();
+    }
+    return pool;
+}
+
+static double percentile(std::vector<double> sorted, double p) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    std::sort(sorted.begin(), sorted.end());
+    auto rank = static_cast<size_t>(std::ceil(p * sorted.size()));
+    return sorted[std::clamp<size_t>(rank, 1, sorted.size()) - 1];
+}
+
+static double mean(const std::vector<double> &v) {
+    return v.empty() ? 0 : std::accumulate(v.begin(), v.end(), 0.) / v.size();
+}
+
+static double stddev(const std::vector<double> &v) {
+    auto m = mean(v);
+    double sum = 0;
+    for (auto x : v) {
+        sum += (x - m) * (x - m);
+    }
+    return v.empty() ? 0 : std::sqrt(sum / v.size());
+}
+
+struct run_result {
+    double batches_per_second;
+    benchmark_report::fields fields;
+};
+
+/** \param consume_rate Batches per second taken by the consumer, 0 for as fast as possible. */
+static run_result run(std::vector<video> &pool, const options &opts, int threads,
+                      double consume_rate) {
+    std::mt19937_64 rng(42);
+    size_t next_clip = 0;
+    dataset_batch_producer producer = [&]() -> std::optional<dataset_load_batch> {
+        dataset_load_batch batch;
+        for (size_t i = 0; i < opts.batch_size; i++) {
+            auto &v = pool[next_clip++ % pool.size()];
+            auto n = std::min(frames_per_clip, v.num_frames());
+            auto start = rng() % (v.num_frames() - n + 1);
+            std::vector<size_t> indices(n);
+            std::iota(indices.begin(), indices.end(), start);
+            batch.push_back({.video = v, .frame_indices = std::move(indices)});
+        }
+        return batch;
+    };
+    video_dataset_loader loader(producer, preload_batches);
+    preload_limits limits;
+    limits.max_clips = opts.max_preload;
+    loader.set_preload_limits(limits);
+    loader.start(threads);
+
+    auto warmup_end = bench_clock::now() + std::chrono::duration_cast<bench_clock::duration>(
+                                               std::chrono::duration<double>(opts.warmup));
+    while (bench_clock::now() < warmup_end) {
+        loader.get_next_batch();
+    }
+
+    std::vector<double> active_workers, preloaded_clips;
+    std::atomic<bool> sampling = true;
+    std::thread sampler([&] {
+        while (sampling.load(std::memory_order_relaxed)) {
+            auto status = loader.status();
+            active_workers.push_back(status.active_workers);
+            preloaded_clips.push_back(status.preloaded_clips);
+            std::this_thread::sleep_for(sample_interval);
+        }
+    });
+
+    std::vector<double> latencies_ms;
+    auto start = bench_clock::now();
+    auto end = start + std::chrono::duration_cast<bench_clock::duration>(
+                           std::chrono::duration<double>(opts.duration));
+    auto step = std::chrono::duration_cast<bench_clock::duration>(
+        std::chrono::duration<double>(consume_rate > 0 ? 1 / consume_rate : 0));
+    auto next_consume = start;
+    size_t num_batches = 0;
+    while (bench_clock::now() < end) {
+        auto t = bench_clock::now();
+        loader.get_next_batch();
+        latencies_ms.push_back(
+            std::chrono::duration<double, std::milli>(bench_clock::now() - t).count());
+        num_batches++;
+        if (consume_rate > 0) {
+            // Simulate a training step, without catching up after a slow batch.
+            next_consume = std::max(next_consume + step, bench_clock::now());
+            std::this_thread::sleep_until(next_consume);
+        }
+    }
+    auto elapsed = std::chrono::duration<double>(bench_clock::now() - start).count();
+    sampling = false;
+    sampler.join();
+    loader.stop();
+
+    size_t worker_changes = 0;
+    for (size_t i = 1; i < active_workers.size(); i++) {
+        worker_changes += active_workers[i] != active_workers[i - 1];
+    }
+    auto batches_per_second = num_batches / elapsed;
+    return {
+        batches_per_second,
+        {
+            {"threads", int64_t(threads)},
+            {"consume_rate", consume_rate},
+            {"batch_size", int64_t(opts.batch_size)},
+            {"max_preload", int64_t(opts.max_preload)},
+            {"batches", int64_t(num_batches)},
+            {"batches_per_second", batches_per_second},
+            {"clips_per_second", batches_per_second * opts.batch_size},
+            {"latency_p50_ms", percentile(latencies_ms, 0.5)},
+            {"latency_p90_ms", percentile(latencies_ms, 0.9)},
+            {"latency_p99_ms", percentile(latencies_ms, 0.99)},
+            {"latency_max_ms", percentile(latencies_ms, 1)},
+            {"active_workers_mean", mean(active_workers)},
+            {"active_workers_stddev", stddev(active_workers)},
+            {"active_workers_changes_per_second", worker_changes / elapsed},
+            {"preloaded_clips_mean", mean(preloaded_clips)},
+            {"preloaded_clips_max", percentile(preloaded_clips, 1)},
+            {"sample_interval_ms", double(sample_interval.count())},
+            {"timeline_active_workers", active_workers},
+            {"timeline_preloaded_clips", preloaded_clips},
+        },
+    };
+}
+
+int main(int argc, char const *argv[]) {
+    options opts;
+    try {
+        opts = parse_options(argc, argv);
+    } catch (std::exception &e) {
+        std::cerr << e.what() << "\nUsage: " << argv[0]
+                  << " [--output <json>] [--work-dir <dir>] [--threads <n,...>]"
+                     " [--consume-rates <batches per second,...>]"
+                     " [--relative-rates <fraction,...>] [--duration <seconds>]"
+                     " [--warmup <seconds>] [--batch-size <n>] [--max-preload <n>]"
+                  << std::endl;
+        return 1;
+    }
+    opts.create_work_dir();
+    benchmark_report report;
+    report.add_context("duration", opts.duration);
+    report.add_context("warmup", opts.warmup);
+
+    auto paths = prepare_videos(opts.work_dir);
+    auto pool = open_video_pool(paths, (preload_batches + 2) * opts.batch_size);
+
+    double peak = 0;
+    for (auto threads : opts.threads) {
+        std::cerr << "Unlimited consumer, " << threads << " threads" << std::endl;
+        auto result = run(pool, opts, threads, 0);
+        peak = std::max(peak, result.batches_per_second);
+        report.add("loader_scaling", std::move(result.fields));
+    }
+
+    auto max_threads = *std::max_element(opts.threads.begin(), opts.threads.end());
+    auto rates = opts.consume_rates;
+    for (auto fraction : opts.relative_rates) {
+        rates.push_back(peak * fraction);
+    }
+    for (auto rate : rates) {
+        std::cerr << "Consumer at " << rate << " batches/s, " << max_threads << " threads"
+                  << std::endl;
+        auto result = run(pool, opts, max_threads, rate);
+        result.fields.emplace_back("achieved_fraction",
+                                   rate > 0 ? result.batches_per_second / rate : 1.);
+        report.add("loader_saturation", std::move(result.fields));
+    }
+
+    opts.finish(report);
+    return 0;
+}
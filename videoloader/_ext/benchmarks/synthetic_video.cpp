@@ -0,0 +1,211 @@
+#include "synthetic_video.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <numeric>
+#include <sstream>
+#include <system_error>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+}
+
+#include "av_utils.h"
+
+namespace huww {
+namespace videoloader {
+namespace benchmark {
+
+std::string synthetic_video_spec::name() const {
+    std::ostringstream name;
+    name << codec << '_' << width << 'x' << height << "_g" << gop_size << "_b" << max_b_frames
+         << "_n" << num_frames;
+    return name.str();
+}
+
+bool has_encoder(const std::string &codec) {
+    return avcodec_find_encoder_by_name(codec.c_str()) != nullptr;
+}
+
+struct codec_context_deleter {
+    void operator()(AVCodecContext *c) { avcodec_free_context(&c); }
+};
+struct packet_deleter {
+    void operator()(AVPacket *p) { av_packet_free(&p); }
+};
+struct output_deleter {
+    void operator()(AVFormatContext *c) {
+        if (!(c->oformat->flags & AVFMT_NOFILE)) {
+            avio_closep(&c->pb);
+        }
+        avformat_free_context(c);
+    }
+};
+
+/** Gradient scrolling diagonally, with a box moving across, so motion estimation has work. */
+static void draw_frame(AVFrame *frame, int i) {
+    for (int y = 0; y < frame->height; y++) {
+        auto row = frame->data[0] + y * frame->linesize[0];
+        for (int x = 0; x < frame->width; x++) {
+            row[x] = uint8_t(x + y + i * 3);
+        }
+    }
+    auto box = std::min(frame->width, frame->height) / 4;
+    auto box_x = (i * 4) % std::max(frame->width - box, 1);
+    auto box_y = (i * 2) % std::max(frame->height - box, 1);
+    for (int y = box_y; y < box_y + box; y++) {
+        std::memset(frame->data[0] + y * frame->linesize[0] + box_x, 235, box);
+    }
+    for (int plane = 1; plane <= 2; plane++) {
+        for (int y = 0; y < frame->height / 2; y++) {
+            auto row = frame->data[plane] + y * frame->linesize[plane];
+            for (int x = 0; x < frame->width / 2; x++) {
+                row[x] = uint8_t(128 + (plane == 1 ? x : y) / 4 + i);
+            }
+        }
+    }
+}
+
+/** Send a frame, or flush if null, and write all packets ready. */
+static void encode(AVCodecContext *encoder, AVFormatContext *output, AVStream *stream,
+                   const AVFrame *frame, AVPacket *packet) {
+    CHECK_AV(avcodec_send_frame(encoder, frame), "Unable to send frame to encoder");
+    while (true) {
+        int ret = avcodec_receive_packet(encoder, packet);
+        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+            return;
+        }
+        CHECK_AV(ret, "Unable to encode frame");
+        av_packet_rescale_ts(packet, encoder->time_base, stream->time_base);
+        packet->stream_index = stream->index;
+        CHECK_AV(av_interleaved_write_frame(output, packet), "Unable to write packet");
+    }
+}
+
+void write_synthetic_video(const std::string &path, const synthetic_video_spec &spec) {
+    auto codec = CHECK_AV(avcodec_find_encoder_by_name(spec.codec.c_str()),
+                          "Encoder \"" << spec.codec << "\" not found");
+    AVFormatContext *_output = nullptr;
+    CHECK_AV(avformat_alloc_output_context2(&_output, nullptr, nullptr, path.c_str()),
+             "Unable to create output \"" << path << "\"");
+    std::unique_ptr<AVFormatContext, output_deleter> output(_output);
+
+    std::unique_ptr<AVCodecContext, codec_context_deleter> encoder(
+        CHECK_AV(avcodec_alloc_context3(codec), "Unable to alloc encoder"));
+    encoder->width = spec.width;
+    encoder->height = spec.height;
+    encoder->pix_fmt = AV_PIX_FMT_YUV420P;
+    encoder->time_base = AVRational{1, spec.frame_rate};
+    encoder->framerate = AVRational{spec.frame_rate, 1};
+    encoder->gop_size = spec.gop_size;
+    encoder->max_b_frames = spec.max_b_frames;
+    // About 0.1 bit per pixel, similar to web videos.
+    encoder->bit_rate = int64_t(spec.width) * spec.height * spec.frame_rate / 10;
+    if (output->oformat->flags & AVFMT_GLOBALHEADER) {
+        encoder->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    }
+    AVDictionary *options = nullptr;
+    av_dict_set(&options, "preset", "veryfast", 0); // Only used by x264 and x265
+    int ret = avcodec_open2(encoder.get(), codec, &options);
+    av_dict_free(&options);
+    CHECK_AV(ret, "Unable to open encoder \"" << spec.codec << "\"");
+
+    auto stream = CHECK_AV(avformat_new_stream(output.get(), nullptr), "Unable to add stream");
+    stream->time_base = encoder->time_base;
+    CHECK_AV(avcodec_parameters_from_context(stream->codecpar, encoder.get()),
+             "Unable to copy encoder parameters");
+    if (!(output->oformat->flags & AVFMT_NOFILE)) {
+        CHECK_AV(avio_open(&output->pb, path.c_str(), AVIO_FLAG_WRITE),
+                 "Unable to open \"" << path << "\"");
+    }
+    CHECK_AV(avformat_write_header(output.get(), nullptr), "Unable to write header");
+
+    auto frame = new_avframe();
+    frame->format = encoder->pix_fmt;
+    frame->width = spec.width;
+    frame->height = spec.height;
+    CHECK_AV(av_frame_get_buffer(frame.get(), 0), "Unable to alloc frame buffer");
+    std::unique_ptr<AVPacket, packet_deleter> packet(
+        CHECK_AV(av_packet_alloc(), "Unable to alloc packet"));
+    for (int i = 0; i < spec.num_frames; i++) {
+        CHECK_AV(av_frame_make_writable(frame.get()), "Unable to write frame");
+        draw_frame(frame.get(), i);
+        frame->pts = i;
+        encode(encoder.get(), output.get(), stream, frame.get(), packet.get());
+    }
+    encode(encoder.get(), output.get(), stream, nullptr, packet.get());
+    CHECK_AV(av_write_trailer(output.get()), "Unable to write trailer");
+}
+
+/** GNU tar header, the only format `tar_iterator` reads. */
+struct tar_header {
+    std::array<char, 100> name;
+    std::array<char, 8> mode;
+    std::array<char, 8> owner;
+    std::array<char, 8> group;
+    std::array<char, 12> size;
+    std::array<char, 12> mtime;
+    std::array<char, 8> checksum;
+    char type;
+    std::array<char, 100> linkname;
+    std::array<char, 8> magic;
+    std::array<char, 247> padding;
+};
+static_assert(sizeof(tar_header) == 512);
+
+template <size_t N> static void write_octal(std::array<char, N> &field, uint64_t value) {
+    std::snprintf(field.data(), N, "%0*llo", int(N - 1), static_cast<unsigned long long>(value));
+}
+
+void write_tar(const std::string &tar_path,
+               const std::vector<std::pair<std::string, std::string>> &members) {
+    std::ofstream tar(tar_path, std::ios::binary | std::ios::trunc);
+    std::array<char, 512> zeros{};
+    for (auto &[name, file_path] : members) {
+        if (name.size() >= sizeof(tar_header::name)) {
+            throw std::invalid_argument("Tar member name too long: " + name);
+        }
+        std::ifstream file(file_path, std::ios::binary);
+        std::string content((std::istreambuf_iterator<char>(file)),
+                            std::istreambuf_iterator<char>());
+        if (!file) {
+            throw std::system_error(errno, std::system_category(),
+                                    "Unable to read \"" + file_path + "\"");
+        }
+
+        tar_header header{};
+        std::copy(name.begin(), name.end(), header.name.begin());
+        write_octal(header.mode, 0644);
+        write_octal(header.owner, 0);
+        write_octal(header.group, 0);
+        write_octal(header.size, content.size());
+        write_octal(header.mtime, 0);
+        header.type = '0';
+        header.magic = {'u', 's', 't', 'a', 'r', ' ', ' ', '\0'};
+        std::fill(header.checksum.begin(), header.checksum.end(), ' ');
+        auto bytes = reinterpret_cast<const uint8_t *>(&header);
+        auto checksum = std::accumulate(bytes, bytes + sizeof(header), uint32_t(0));
+        std::snprintf(header.checksum.data(), header.checksum.size(), "%06o", checksum);
+        header.checksum[7] = ' ';
+
+        tar.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        tar.write(content.data(), content.size());
+        tar.write(zeros.data(), (zeros.size() - content.size() % zeros.size()) % zeros.size());
+    }
+    tar.write(zeros.data(), zeros.size());
+    tar.write(zeros.data(), zeros.size());
+    tar.close();
+    if (!tar) {
+        throw std::system_error(errno, std::system_category(),
+                                "Unable to write \"" + tar_path + "\"");
+    }
+}
+
+} // namespace benchmark
+} // namespace videoloader
+} // namespace huww
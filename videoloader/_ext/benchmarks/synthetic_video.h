@@ -0,0 +1,41 @@
+#pragma once
+
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace huww {
+namespace videoloader {
+namespace benchmark {
+
+/** Encoding parameters of a generated video. */
+struct synthetic_video_spec {
+    /** Name of the libavcodec encoder, e.g. "libx264", "libx265", "mpeg4" */
+    std::string codec = "libx264";
+    int width = 640;
+    int height = 360;
+    int num_frames = 300;
+    int frame_rate = 30;
+    int gop_size = 30;
+    int max_b_frames = 0;
+
+    /** Unique for each spec, e.g. "libx264_640x360_g30_b0_n300", used as file name. */
+    std::string name() const;
+};
+
+bool has_encoder(const std::string &codec);
+
+/**
+ * Encode a moving test pattern. The container is chosen by the extension of `path`.
+ *
+ * \throw av_error if the encoder is not available or encoding fails.
+ */
+void write_synthetic_video(const std::string &path, const synthetic_video_spec &spec);
+
+/** Write a GNU tar of files, each `{member path, file path}`. */
+void write_tar(const std::string &tar_path,
+               const std::vector<std::pair<std::string, std::string>> &members);
+
+} // namespace benchmark
+} // namespace videoloader
+} // namespace huww
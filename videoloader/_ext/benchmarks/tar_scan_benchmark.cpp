@@ -0,0 +1,102 @@
+/**
+ * Compare scanning a tar with `POSIX_FADV_SEQUENTIAL` against O_DIRECT reads.
+ *
+ * Both modes read the content of every file entry once, in tar order. The tar is evicted from page
+ * cache before each mode, and the bytes of it left in page cache afterwards are reported, which is
+ * what the O_DIRECT mode saves for other data on the machine.
+ *
+ * Usage: tar_scan_benchmark <tar>
+ */
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "direct_io.h"
+#include "file_descriptor.h"
+#include "tar_iterator.h"
+#include "video_tar.h"
+
+using namespace huww::videoloader;
+using huww::tar_entry_type;
+using huww::tar_iterator;
+using huww::tar_options;
+
+using bench_clock = std::chrono::steady_clock;
+
+static void evict(const file_descriptor &fd) {
+    posix_fadvise(fd.get(), 0, 0, POSIX_FADV_DONTNEED);
+}
+
+static int64_t resident_bytes(const file_descriptor &fd) {
+    auto size = fd.size();
+    if (size == 0) {
+        return 0;
+    }
+    auto addr = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd.get(), 0);
+    if (addr == MAP_FAILED) {
+        throw std::system_error(errno, std::system_category(), "mmap failed");
+    }
+    auto page_size = sysconf(_SC_PAGESIZE);
+    std::vector<unsigned char> pages((size + page_size - 1) / page_size);
+    mincore(addr, size, pages.data());
+    munmap(addr, size);
+    int64_t resident = 0;
+    for (auto p : pages) {
+        resident += p & 1;
+    }
+    return resident * page_size;
+}
+
+/** Returns bytes of content read. */
+static int64_t scan_sequential(const std::string &path) {
+    int64_t total = 0;
+    for (auto &entry : tar_iterator(path, tar_options::advise_sequential)) {
+        if (entry.type() != tar_entry_type::file) {
+            continue;
+        }
+        entry.prefetch_content();
+        total += entry.file_size();
+    }
+    return total;
+}
+
+static int64_t scan_direct(const std::string &path) {
+    auto fd = open_direct(path);
+    auto pool = std::make_shared<aligned_buffer_pool>(direct_scan_buffer_bytes);
+    int64_t total = 0;
+    for (auto &entry : tar_iterator(path, tar_options::direct_io)) {
+        if (entry.type() != tar_entry_type::file) {
+            continue;
+        }
+        // Released right away, as if a video were opened from it.
+        read_direct(*fd, entry.content_start_position(), entry.file_size(), *pool);
+        total += entry.file_size();
+    }
+    return total;
+}
+
+int main(int argc, char const *argv[]) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <tar>" << std::endl;
+        return 1;
+    }
+    std::string path = argv[1];
+    file_descriptor fd(path);
+
+    for (auto [name, scan] : {std::pair{"fadvise_sequential", &scan_sequential},
+                              std::pair{"direct", &scan_direct}}) {
+        evict(fd);
+        auto start = bench_clock::now();
+        auto total = scan(path);
+        auto seconds = std::chrono::duration<double>(bench_clock::now() - start).count();
+        std::cout << name << ": " << total / seconds / 1e6 << " MB/s, "
+                  << resident_bytes(fd) / 1e6 << " MB left in page cache\n";
+    }
+    return 0;
+}
@@ -0,0 +1,216 @@
+/**
+ * Benchmark opening, indexing and decoding on videos generated at setup time, so results are
+ * reproducible on any machine with an FFmpeg build.
+ *
+ * Videos are encoded with varying codec, GOP length, B-frames and resolution. Encoders that are
+ * not available are listed as skipped. Files are read from page cache after the first run, so this
+ * mostly measures CPU time.
+ *
+ * Usage: video_benchmark [--output <json>] [--work-dir <dir>] [--repeat <n>] [--quick]
+ */
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "benchmark_options.h"
+#include "benchmark_report.h"
+#include "synthetic_video.h"
+#include "video.h"
+#include "video_dataset_loader.h"
+#include "video_tar.h"
+
+using namespace huww::videoloader;
+using namespace huww::videoloader::benchmark;
+namespace fs = std::filesystem;
+
+constexpr size_t frames_per_batch = 16;
+constexpr size_t clips_per_loader_batch = 8;
+
+struct options : common_options {
+    int repeat = 10;
+    bool quick = false;
+};
+
+static options parse_options(int argc, char const *argv[]) {
+    options opts;
+    argument_parser args(argc, argv);
+    while (args.next()) {
+        auto arg = args.arg();
+        if (opts.parse(args)) {
+            continue;
+        }
+        if (arg == "--repeat") {
+            opts.repeat = std::stoi(args.value());
+        } else if (arg == "--quick") {
+            opts.quick = true;
+        } else {
+            throw std::invalid_argument("Unknown argument " + arg);
+        }
+    }
+    return opts;
+}
+
+/** Vary one parameter at a time from a typical web video. */
+static std::vector<synthetic_video_spec> video_specs(bool quick) {
+    synthetic_video_spec base;
+    if (quick) {
+        base.num_frames = 120;
+    }
+    std::vector<synthetic_video_spec> specs = {base};
+    auto vary = [&](auto change) {
+        auto spec = base;
+        change(spec);
+        specs.push_back(spec);
+    };
+    vary([](auto &s) { s.gop_size = 12; });
+    vary([](auto &s) { s.gop_size = 250; });
+    vary([](auto &s) { s.max_b_frames = 3; });
+    vary([](auto &s) { s.width = 320, s.height = 180; });
+    vary([](auto &s) { s.width = 1280, s.height = 720; });
+    if (!quick) {
+        vary([](auto &s) { s.width = 1920, s.height = 1080; });
+    }
+    vary([](auto &s) { s.codec = "libx265"; });
+    vary([](auto &s) { s.codec = "mpeg4"; });
+    return specs;
+}
+
+static benchmark_report::fields spec_fields(const synthetic_video_spec &spec) {
+    return {
+        {"video", spec.name()},
+        {"codec", spec.codec},
+        {"width", int64_t(spec.width)},
+        {"height", int64_t(spec.height)},
+        {"gop_size", int64_t(spec.gop_size)},
+        {"max_b_frames", int64_t(spec.max_b_frames)},
+    };
+}
+
+/** Frame indices of each access pattern. */
+static std::vector<std::pair<std::string, std::vector<size_t>>> access_patterns(size_t num_frames) {
+    auto n = std::min(frames_per_batch, num_frames);
+    std::vector<size_t> dense(n), sparse(n), random(n);
+    auto dense_start = (num_frames - n) / 2;
+    std::mt19937_64 rng(42);
+    for (size_t i = 0; i < n; i++) {
+        dense[i] = dense_start + i;
+        sparse[i] = i * num_frames / n;
+        random[i] = rng() % num_frames;
+    }
+    return {{"get_batch_dense", dense}, {"get_batch_sparse", sparse}, {"get_batch_random", random}};
+}
+
+static void bench_video(benchmark_report &report, const synthetic_video_spec &spec,
+                        const std::string &path, int repeat) {
+    auto fields = spec_fields(spec);
+    report.add("open", fields, measure(repeat, [&] { video(path).sleep(); }));
+
+    video v(path);
+    v.sleep();
+    report.add("open_with_index", fields, measure(repeat, [&] {
+                   video(file_io::file_spec{.path = path}, v.video_stream_index(), v.frame_index())
+                       .sleep();
+               }));
+
+    for (auto &[name, indices] : access_patterns(v.num_frames())) {
+        // Sleep after each batch, as Python `Video.get_batch()` does.
+        auto t = measure(repeat, [&, &indices = indices] {
+            v.get_batch(indices);
+            v.sleep();
+        });
+        auto f = fields;
+        f.emplace_back("frames", int64_t(indices.size()));
+        f.emplace_back("frames_per_second", indices.size() / t.mean());
+        report.add(name, f, t);
+    }
+}
+
+static void bench_tar(benchmark_report &report, const std::string &tar_path, size_t num_videos,
+                      int repeat) {
+    int num_threads = std::max(1u, std::thread::hardware_concurrency());
+    for (int threads : {1, num_threads}) {
+        auto t = measure(repeat, [&] { open_video_tar(tar_path, threads); });
+        report.add("open_video_tar", {{"videos", int64_t(num_videos)},
+                                      {"threads", int64_t(threads)},
+                                      {"videos_per_second", num_videos / t.mean()}},
+                   t);
+    }
+
+    auto videos = open_video_tar(tar_path, num_threads);
+    std::mt19937_64 rng(42);
+    dataset_load_schedule schedule(1);
+    size_t num_frames = 0;
+    for (auto &v : videos) {
+        if (schedule.back().size() == clips_per_loader_batch) {
+            schedule.emplace_back();
+        }
+        auto n = std::min(frames_per_batch, v.num_frames());
+        auto start = rng() % (v.num_frames() - n + 1);
+        std::vector<size_t> indices(n);
+        for (size_t i = 0; i < n; i++) {
+            indices[i] = start + i;
+        }
+        num_frames += n;
+        schedule.back().push_back({.video = v, .frame_indices = indices});
+    }
+    auto t = measure(repeat, [&] {
+        video_dataset_loader loader(schedule);
+        loader.start(num_threads);
+        for (size_t i = 0; i < schedule.size(); i++) {
+            loader.get_next_batch();
+        }
+        loader.stop();
+    });
+    report.add("video_dataset_loader", {{"clips", int64_t(videos.size())},
+                                        {"threads", int64_t(num_threads)},
+                                        {"clips_per_second", videos.size() / t.mean()},
+                                        {"frames_per_second", num_frames / t.mean()}},
+               t);
+}
+
+int main(int argc, char const *argv[]) {
+    options opts;
+    try {
+        opts = parse_options(argc, argv);
+    } catch (std::exception &e) {
+        std::cerr << e.what() << "\nUsage: " << argv[0]
+                  << " [--output <json>] [--work-dir <dir>] [--repeat <n>] [--quick]" << std::endl;
+        return 1;
+    }
+    opts.create_work_dir();
+    benchmark_report report;
+    report.add_context("repeat", int64_t(opts.repeat));
+
+    std::vector<std::pair<std::string, std::string>> tar_members;
+    for (auto &spec : video_specs(opts.quick)) {
+        if (!has_encoder(spec.codec)) {
+            report.skip(spec.name(), "encoder not available");
+            continue;
+        }
+        auto path = (opts.work_dir / (spec.name() + ".mp4")).string();
+        if (!fs::exists(path)) {
+            std::cerr << "Generating " << path << std::endl;
+            write_synthetic_video(path, spec);
+        }
+        std::cerr << "Benchmarking " << spec.name() << std::endl;
+        bench_video(report, spec, path, opts.repeat);
+        // Enough members for every thread to be busy.
+        for (int copy = 0; copy < (opts.quick ? 4 : 16); copy++) {
+            tar_members.emplace_back(std::to_string(copy) + "/" + spec.name() + ".mp4", path);
+        }
+    }
+
+    if (!tar_members.empty()) {
+        auto tar_path = (opts.work_dir / "videos.tar").string();
+        write_tar(tar_path, tar_members);
+        std::cerr << "Benchmarking " << tar_path << std::endl;
+        bench_tar(report, tar_path, tar_members.size(), opts.repeat);
+    }
+
+    opts.finish(report);
+    return 0;
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+
+namespace huww {
+namespace videoloader {
+
+/**
+ * A blocking FIFO queue with limited capacity.
+ *
+ * Any number of threads can push and pop concurrently. After `close()`, `push()` is refused and
+ * `pop()` drains the remaining items, then returns `std::nullopt`.
+ */
+template <typename T> class bounded_queue {
+    std::deque<T> items;
+    size_t _capacity;
+    bool closed = false;
+    std::mutex m;
+    std::condition_variable not_empty;
+    std::condition_variable not_full;
+
+  public:
+    explicit bounded_queue(size_t capacity) : _capacity(capacity) {
+        if (capacity == 0) {
+            throw std::logic_error("capacity should be greater than 0");
+        }
+    }
+    bounded_queue(const bounded_queue &) = delete;
+    bounded_queue &operator=(const bounded_queue &) = delete;
+
+    /**
+     * Block until there is room for `item`, then enqueue it.
+     *
+     * \return false if the queue is closed, `item` is not enqueued.
+     */
+    bool push(T item) {
+        {
+            std::unique_lock lk(m);
+            not_full.wait(lk, [this] { return closed || items.size() < _capacity; });
+            if (closed) {
+                return false;
+            }
+            items.push_back(std::move(item));
+        }
+        not_empty.notify_one();
+        return true;
+    }
+
+    /**
+     * Block until an item is available.
+     *
+     * \return `std::nullopt` if the queue is closed and all items have been popped.
+     */
+    std::optional<T> pop() {
+        std::optional<T> item;
+        {
+            std::unique_lock lk(m);
+            not_empty.wait(lk, [this] { return closed || !items.empty(); });
+            if (items.empty()) {
+                return std::nullopt;
+            }
+            item = std::move(items.front());
+            items.pop_front();
+        }
+        not_full.notify_one();
+        return item;
+    }
+
+    /** No more items will be pushed. Wake up all blocked threads. */
+    void close() {
+        {
+            std::lock_guard lk(m);
+            closed = true;
+        }
+        not_empty.notify_all();
+        not_full.notify_all();
+    }
+
+    size_t capacity() const noexcept { return _capacity; }
+};
+
+} // namespace videoloader
+} // namespace huww
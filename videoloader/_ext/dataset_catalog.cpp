@@ -0,0 +1,116 @@
+#include "dataset_catalog.h"
+
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+
+#include <spdlog/spdlog.h>
+
+#include "open_videos.h"
+#include "video_tar.h"
+
+namespace huww {
+namespace videoloader {
+
+namespace fs = std::filesystem;
+
+/** Video files opened in parallel at a time, bounding memory of opened videos. */
+constexpr size_t catalog_open_batch_size = 1024;
+
+static bool is_tar_path(const std::string &path) {
+    if (path.size() < 4) {
+        return false;
+    }
+    auto ext = path.substr(path.size() - 4);
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    return ext == ".tar";
+}
+
+static void collect_tar(const std::string &tar_path, const dataset_catalog_options &options,
+                        video_collection_builder &builder) {
+    auto tar_options = tar_options::advise_sequential;
+    if (options.memory_map) {
+        tar_options = tar_options | tar_options::memory_map;
+    }
+    video_tar_stream stream(tar_path, options.filter, options.max_threads, tar_options);
+    while (auto v = stream.next()) {
+        builder.add(*v);
+    }
+}
+
+static void collect_files(const std::vector<std::string> &paths,
+                          const dataset_catalog_options &options,
+                          video_collection_builder &builder) {
+    for (size_t begin = 0; begin < paths.size(); begin += catalog_open_batch_size) {
+        auto end = std::min(paths.size(), begin + catalog_open_batch_size);
+        std::vector<std::string> batch(paths.begin() + begin, paths.begin() + end);
+        auto results = open_videos(batch, options.max_threads, options.memory_map);
+        for (size_t i = 0; i < results.size(); i++) {
+            if (results[i].video) {
+                builder.add(*results[i].video);
+                continue;
+            }
+            try {
+                std::rethrow_exception(results[i].error);
+            } catch (std::exception &e) {
+                SPDLOG_WARN("Skip \"{}\" in catalog: {}", batch[i], e.what());
+            }
+        }
+    }
+}
+
+video_collection_builder collect_dataset(const std::vector<std::string> &sources,
+                                         const dataset_catalog_options &options) {
+    if (options.max_threads <= 0) {
+        throw std::logic_error("max_threads should be greater than 0");
+    }
+    video_collection_builder builder;
+    for (auto &source : sources) {
+        auto path = fs::absolute(source).lexically_normal().string();
+        if (!fs::is_directory(path)) {
+            if (is_tar_path(path)) {
+                collect_tar(path, options, builder);
+            } else {
+                // Explicitly listed, so its errors are not skipped.
+                file_io::file_spec spec{.path = path};
+                if (options.memory_map) {
+                    spec.mapping = std::make_shared<const mapped_file>(path);
+                }
+                builder.add(video(spec));
+            }
+            continue;
+        }
+
+        std::vector<std::string> files;
+        std::vector<std::string> tars;
+        for (auto &entry : fs::recursive_directory_iterator(path)) {
+            if (!entry.is_regular_file()) {
+                continue;
+            }
+            auto file_path = entry.path().string();
+            if (is_tar_path(file_path)) {
+                tars.push_back(std::move(file_path));
+            } else if (options.filter(tar_entry(file_path, 0, entry.file_size()))) {
+                files.push_back(std::move(file_path));
+            }
+        }
+        std::sort(files.begin(), files.end());
+        std::sort(tars.begin(), tars.end());
+        collect_files(files, options, builder);
+        for (auto &tar_path : tars) {
+            collect_tar(tar_path, options, builder);
+        }
+    }
+    return builder;
+}
+
+size_t write_dataset_catalog(const std::string &catalog_path,
+                             const std::vector<std::string> &sources,
+                             const dataset_catalog_options &options) {
+    auto builder = collect_dataset(sources, options);
+    builder.write(catalog_path);
+    return builder.size();
+}
+
+} // namespace videoloader
+} // namespace huww
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "tar_entry_filter.h"
+#include "video_collection.h"
+
+namespace huww {
+namespace videoloader {
+
+struct dataset_catalog_options {
+    /**
+     * Select files of directories and entries of tars. Files of directories are matched by their
+     * whole path.
+     */
+    tar_entry_filter filter;
+    /** Max number of threads opening videos. */
+    int max_threads = 4;
+    /** Videos opened from the catalog read from a memory mapping of their file. */
+    bool memory_map = false;
+};
+
+/**
+ * Open videos of many sources and collect them into a catalog, see `video_collection::map()`.
+ *
+ * Sources ending with ".tar" are opened as tars, directories are walked recursively in path order,
+ * other paths are opened as video files. Paths are made absolute, so the catalog can be used from
+ * another working directory. Files of directories that are not videos are skipped with a warning,
+ * other errors are thrown.
+ *
+ * Only one batch of opened videos is kept in memory at a time.
+ */
+video_collection_builder collect_dataset(const std::vector<std::string> &sources,
+                                         const dataset_catalog_options &options);
+
+/**
+ * Collect videos of the sources and write them to a catalog file.
+ *
+ * \return Number of videos in the catalog.
+ */
+size_t write_dataset_catalog(const std::string &catalog_path,
+                             const std::vector<std::string> &sources,
+                             const dataset_catalog_options &options);
+
+} // namespace videoloader
+} // namespace huww
@@ -0,0 +1,128 @@
+#include "direct_io.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <new>
+#include <sstream>
+#include <system_error>
+
+#include <spdlog/spdlog.h>
+
+namespace huww {
+namespace videoloader {
+
+aligned_buffer::aligned_buffer(size_t size) : _size(size) {
+    void *p;
+    if (posix_memalign(&p, direct_io_alignment, std::max<size_t>(size, 1)) != 0) {
+        throw std::bad_alloc();
+    }
+    _data = static_cast<uint8_t *>(p);
+}
+
+aligned_buffer::~aligned_buffer() { free(_data); }
+
+aligned_buffer_pool::aligned_buffer_pool(size_t max_bytes) : max_bytes(max_bytes) {
+    if (max_bytes == 0) {
+        throw std::logic_error("max_bytes should be greater than 0");
+    }
+}
+
+std::shared_ptr<aligned_buffer> aligned_buffer_pool::acquire(size_t size) {
+    size = align_up(size);
+    std::unique_ptr<aligned_buffer> buffer;
+    {
+        std::unique_lock lk(m);
+        returned.wait(lk, [&] { return used_bytes == 0 || used_bytes + size <= max_bytes; });
+        // Smallest idle buffer large enough.
+        auto best = idle.end();
+        for (auto it = idle.begin(); it != idle.end(); ++it) {
+            if ((*it)->size() >= size && (best == idle.end() || (*it)->size() < (*best)->size())) {
+                best = it;
+            }
+        }
+        if (best != idle.end()) {
+            buffer = std::move(*best);
+            idle.erase(best);
+            idle_bytes -= buffer->size();
+        } else {
+            // Make room by freeing idle buffers too small to be reused.
+            while (!idle.empty() && used_bytes + idle_bytes + size > max_bytes) {
+                idle_bytes -= idle.back()->size();
+                idle.pop_back();
+            }
+        }
+        used_bytes += buffer ? buffer->size() : size;
+    }
+    if (!buffer) {
+        try {
+            buffer = std::make_unique<aligned_buffer>(size);
+        } catch (...) {
+            std::lock_guard lk(m);
+            used_bytes -= size;
+            returned.notify_all();
+            throw;
+        }
+    }
+    return std::shared_ptr<aligned_buffer>(
+        buffer.release(), [pool = shared_from_this()](aligned_buffer *b) { pool->release(b); });
+}
+
+void aligned_buffer_pool::release(aligned_buffer *buffer) noexcept {
+    std::unique_ptr<aligned_buffer> owned(buffer);
+    {
+        std::lock_guard lk(m);
+        used_bytes -= buffer->size();
+        if (used_bytes + idle_bytes + buffer->size() <= max_bytes) {
+            idle_bytes += buffer->size();
+            idle.push_back(std::move(owned));
+        }
+    }
+    returned.notify_all();
+}
+
+size_t aligned_buffer_pool::used() noexcept {
+    std::lock_guard lk(m);
+    return used_bytes;
+}
+
+std::shared_ptr<const file_descriptor> open_direct(const std::string &path) {
+    try {
+        return std::make_shared<const file_descriptor>(path, true);
+    } catch (std::system_error &e) {
+        if (e.code().value() != EINVAL) {
+            throw;
+        }
+        SPDLOG_DEBUG("O_DIRECT not supported for \"{}\", read through page cache", path);
+        return std::make_shared<const file_descriptor>(path);
+    }
+}
+
+preloaded_range read_direct(const file_descriptor &fd, int64_t offset, int64_t size,
+                            aligned_buffer_pool &pool) {
+    auto begin = align_down(offset);
+    auto end = align_up(offset + size);
+    auto buffer = pool.acquire(end - begin);
+    int64_t read_size = 0;
+    while (begin + read_size < offset + size) {
+        // Offset and size of every read stay aligned, except the last one at EOF.
+        auto ret = fd.pread(buffer->data() + read_size, end - begin - read_size, begin + read_size);
+        if (ret < 0) {
+            throw std::system_error(errno, std::system_category(), "Direct read failed");
+        }
+        read_size += ret;
+        if (ret == 0 || ret % direct_io_alignment != 0) {
+            break; // EOF
+        }
+    }
+    auto data = buffer->data() + (offset - begin);
+    return {
+        .buffer = std::move(buffer),
+        .data = data,
+        .offset = offset,
+        .size = std::clamp<int64_t>(begin + read_size - offset, 0, size),
+    };
+}
+
+} // namespace videoloader
+} // namespace huww
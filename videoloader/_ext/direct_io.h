@@ -0,0 +1,87 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "file_descriptor.h"
+
+namespace huww {
+namespace videoloader {
+
+/** Offset, size and memory address of O_DIRECT reads should be aligned to this. */
+constexpr int64_t direct_io_alignment = 4096;
+/** `file_io` reads with O_DIRECT in chunks of this size. */
+constexpr int64_t direct_io_chunk_size = 256 * 1024;
+
+constexpr int64_t align_down(int64_t x) noexcept {
+    return x / direct_io_alignment * direct_io_alignment;
+}
+constexpr int64_t align_up(int64_t x) noexcept { return align_down(x + direct_io_alignment - 1); }
+
+class aligned_buffer {
+    uint8_t *_data = nullptr;
+    size_t _size;
+
+  public:
+    explicit aligned_buffer(size_t size);
+    aligned_buffer(const aligned_buffer &) = delete;
+    aligned_buffer &operator=(const aligned_buffer &) = delete;
+    ~aligned_buffer();
+
+    uint8_t *data() noexcept { return _data; }
+    const uint8_t *data() const noexcept { return _data; }
+    size_t size() const noexcept { return _size; }
+};
+
+/**
+ * Aligned buffers reused across O_DIRECT reads, bounded by total bytes.
+ *
+ * `acquire()` blocks until enough bytes are returned, so a sequential reader can not run far ahead
+ * of the threads consuming its buffers. A single buffer larger than the bound is allowed when no
+ * other buffer is in use.
+ */
+class aligned_buffer_pool : public std::enable_shared_from_this<aligned_buffer_pool> {
+    std::mutex m;
+    std::condition_variable returned;
+    size_t max_bytes;
+    size_t used_bytes = 0;
+    size_t idle_bytes = 0;
+    std::vector<std::unique_ptr<aligned_buffer>> idle;
+
+    void release(aligned_buffer *buffer) noexcept;
+
+  public:
+    /** Should be created by `std::make_shared`, buffers keep the pool alive. */
+    explicit aligned_buffer_pool(size_t max_bytes);
+
+    /** Block until a buffer of at least `size` bytes can be handed out. */
+    std::shared_ptr<aligned_buffer> acquire(size_t size);
+    size_t used() noexcept;
+};
+
+/** Part of a file already read into memory. */
+struct preloaded_range {
+    std::shared_ptr<const aligned_buffer> buffer;
+    const uint8_t *data; /**< Content at `offset` */
+    int64_t offset;
+    int64_t size;
+
+    bool contains(int64_t pos) const noexcept { return pos >= offset && pos < offset + size; }
+};
+
+/**
+ * Open a file for O_DIRECT reads. Fall back to normal reads if the file system does not support it,
+ * e.g. tmpfs.
+ */
+std::shared_ptr<const file_descriptor> open_direct(const std::string &path);
+
+/** Read a byte range with a single aligned read, bypassing page cache if `fd` is direct. */
+preloaded_range read_direct(const file_descriptor &fd, int64_t offset, int64_t size,
+                            aligned_buffer_pool &pool);
+
+} // namespace videoloader
+} // namespace huww
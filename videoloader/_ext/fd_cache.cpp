@@ -0,0 +1,74 @@
+#include "fd_cache.h"
+
+#include "direct_io.h"
+
+namespace huww {
+namespace videoloader {
+
+fd_cache &fd_cache::global() {
+    static fd_cache cache;
+    return cache;
+}
+
+void fd_cache::evict_locked() {
+    while (lru.size() > _capacity) {
+        entries.erase(lru.back().first);
+        lru.pop_back();
+    }
+}
+
+std::shared_ptr<const file_descriptor> fd_cache::open(const std::string &path, bool direct) {
+    key k{path, direct};
+    {
+        std::lock_guard lk(m);
+        auto it = entries.find(k);
+        if (it != entries.end()) {
+            lru.splice(lru.begin(), lru, it->second);
+            _hits.fetch_add(1, std::memory_order_relaxed);
+            return it->second->second;
+        }
+    }
+    _misses.fetch_add(1, std::memory_order_relaxed);
+    // Opening may be slow on network file systems, don't block other threads.
+    auto fd = direct ? open_direct(path) : std::make_shared<const file_descriptor>(path);
+
+    std::lock_guard lk(m);
+    if (_capacity == 0) {
+        return fd;
+    }
+    auto it = entries.find(k);
+    if (it != entries.end()) {
+        // Opened concurrently by another thread, share theirs.
+        lru.splice(lru.begin(), lru, it->second);
+        return it->second->second;
+    }
+    lru.emplace_front(k, fd);
+    entries.emplace(std::move(k), lru.begin());
+    evict_locked();
+    return fd;
+}
+
+void fd_cache::set_capacity(size_t capacity) {
+    std::lock_guard lk(m);
+    _capacity = capacity;
+    evict_locked();
+}
+
+size_t fd_cache::capacity() const {
+    std::lock_guard lk(m);
+    return _capacity;
+}
+
+size_t fd_cache::size() const {
+    std::lock_guard lk(m);
+    return lru.size();
+}
+
+void fd_cache::clear() {
+    std::lock_guard lk(m);
+    entries.clear();
+    lru.clear();
+}
+
+} // namespace videoloader
+} // namespace huww
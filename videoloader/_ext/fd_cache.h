@@ -0,0 +1,75 @@
+#pragma once
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "file_descriptor.h"
+
+namespace huww {
+namespace videoloader {
+
+/**
+ * Keep recently used files open, so that waking up a video does not cost an `open` and a `close`.
+ *
+ * Descriptors are shared by path and whether they are for direct reads, and evicted in LRU order
+ * when more than `capacity()` files are cached. An evicted descriptor is closed after every
+ * `file_io` using it released it.
+ */
+class fd_cache {
+    struct key {
+        std::string path;
+        bool direct;
+
+        bool operator==(const key &other) const noexcept {
+            return direct == other.direct && path == other.path;
+        }
+    };
+    struct key_hash {
+        size_t operator()(const key &k) const noexcept {
+            return std::hash<std::string>()(k.path) ^ static_cast<size_t>(k.direct);
+        }
+    };
+    using entry = std::pair<key, std::shared_ptr<const file_descriptor>>;
+
+    mutable std::mutex m;
+    size_t _capacity;
+    std::list<entry> lru; /**< Most recently used first */
+    std::unordered_map<key, std::list<entry>::iterator, key_hash> entries;
+
+    std::atomic<size_t> _hits = 0;
+    std::atomic<size_t> _misses = 0;
+
+    void evict_locked();
+
+  public:
+    static constexpr size_t default_capacity = 128;
+    explicit fd_cache(size_t capacity = default_capacity) : _capacity(capacity) {}
+    fd_cache(const fd_cache &) = delete;
+    fd_cache &operator=(const fd_cache &) = delete;
+
+    /** Shared by the whole process */
+    static fd_cache &global();
+
+    /**
+     * Get the cached descriptor of `path`, or open it. Thread safe.
+     *
+     * \param direct Open for direct reads, see `open_direct()`.
+     */
+    std::shared_ptr<const file_descriptor> open(const std::string &path, bool direct = false);
+
+    /** 0 disables caching, every `open()` opens the file. */
+    void set_capacity(size_t capacity);
+    size_t capacity() const;
+    size_t size() const;
+    void clear();
+
+    size_t hits() const noexcept { return _hits.load(std::memory_order_relaxed); }
+    size_t misses() const noexcept { return _misses.load(std::memory_order_relaxed); }
+};
+
+} // namespace videoloader
+} // namespace huww
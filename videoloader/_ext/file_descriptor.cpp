@@ -0,0 +1,60 @@
+#include "file_descriptor.h"
+
+#include <cerrno>
+#include <sstream>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace huww {
+namespace videoloader {
+
+file_descriptor::file_descriptor(const std::string &path, bool direct) : direct(direct) {
+    do {
+        fd = open(path.c_str(), O_RDONLY | O_CLOEXEC | (direct ? O_DIRECT : 0));
+    } while (fd < 0 && errno == EINTR);
+    if (fd < 0) {
+        std::ostringstream msg;
+        msg << "Unable to open file \"" << path << "\"";
+        throw std::system_error(errno, std::system_category(), msg.str());
+    }
+}
+
+file_descriptor &file_descriptor::operator=(file_descriptor &&other) noexcept {
+    if (this != &other) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        fd = other.fd;
+        direct = other.direct;
+        other.fd = -1;
+    }
+    return *this;
+}
+
+file_descriptor::~file_descriptor() {
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+int64_t file_descriptor::size() const {
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        throw std::system_error(errno, std::system_category(), "fstat failed");
+    }
+    return st.st_size;
+}
+
+ssize_t file_descriptor::pread(void *buf, size_t size, int64_t offset) const noexcept {
+    ssize_t ret;
+    do {
+        ret = ::pread(fd, buf, size, offset);
+    } while (ret < 0 && errno == EINTR);
+    return ret;
+}
+
+} // namespace videoloader
+} // namespace huww
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include <sys/types.h>
+
+namespace huww {
+namespace videoloader {
+
+/**
+ * A read-only file descriptor.
+ *
+ * All reads take an explicit offset and do not change the file position, so one descriptor can be
+ * shared by many `file_io` in different threads.
+ */
+class file_descriptor {
+    int fd = -1;
+    bool direct = false;
+
+  public:
+    /** \param direct Open with O_DIRECT, reads should be aligned, see `direct_io.h`. */
+    explicit file_descriptor(const std::string &path, bool direct = false);
+    file_descriptor(file_descriptor &&other) noexcept : fd(other.fd), direct(other.direct) {
+        other.fd = -1;
+    }
+    file_descriptor &operator=(file_descriptor &&other) noexcept;
+    file_descriptor(const file_descriptor &) = delete;
+    file_descriptor &operator=(const file_descriptor &) = delete;
+    ~file_descriptor();
+
+    int get() const noexcept { return fd; }
+    bool is_direct() const noexcept { return direct; }
+    int64_t size() const;
+
+    /**
+     * Read up to `size` bytes at `offset`, retry if interrupted by signal.
+     *
+     * \return Bytes read, 0 on EOF, -1 on error and `errno` is set.
+     */
+    ssize_t pread(void *buf, size_t size, int64_t offset) const noexcept;
+};
+
+} // namespace videoloader
+} // namespace huww
@@ -1,108 +1,163 @@
 #include "file_io.h"
 
-#include <sstream>
+#include <algorithm>
+#include <cstring>
 
-namespace huww {
-namespace videoloader {
+#include <fcntl.h>
 
-std::istream &file_io::current_stream() {
-    if (this->external_stream != nullptr) {
-        return *this->external_stream;
-    }
-    return fstream;
-}
+#include "fd_cache.h"
+#include "stage_stats.h"
 
-void file_io::set_external_stream(std::istream *stream) { this->external_stream = stream; }
+namespace huww {
+namespace videoloader {
 
-void file_io::open_io() {
-    fstream.open(file_path, std::fstream::in | std::fstream::binary);
-    if (!fstream) {
-        std::ostringstream msg;
-        msg << "Unable to open file \"" << file_path << "\"";
-        throw std::system_error(errno, std::system_category(), msg.str());
+file_io::file_io(const file_spec &spec)
+    : file_path(spec.path), fd(spec.shared_fd), mapping(spec.mapping),
+      direct_io(spec.direct_io && !spec.mapping), preloaded(spec.preloaded),
+      start_pos(spec.start_pos), file_size(spec.file_size) {
+    if (mapping) {
+        fd = nullptr;
+        auto available = std::max<int64_t>(mapping->size() - start_pos, 0);
+        this->file_size = file_size < 0 ? available : std::min(file_size, available);
+        return;
     }
-}
-
-file_io::file_io(std::string file_path, std::streampos start_pos, std::streamsize file_size,
-                 std::istream *external_stream)
-    : file_path(file_path), start_pos(start_pos), file_size(file_size),
-      external_stream(external_stream) {
-
-    if (external_stream == nullptr) {
-        open_io();
+    if (!fd || (direct_io && !fd->is_direct())) {
+        // Shared with other videos of the file, including the fallback if O_DIRECT is unsupported.
+        fd = fd_cache::global().open(file_path, direct_io);
     }
     if (file_size < 0) {
-        auto &s = current_stream();
-        this->file_size = s.seekg(0, std::istream::end).tellg() - start_pos;
-        s.seekg(start_pos);
+        this->file_size = fd->size() - start_pos;
     }
 }
 
-bool file_io::is_sleeping() { return external_stream == nullptr && !fstream.is_open(); }
+bool file_io::is_sleeping() { return sleeping; }
 
 void file_io::sleep() {
-    external_stream = nullptr;
-    if (!is_sleeping()) {
-        fstream.close();
-    }
+    fd.reset();
+    preloaded.reset();
+    chunk.reset();
+    sleeping = true;
 }
 
 void file_io::wake_up() {
     if (is_sleeping()) {
-        this->open_io();
-        fstream.seekg(last_pos);
+        if (!mapping) {
+            fd = fd_cache::global().open(file_path, direct_io);
+        }
+        sleeping = false;
     }
 }
 
 int file_io::read(uint8_t *buf, int size) {
-    size = std::min(std::streamsize(size), start_pos + file_size - last_pos);
+    VIDEOLOADER_STAGE_TIMER(file_read);
+    size = std::min<int64_t>(size, file_size - pos);
     if (size <= 0) {
         return AVERROR_EOF;
     }
-
-    auto &s = current_stream();
-    s.read((char *)buf, size);
-    if (s.eof()) {
-        s.clear();
-        if (s.gcount() == 0) {
-            return AVERROR_EOF;
+    if (mapping) {
+        memcpy(buf, mapping->data() + start_pos + pos, size);
+        pos += size;
+        return size;
+    }
+    auto offset = start_pos + pos;
+    if (preloaded && preloaded->contains(offset)) {
+        size = std::min<int64_t>(size, preloaded->offset + preloaded->size - offset);
+        memcpy(buf, preloaded->data + (offset - preloaded->offset), size);
+        pos += size;
+        return size;
+    }
+    if (direct_io) {
+        auto read_count = read_chunk(buf, size, offset);
+        if (read_count > 0) {
+            pos += read_count;
         }
+        return read_count;
     }
-    if (!s) {
+    auto read_count = fd->pread(buf, size, offset);
+    if (read_count < 0) {
         return AVERROR(errno);
     }
-    auto read_count = s.gcount();
-    last_pos += read_count;
+    if (read_count == 0) {
+        return AVERROR_EOF;
+    }
+    pos += read_count;
     return read_count;
 }
 
+int file_io::read_chunk(uint8_t *buf, int size, int64_t offset) {
+    if (!chunk || offset < chunk_offset || offset >= chunk_offset + chunk_size) {
+        if (!chunk) {
+            chunk = std::make_unique<aligned_buffer>(direct_io_chunk_size);
+        }
+        chunk_offset = align_down(offset);
+        chunk_size = 0;
+        auto read_count = fd->pread(chunk->data(), chunk->size(), chunk_offset);
+        if (read_count < 0) {
+            return AVERROR(errno);
+        }
+        chunk_size = read_count;
+        if (offset >= chunk_offset + chunk_size) {
+            return AVERROR_EOF;
+        }
+    }
+    size = std::min<int64_t>(size, chunk_offset + chunk_size - offset);
+    memcpy(buf, chunk->data() + (offset - chunk_offset), size);
+    return size;
+}
+
 int64_t file_io::seek(int64_t pos, int whence) {
-    std::istream::seekdir dir;
     switch (whence) {
     case SEEK_SET:
-        pos += this->start_pos;
-        last_pos = pos;
-        dir = std::istream::beg;
         break;
     case SEEK_CUR:
-        last_pos += pos;
-        dir = std::istream::cur;
+        pos += this->pos;
         break;
     case SEEK_END:
-        dir = std::istream::beg;
-        last_pos = pos = pos + start_pos + file_size;
+        pos += file_size;
         break;
     case AVSEEK_SIZE:
         return file_size;
     default:
         return -1;
     }
-    auto &s = current_stream();
-    s.seekg(pos, dir);
-    if (!s) {
-        return AVERROR(errno);
+    if (pos < 0) {
+        return AVERROR(EINVAL);
     }
-    return last_pos - start_pos;
+    this->pos = pos;
+    return pos;
+}
+
+void file_io::will_need(int64_t pos, int64_t size) noexcept {
+    pos = std::max<int64_t>(pos, 0);
+    size = std::min(size, file_size - pos);
+    if (size <= 0) {
+        return;
+    }
+    if (mapping) {
+        mapping->will_need(start_pos + pos, size);
+    } else if (fd && !direct_io) {
+        posix_fadvise(fd->get(), start_pos + pos, size, POSIX_FADV_WILLNEED);
+    }
+}
+
+file_range file_io::absolute_range(int64_t pos, int64_t size) const {
+    pos = std::clamp<int64_t>(pos, 0, file_size);
+    return {
+        .path = file_path,
+        .mapping = mapping,
+        .offset = start_pos + pos,
+        .size = std::clamp<int64_t>(size, 0, file_size - pos),
+    };
+}
+
+file_io::file_spec file_io::reopen_spec() const {
+    return {
+        .path = file_path,
+        .start_pos = start_pos,
+        .file_size = file_size,
+        .mapping = mapping,
+        .direct_io = direct_io,
+    };
 }
 
 void avio_context_deleter::operator()(AVIOContext *c) {
@@ -112,13 +167,13 @@ void avio_context_deleter::operator()(AVIOContext *c) {
 }
 
 avio_context_ptr file_io::new_avio_context(const file_spec &spec) {
-    auto io =
-        std::make_unique<file_io>(spec.path, spec.start_pos, spec.file_size, spec.external_stream);
+    auto io = std::make_unique<file_io>(spec);
     uint8_t *buffer = (uint8_t *)av_malloc(IO_BUFFER_SIZE);
     if (!buffer) {
         throw std::bad_alloc();
     }
-    return avio_context_ptr(avio_alloc_context(
+    auto mapped = io->is_mapped();
+    auto ctx = avio_context_ptr(avio_alloc_context(
         buffer, IO_BUFFER_SIZE, 0, io.release(),
         [](void *opaque, uint8_t *buf, int buf_size) {
             return static_cast<file_io *>(opaque)->read(buf, buf_size);
@@ -127,6 +182,12 @@ avio_context_ptr file_io::new_avio_context(const file_spec &spec) {
         [](void *opaque, int64_t offset, int whence) {
             return static_cast<file_io *>(opaque)->seek(offset, whence);
         }));
+    if (ctx && mapped) {
+        // Reading from the mapping is cheap, let large reads (packet data) copy directly into the
+        // destination instead of through the IO buffer.
+        ctx->direct = 1;
+    }
+    return ctx;
 }
 
 } // namespace videoloader
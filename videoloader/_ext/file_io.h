@@ -1,6 +1,5 @@
 #pragma once
 
-#include <fstream>
 #include <memory>
 #include <string>
 
@@ -8,6 +7,10 @@ extern "C" {
 #include <libavformat/avio.h>
 }
 
+#include "direct_io.h"
+#include "file_descriptor.h"
+#include "mapped_file.h"
+
 namespace huww {
 namespace videoloader {
 
@@ -17,23 +20,58 @@ struct avio_context_deleter {
 using avio_context_ptr = std::unique_ptr<AVIOContext, avio_context_deleter>;
 constexpr int IO_BUFFER_SIZE = 32768;
 
+/** A byte range of a file, or of a mapping if `mapping` is set. */
+struct file_range {
+    std::string path;
+    std::shared_ptr<const mapped_file> mapping;
+    int64_t offset;
+    int64_t size;
+};
+
 class file_io {
+  public:
+    struct file_spec {
+        std::string path;
+        int64_t start_pos = 0;
+        int64_t file_size = -1;
+        /**
+         * Already opened descriptor of `path`, used until the first `sleep()`. Can be shared by
+         * many videos across threads. Otherwise the descriptor is taken from `fd_cache`.
+         */
+        std::shared_ptr<const file_descriptor> shared_fd = nullptr;
+        /**
+         * Read from this mapping of `path` instead of the file. Kept while sleeping, so no file is
+         * opened on wake up.
+         */
+        std::shared_ptr<const mapped_file> mapping = nullptr;
+        /**
+         * Read with O_DIRECT in aligned chunks, bypassing page cache. Not used with `mapping`.
+         * `shared_fd` is used only if it is opened for direct reads.
+         */
+        bool direct_io = false;
+        /** Content already read, e.g. by the tar scanner. Used until the first `sleep()`. */
+        std::shared_ptr<const preloaded_range> preloaded = nullptr;
+    };
+
   private:
     std::string file_path;
-    std::ifstream fstream;
-    std::streampos last_pos = 0;
-    std::streampos start_pos;
-    std::streamsize file_size;
-    std::istream *external_stream = nullptr;
+    std::shared_ptr<const file_descriptor> fd;
+    std::shared_ptr<const mapped_file> mapping;
+    bool direct_io;
+    std::shared_ptr<const preloaded_range> preloaded;
+    std::unique_ptr<aligned_buffer> chunk; /**< Last chunk read with O_DIRECT */
+    int64_t chunk_offset = 0;              /**< Absolute position of `chunk` */
+    int64_t chunk_size = 0;                /**< Valid bytes in `chunk` */
+    bool sleeping = false;
+    int64_t pos = 0; /**< Relative to `start_pos` */
+    int64_t start_pos;
+    int64_t file_size;
 
-    void open_io();
-    std::istream &current_stream();
+    /** Read through `chunk`, at absolute position `offset`. */
+    int read_chunk(uint8_t *buf, int size, int64_t offset);
 
   public:
-    file_io(std::string file_path, std::streampos start_pos = 0, std::streamsize file_size = -1,
-            std::istream *external_stream = nullptr);
-
-    void set_external_stream(std::istream *stream);
+    explicit file_io(const file_spec &spec);
 
     bool is_sleeping();
     void sleep();
@@ -41,13 +79,19 @@ class file_io {
 
     int read(uint8_t *buf, int size);
     int64_t seek(int64_t pos, int whence);
+    /** Hint that the byte range will be read soon. */
+    void will_need(int64_t pos, int64_t size) noexcept;
+    bool is_mapped() const noexcept { return mapping != nullptr; }
+    /** Bytes buffered in addition to the AVIOContext buffer */
+    size_t buffer_size() const noexcept { return chunk ? chunk->size() : 0; }
+    /** Locate a byte range of this input in the underlying file. Thread safe. */
+    file_range absolute_range(int64_t pos, int64_t size) const;
+    /**
+     * Spec to open the same input again, sharing the mapping if any. The descriptor and preloaded
+     * content are not included. Thread safe.
+     */
+    file_spec reopen_spec() const;
 
-    struct file_spec {
-        std::string path;
-        std::streampos start_pos = 0;
-        std::streamsize file_size = -1;
-        std::istream *external_stream = nullptr;
-    };
     static avio_context_ptr new_avio_context(const file_spec &spec);
 };
 
@@ -0,0 +1,145 @@
+#include "frame_index_file.h"
+
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <system_error>
+
+#include <unistd.h>
+
+namespace huww {
+namespace videoloader {
+
+constexpr uint32_t frame_index_file_byte_order = 0x01020304;
+
+static_assert(sizeof(frame_index_file_header) == 56 && sizeof(frame_index_file_record) == 56);
+static_assert(sizeof(packet_index_entry) == 32 && offsetof(packet_index_entry, pos) == 16 &&
+                  offsetof(packet_index_entry, size) == 24,
+              "Layout of frame index files changed, bump their versions");
+
+frame_index_file::frame_index_file(const uint8_t *data, size_t size,
+                                   const std::array<char, 8> &magic, uint32_t version) {
+    if (reinterpret_cast<uintptr_t>(data) % alignof(frame_index_file_header) != 0) {
+        throw std::invalid_argument("not aligned");
+    }
+    if (size < sizeof(frame_index_file_header)) {
+        throw std::invalid_argument("truncated");
+    }
+    auto &header = *reinterpret_cast<const frame_index_file_header *>(data);
+    if (header.magic != magic || header.byte_order != frame_index_file_byte_order ||
+        header.version != version) {
+        throw std::invalid_argument("unsupported format");
+    }
+    auto remaining = size - sizeof(header);
+    if (header.num_records > remaining / sizeof(frame_index_file_record)) {
+        throw std::invalid_argument("truncated");
+    }
+    remaining -= header.num_records * sizeof(frame_index_file_record);
+    if (header.num_packets > remaining / sizeof(packet_index_entry)) {
+        throw std::invalid_argument("truncated");
+    }
+    remaining -= header.num_packets * sizeof(packet_index_entry);
+    if (header.strings_size != remaining) {
+        throw std::invalid_argument("size mismatch");
+    }
+
+    auto records = reinterpret_cast<const frame_index_file_record *>(data + sizeof(header));
+    for (size_t i = 0; i < header.num_records; i++) {
+        auto &r = records[i];
+        if (r.path_offset > header.strings_size ||
+            r.path_size > header.strings_size - r.path_offset ||
+            r.first_packet > header.num_packets ||
+            r.num_packets > header.num_packets - r.first_packet) {
+            throw std::invalid_argument("record out of range");
+        }
+    }
+    this->h = &header;
+    this->records = records;
+    this->packets = reinterpret_cast<const packet_index_entry *>(records + header.num_records);
+    this->strings = reinterpret_cast<const char *>(this->packets + header.num_packets);
+}
+
+std::string frame_index_file::path(size_t i) const {
+    auto &r = records[i];
+    return std::string(strings + r.path_offset, r.path_size);
+}
+
+shared_frame_index frame_index_file::frame_index(size_t i,
+                                                 std::shared_ptr<const void> owner) const {
+    auto &r = records[i];
+    return shared_frame_index(std::move(owner), packets + r.first_packet, r.num_packets);
+}
+
+frame_index_file_builder::frame_index_file_builder(const std::array<char, 8> &magic,
+                                                   uint32_t version, int64_t source_size,
+                                                   int64_t source_mtime_ns)
+    : h{
+          .magic = magic,
+          .version = version,
+          .byte_order = frame_index_file_byte_order,
+          .source_size = source_size,
+          .source_mtime_ns = source_mtime_ns,
+          .num_records = 0,
+          .num_packets = 0,
+          .strings_size = 0,
+      } {}
+
+void frame_index_file_builder::add(frame_index_file_record record, std::string_view path,
+                                   const shared_frame_index &frame_index) {
+    record.path_offset = strings.size();
+    record.path_size = static_cast<uint32_t>(path.size());
+    record.first_packet = packets.size();
+    record.num_packets = frame_index.size();
+    records.push_back(record);
+    strings.append(path);
+    for (auto &p : frame_index) {
+        // Value initialized, so padding is written as zeros.
+        auto &r = packets.emplace_back();
+        r.pts = p.pts;
+        r.key_frame_index = p.key_frame_index;
+        r.packet_index = p.packet_index;
+        r.pos = p.pos;
+        r.size = p.size;
+    }
+}
+
+std::string frame_index_file_builder::build() const {
+    auto header = h;
+    header.num_records = records.size();
+    header.num_packets = packets.size();
+    header.strings_size = strings.size();
+
+    std::string out;
+    out.reserve(sizeof(header) + records.size() * sizeof(frame_index_file_record) +
+                packets.size() * sizeof(packet_index_entry) + strings.size());
+    auto append = [&out](const void *p, size_t size) {
+        out.append(reinterpret_cast<const char *>(p), size);
+    };
+    append(&header, sizeof(header));
+    append(records.data(), records.size() * sizeof(frame_index_file_record));
+    append(packets.data(), packets.size() * sizeof(packet_index_entry));
+    out.append(strings);
+    return out;
+}
+
+void write_file_atomically(const std::string &path, std::string_view bytes) {
+    auto temp_path = path + ".tmp" + std::to_string(getpid());
+    try {
+        std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+        out.write(bytes.data(), bytes.size());
+        out.close();
+        if (!out) {
+            throw std::system_error(errno, std::system_category(),
+                                    "Unable to write \"" + temp_path + "\"");
+        }
+        std::filesystem::rename(temp_path, path);
+    } catch (...) {
+        std::error_code ec;
+        std::filesystem::remove(temp_path, ec);
+        throw;
+    }
+}
+
+} // namespace videoloader
+} // namespace huww
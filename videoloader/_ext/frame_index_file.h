@@ -0,0 +1,98 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "video.h"
+
+namespace huww {
+namespace videoloader {
+
+/*
+ * Flat file of many frame indices, shared by sidecar indices of tars and video collections. In
+ * native byte order:
+ *   header | record[num_records] | packet_index_entry[num_packets] | path strings
+ *
+ * Frame indices are stored in the layout of `packet_index_entry`, so a mapped file can be read in
+ * place. Files written in another byte order or layout are rejected.
+ */
+
+struct frame_index_file_header {
+    std::array<char, 8> magic;
+    uint32_t version;
+    uint32_t byte_order;
+    int64_t source_size;     /**< Size of the indexed file, e.g. the tar, 0 if not applicable */
+    int64_t source_mtime_ns; /**< Modification time of the indexed file, 0 if not applicable */
+    uint64_t num_records;
+    uint64_t num_packets;
+    uint64_t strings_size;
+};
+
+struct frame_index_file_record {
+    uint64_t path_offset;
+    uint32_t path_size;
+    int32_t stream_index; /**< -1 if it has no frame index */
+    int64_t start_pos;
+    int64_t file_size;
+    uint64_t first_packet;
+    uint64_t num_packets;
+    uint32_t flags; /**< Defined by each format */
+    uint32_t reserved;
+};
+
+/** Validated view of a frame index file, the buffer should outlive it. */
+class frame_index_file {
+    const frame_index_file_header *h = nullptr;
+    const frame_index_file_record *records = nullptr;
+    const packet_index_entry *packets = nullptr;
+    const char *strings = nullptr;
+
+  public:
+    frame_index_file() = default;
+    /**
+     * \throw std::invalid_argument with the reason, if the buffer is not aligned, truncated, in
+     * another format or version, or has records out of range.
+     */
+    frame_index_file(const uint8_t *data, size_t size, const std::array<char, 8> &magic,
+                     uint32_t version);
+
+    const frame_index_file_header &header() const noexcept { return *h; }
+    size_t size() const noexcept { return h ? h->num_records : 0; }
+    /** The i-th record, `i` should be less than `size()`. */
+    const frame_index_file_record &record(size_t i) const noexcept { return records[i]; }
+    std::string path(size_t i) const;
+    /** View of the frame index of the i-th record, `owner` should keep the buffer alive. */
+    shared_frame_index frame_index(size_t i, std::shared_ptr<const void> owner) const;
+};
+
+/** Serialize records with their paths and frame indices into a frame index file. */
+class frame_index_file_builder {
+    frame_index_file_header h;
+    std::vector<frame_index_file_record> records;
+    std::vector<packet_index_entry> packets;
+    std::string strings;
+
+  public:
+    frame_index_file_builder(const std::array<char, 8> &magic, uint32_t version,
+                             int64_t source_size = 0, int64_t source_mtime_ns = 0);
+
+    /** Append a record, its path and packet ranges are filled in. */
+    void add(frame_index_file_record record, std::string_view path,
+             const shared_frame_index &frame_index);
+    std::string build() const;
+};
+
+/**
+ * Replace the file at `path` by writing a temporary file and renaming it. Processes still mapping
+ * the replaced file are not affected.
+ *
+ * \throw std::system_error or std::filesystem::filesystem_error if it fails.
+ */
+void write_file_atomically(const std::string &path, std::string_view bytes);
+
+} // namespace videoloader
+} // namespace huww
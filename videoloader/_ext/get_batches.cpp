@@ -0,0 +1,201 @@
+#include "get_batches.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+
+namespace huww {
+namespace videoloader {
+
+std::vector<batch_result> get_batches(const std::vector<batch_request> &requests,
+                                      int max_threads) {
+    if (max_threads <= 0) {
+        throw std::logic_error("max_threads should be greater than 0");
+    }
+    // Requests of each video, in order.
+    std::vector<std::vector<size_t>> groups;
+    std::unordered_map<const video *, size_t> group_of_video;
+    for (size_t i = 0; i < requests.size(); i++) {
+        auto [it, inserted] = group_of_video.try_emplace(&requests[i].video, groups.size());
+        if (inserted) {
+            groups.emplace_back();
+        }
+        groups[it->second].push_back(i);
+    }
+
+    std::vector<batch_result> results(requests.size());
+    // Helpers may start after all groups are taken and this function returned, so they only
+    // touch `progress` then.
+    struct progress_t {
+        size_t num_groups;
+        std::atomic<size_t> next = 0;
+        std::mutex m;
+        std::condition_variable all_finished;
+        size_t finished = 0;
+    };
+    auto progress = std::make_shared<progress_t>();
+    progress->num_groups = groups.size();
+    auto decode_next = [progress, &groups, &requests, &results] {
+        while (true) {
+            auto g = progress->next.fetch_add(1, std::memory_order_relaxed);
+            if (g >= progress->num_groups) {
+                return;
+            }
+            for (auto i : groups[g]) {
+                try {
+                    results[i].batch = requests[i].video.get_batch(requests[i].frame_indices);
+                } catch (...) {
+                    results[i].error = std::current_exception();
+                }
+            }
+            {
+                std::lock_guard lk(progress->m);
+                progress->finished++;
+            }
+            progress->all_finished.notify_one();
+        }
+    };
+
+    auto num_threads = std::min<size_t>(max_threads, groups.size());
+    if (num_threads > 1) {
+        auto &pool = thread_pool::shared();
+        pool.reserve(num_threads - 1);
+        for (size_t t = 1; t < num_threads; t++) {
+            pool.submit(decode_next);
+        }
+    }
+    decode_next();
+    std::unique_lock lk(progress->m);
+    progress->all_finished.wait(lk, [&] { return progress->finished == progress->num_groups; });
+    return results;
+}
+
+enum class async_batch_status { pending, running, cancelled };
+
+struct async_batch::state {
+    std::atomic<async_batch_status> status = async_batch_status::pending;
+    std::vector<size_t> frame_indices;
+    async_batch_callbacks callbacks;
+    bool sleep_when_idle;
+    std::promise<video_dlpack::ptr> result;
+
+    bool start() noexcept {
+        auto expected = async_batch_status::pending;
+        return status.compare_exchange_strong(expected, async_batch_status::running);
+    }
+};
+
+bool async_batch::cancel() noexcept {
+    auto expected = async_batch_status::pending;
+    if (!s->status.compare_exchange_strong(expected, async_batch_status::cancelled)) {
+        return false;
+    }
+    if (!s->callbacks.on_done) {
+        s->result.set_exception(std::make_exception_ptr(batch_cancelled()));
+    }
+    return true;
+}
+
+async_batch_decoder::async_batch_decoder(size_t num_threads, thread_pool &pool) : pool(pool) {
+    if (num_threads == 0) {
+        throw std::logic_error("num_threads should be greater than 0");
+    }
+    pool.reserve(num_threads);
+}
+
+async_batch_decoder::~async_batch_decoder() {
+    std::unique_lock lk(m);
+    idle.wait(lk, [this] { return queues.empty(); });
+}
+
+async_batch async_batch_decoder::submit(video &v, std::vector<size_t> frame_indices,
+                                        async_batch_callbacks callbacks, bool sleep_when_idle) {
+    auto s = std::make_shared<async_batch::state>();
+    s->frame_indices = std::move(frame_indices);
+    s->callbacks = std::move(callbacks);
+    s->sleep_when_idle = sleep_when_idle;
+    async_batch batch(s, s->result.get_future());
+    bool start_draining;
+    {
+        std::lock_guard lk(m);
+        auto [it, inserted] = queues.try_emplace(&v);
+        it->second.push_back(std::move(s));
+        start_draining = inserted;
+    }
+    if (start_draining) {
+        pool.submit([this, v = &v] { this->drain(v); });
+    }
+    return batch;
+}
+
+void async_batch_decoder::drain(video *v) {
+    while (true) {
+        std::shared_ptr<async_batch::state> s;
+        {
+            std::lock_guard lk(m);
+            auto it = queues.find(v);
+            if (it->second.empty()) {
+                queues.erase(it);
+                idle.notify_all();
+                return;
+            }
+            s = std::move(it->second.front());
+            it->second.pop_front();
+        }
+        if (!s->start()) {
+            continue; // Cancelled by `async_batch::cancel()`, the video may be gone.
+        }
+
+        std::optional<batch_result> result;
+        if (s->callbacks.on_start && !s->callbacks.on_start()) {
+            s->status = async_batch_status::cancelled;
+            if (!s->callbacks.on_done) {
+                s->result.set_exception(std::make_exception_ptr(batch_cancelled()));
+            }
+        } else {
+            result.emplace();
+            try {
+                result->batch = v->get_batch(s->frame_indices);
+            } catch (...) {
+                result->error = std::current_exception();
+            }
+        }
+        if (s->sleep_when_idle) {
+            std::unique_lock lk(m);
+            auto idle_after = queues.at(v).empty();
+            lk.unlock();
+            if (idle_after) {
+                // Before passing the result, the caller may release the video then.
+                try {
+                    v->sleep();
+                } catch (...) {
+                    /* Reopened on next read anyway */
+                }
+            }
+        }
+        if (!result) {
+            continue; // Cancelled by `on_start`
+        }
+        if (s->callbacks.on_done) {
+            s->callbacks.on_done(std::move(*result));
+        } else if (result->error) {
+            s->result.set_exception(result->error);
+        } else {
+            s->result.set_value(std::move(result->batch));
+        }
+    }
+}
+
+async_batch_decoder &async_batch_decoder::shared() {
+    static async_batch_decoder decoder(std::max(1u, std::thread::hardware_concurrency()));
+    return decoder;
+}
+
+} // namespace videoloader
+} // namespace huww
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+#include "thread_pool.h"
+#include "video.h"
+
+namespace huww {
+namespace videoloader {
+
+struct batch_request {
+    videoloader::video &video;
+    std::vector<size_t> frame_indices;
+};
+
+/** Either the decoded frames or why decoding failed. */
+struct batch_result {
+    video_dlpack::ptr batch;
+    std::exception_ptr error;
+};
+
+/**
+ * Decode many batches in parallel on `thread_pool::shared()` and the calling thread.
+ *
+ * Requests of the same video are decoded in order by one thread, since a video can not be read
+ * concurrently. Videos are left awake. A failed request does not stop others, its error is
+ * returned in place.
+ *
+ * \param max_threads Max number of threads decoding, including the calling thread.
+ * \return Results in the order of `requests`.
+ */
+std::vector<batch_result> get_batches(const std::vector<batch_request> &requests, int max_threads);
+
+/** Result of an asynchronous request cancelled before it started. */
+class batch_cancelled : public std::runtime_error {
+  public:
+    batch_cancelled() : std::runtime_error("batch request cancelled") {}
+};
+
+/** Called on the decoding thread of an asynchronous request. */
+struct async_batch_callbacks {
+    /** Called right before decoding, return false to cancel the request. */
+    std::function<bool()> on_start;
+    /**
+     * Called with the result of a request that is not cancelled. If set, the result is passed only
+     * to it, `async_batch::future()` is not valid.
+     */
+    std::function<void(batch_result &&)> on_done;
+};
+
+/** A request submitted to `async_batch_decoder`. */
+class async_batch {
+  public:
+    struct state;
+
+  private:
+    friend class async_batch_decoder;
+    std::shared_ptr<state> s;
+    std::future<video_dlpack::ptr> result;
+
+    async_batch(std::shared_ptr<state> s, std::future<video_dlpack::ptr> result)
+        : s(std::move(s)), result(std::move(result)) {}
+
+  public:
+    /**
+     * Cancel the request if it has not started yet. Its future throws `batch_cancelled` then.
+     *
+     * \return false if it is already started, finished or cancelled.
+     */
+    bool cancel() noexcept;
+    /** Decoded frames, or throws why decoding failed. */
+    std::future<video_dlpack::ptr> &future() noexcept { return result; }
+};
+
+/**
+ * Decode requests in background on a thread pool, without blocking the caller.
+ *
+ * Requests of the same video are decoded in submission order by one thread at a time, and
+ * requests of different videos in parallel. Videos must outlive their requests, and should not be
+ * read otherwise until their requests finish.
+ */
+class async_batch_decoder {
+    thread_pool &pool;
+    std::mutex m;
+    std::condition_variable idle;
+    /** Pending requests of videos being decoded. A video is in the map while a task drains it. */
+    std::unordered_map<video *, std::deque<std::shared_ptr<async_batch::state>>> queues;
+
+    void drain(video *v);
+
+  public:
+    /** \param num_threads Threads of `pool` reserved for decoding. */
+    explicit async_batch_decoder(size_t num_threads, thread_pool &pool = thread_pool::shared());
+    async_batch_decoder(const async_batch_decoder &) = delete;
+    async_batch_decoder &operator=(const async_batch_decoder &) = delete;
+    /** Wait for submitted requests to finish. */
+    ~async_batch_decoder();
+
+    /**
+     * \param sleep_when_idle Let the video sleep after this request, if no other request of it is
+     * pending then.
+     */
+    async_batch submit(video &v, std::vector<size_t> frame_indices,
+                       async_batch_callbacks callbacks = {}, bool sleep_when_idle = false);
+
+    /** Shared by the whole process, with as many threads as CPU cores. */
+    static async_batch_decoder &shared();
+};
+
+} // namespace videoloader
+} // namespace huww
@@ -2,13 +2,34 @@
 #include <Python.h>
 #include <numpy/arrayobject.h>
 
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <memory>
 #include <optional>
+#include <string_view>
+#include <type_traits>
 #include <typeindex>
 #include <typeinfo>
 #include <unordered_map>
 
+extern "C" {
+#include <libavutil/pixdesc.h>
+}
+
 #include "pyref.h"
+#include "dataset_catalog.h"
+#include "fd_cache.h"
+#include "get_batches.h"
+#include "locality_shuffle.h"
+#include "memory_stats.h"
+#include "open_videos.h"
+#include "stage_stats.h"
+#include "trace.h"
 #include "video.h"
+#include "video_collection.h"
+#include "video_dataset_loader.h"
+#include "tar_entry_filter.h"
 #include "video_tar.h"
 
 using namespace huww;
@@ -23,6 +44,7 @@ static std::unordered_map<error_t, PyObject *> system_error_map{
 static std::unordered_map<std::type_index, PyObject *> exception_map{
     {std::type_index(typeid(std::runtime_error)), PyExc_RuntimeError},
     {std::type_index(typeid(std::out_of_range)), PyExc_IndexError},
+    {std::type_index(typeid(std::invalid_argument)), PyExc_ValueError},
     {std::type_index(typeid(std::system_error)), PyExc_OSError},
 };
 
@@ -41,14 +63,88 @@ static error_t get_error_code(std::exception &e) {
     return 0;
 }
 
+class release_GIL_guard {
+  private:
+    PyThreadState *_save;
+
+  public:
+    release_GIL_guard(release_GIL_guard &&) = delete;
+    release_GIL_guard(const release_GIL_guard &) = delete;
+
+    release_GIL_guard() noexcept : _save(PyEval_SaveThread()) {}
+    ~release_GIL_guard() noexcept { PyEval_RestoreThread(_save); }
+
+    class GIL_guard {
+        PyThreadState *&_save;
+
+      public:
+        GIL_guard(GIL_guard &&) = delete;
+        GIL_guard(const GIL_guard &) = delete;
+
+        GIL_guard(PyThreadState *&save) noexcept : _save(save) { PyEval_RestoreThread(_save); }
+        ~GIL_guard() noexcept { _save = PyEval_SaveThread(); }
+    };
+
+    GIL_guard acquire() { return {_save}; }
+};
+
+/** Acquire GIL from a thread not created by Python */
+class ensure_GIL_guard {
+    PyGILState_STATE state;
+
+  public:
+    ensure_GIL_guard(ensure_GIL_guard &&) = delete;
+    ensure_GIL_guard(const ensure_GIL_guard &) = delete;
+
+    ensure_GIL_guard() noexcept : state(PyGILState_Ensure()) {}
+    ~ensure_GIL_guard() noexcept { PyGILState_Release(state); }
+};
+
 class PyError : public std::runtime_error {
   public:
     PyError() : std::runtime_error("Python API returned error.") {}
 };
 
+/**
+ * Carry the Python error set in one thread to another thread.
+ *
+ * Must be constructed with GIL held, right after Python API returned error.
+ */
+class PyErrorState : public PyError {
+    struct state {
+        PyObject *type = nullptr, *value = nullptr, *traceback = nullptr;
+
+        /** Release the error if it is never restored, e.g. its loader is dropped. */
+        ~state() {
+            if ((type || value || traceback) && Py_IsInitialized()) {
+                ensure_GIL_guard GIL;
+                Py_XDECREF(type);
+                Py_XDECREF(value);
+                Py_XDECREF(traceback);
+            }
+        }
+    };
+    std::shared_ptr<state> _state;
+
+  public:
+    PyErrorState() : _state(std::make_shared<state>()) {
+        PyErr_Fetch(&_state->type, &_state->value, &_state->traceback);
+    }
+
+    /** Set the error in current thread. Only the first call is effective. */
+    void restore() {
+        PyErr_Restore(_state->type, _state->value, _state->traceback);
+        _state->type = _state->value = _state->traceback = nullptr;
+    }
+};
+
 static void handle_exception(std::exception &e) {
     PyObject *py_exception = nullptr;
 
+    if (auto err = dynamic_cast<PyErrorState *>(&e)) {
+        err->restore();
+        return;
+    }
     if (dynamic_cast<PyError *>(&e)) {
         return; // Python API should already set execption.
     }
@@ -72,31 +168,6 @@ static void handle_exception(std::exception &e) {
     PyErr_SetString(py_exception, e.what());
 }
 
-class release_GIL_guard {
-  private:
-    PyThreadState *_save;
-
-  public:
-    release_GIL_guard(release_GIL_guard &&) = delete;
-    release_GIL_guard(const release_GIL_guard &) = delete;
-
-    release_GIL_guard() noexcept : _save(PyEval_SaveThread()) {}
-    ~release_GIL_guard() noexcept { PyEval_RestoreThread(_save); }
-
-    class GIL_guard {
-        PyThreadState *&_save;
-
-      public:
-        GIL_guard(GIL_guard &&) = delete;
-        GIL_guard(const GIL_guard &) = delete;
-
-        GIL_guard(PyThreadState *&save) noexcept : _save(save) { PyEval_RestoreThread(_save); }
-        ~GIL_guard() noexcept { _save = PyEval_SaveThread(); }
-    };
-
-    GIL_guard acquire() { return {_save}; }
-};
-
 struct PyVideo {
     PyObject_HEAD;
     std::optional<videoloader::video> video;
@@ -114,11 +185,14 @@ static PyObject *PyVideo_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
 
 static int PyVideo_init(PyVideo *self, PyObject *args, PyObject *kwds) {
     std::string file_path_str;
+    int memory_map = 0;
+    int direct_io = 0;
     {
-        static const char *kwlist[] = {"url", nullptr};
+        static const char *kwlist[] = {"url", "memory_map", "direct_io", nullptr};
         PyBytesObject *_file_path_obj;
-        if (!PyArg_ParseTupleAndKeywords(args, kwds, "O&", (char **)kwlist, PyUnicode_FSConverter,
-                                         &_file_path_obj)) {
+        if (!PyArg_ParseTupleAndKeywords(args, kwds, "O&|pp", (char **)kwlist,
+                                         PyUnicode_FSConverter, &_file_path_obj, &memory_map,
+                                         &direct_io)) {
             return -1;
         }
 
@@ -131,7 +205,11 @@ static int PyVideo_init(PyVideo *self, PyObject *args, PyObject *kwds) {
 
     try {
         release_GIL_guard no_GIL;
-        self->video = videoloader::video(file_path_str);
+        videoloader::file_io::file_spec spec{.path = file_path_str, .direct_io = direct_io != 0};
+        if (memory_map) {
+            spec.mapping = std::make_shared<const videoloader::mapped_file>(file_path_str);
+        }
+        self->video = videoloader::video(spec);
         return 0;
     } catch (std::exception &e) {
         handle_exception(e);
@@ -167,6 +245,16 @@ static PyObject *PyVideo_NumFrames(PyVideo *self, PyObject *args) {
     return PyLong_FromSize_t(self->video->num_frames());
 }
 
+static PyObject *video_memory_usage_to_dict(const videoloader::video_memory_usage &usage) {
+    return Py_BuildValue("{snsnsn}", "index_bytes", (Py_ssize_t)usage.index_bytes,
+                         "demuxer_bytes", (Py_ssize_t)usage.demuxer_bytes, "io_buffer_bytes",
+                         (Py_ssize_t)usage.io_buffer_bytes);
+}
+
+static PyObject *PyVideo_MemoryUsage(PyVideo *self, PyObject *args) {
+    return video_memory_usage_to_dict(self->video->memory_usage());
+}
+
 static owned_pyref FractionClass;
 
 static PyObject *PyVideo_AverageFrameRate(PyVideo *self, PyObject *args) {
@@ -176,26 +264,268 @@ static PyObject *PyVideo_AverageFrameRate(PyVideo *self, PyObject *args) {
     return pyFrameRate.transfer();
 }
 
-static PyObject *PyVideo_GetBatch(PyVideo *self, PyObject *args) {
-    owned_pyref iterator = PyObject_GetIter(args);
+/** Append `n` integers of type `T` at `data`. \return false if Python error occurred */
+template <typename T>
+static bool copy_frame_indices(const char *data, Py_ssize_t n, Py_ssize_t stride,
+                               std::vector<size_t> &indices) {
+    indices.reserve(indices.size() + n);
+    for (Py_ssize_t i = 0; i < n; i++) {
+        T index;
+        std::memcpy(&index, data + i * stride, sizeof(T));
+        if constexpr (std::is_signed_v<T>) {
+            if (index < 0) {
+                PyErr_SetString(PyExc_OverflowError, "frame index should not be negative");
+                return false;
+            }
+        }
+        indices.push_back(static_cast<size_t>(index));
+    }
+    return true;
+}
+
+/** \return 1 if copied, 0 if not an integer type of these sizes, -1 if Python error occurred */
+static int copy_frame_indices(bool is_signed, Py_ssize_t item_size, const char *data,
+                              Py_ssize_t n, Py_ssize_t stride, std::vector<size_t> &indices) {
+    bool ok;
+    switch (item_size) {
+    case 1:
+        ok = is_signed ? copy_frame_indices<int8_t>(data, n, stride, indices)
+                       : copy_frame_indices<uint8_t>(data, n, stride, indices);
+        break;
+    case 2:
+        ok = is_signed ? copy_frame_indices<int16_t>(data, n, stride, indices)
+                       : copy_frame_indices<uint16_t>(data, n, stride, indices);
+        break;
+    case 4:
+        ok = is_signed ? copy_frame_indices<int32_t>(data, n, stride, indices)
+                       : copy_frame_indices<uint32_t>(data, n, stride, indices);
+        break;
+    case 8:
+        ok = is_signed ? copy_frame_indices<int64_t>(data, n, stride, indices)
+                       : copy_frame_indices<uint64_t>(data, n, stride, indices);
+        break;
+    default:
+        return 0;
+    }
+    return ok ? 1 : -1;
+}
+
+/**
+ * Read frame indices from a 1-D integer array exposing the buffer protocol, e.g. numpy.
+ *
+ * \return 1 if parsed, 0 if not such an array, -1 if Python error occurred
+ */
+static int parse_frame_indices_buffer(PyObject *obj, std::vector<size_t> &indices) {
+    if (!PyObject_CheckBuffer(obj)) {
+        return 0;
+    }
+    Py_buffer view;
+    if (PyObject_GetBuffer(obj, &view, PyBUF_RECORDS_RO) != 0) {
+        PyErr_Clear();
+        return 0;
+    }
+    std::unique_ptr<Py_buffer, decltype(&PyBuffer_Release)> release(&view, PyBuffer_Release);
+    std::string_view format = view.format ? view.format : "B";
+    // Native byte order only.
+    if (!format.empty() && (format[0] == '@' || format[0] == '=' ||
+                            (format[0] == '<' && PY_LITTLE_ENDIAN))) {
+        format.remove_prefix(1);
+    }
+    if (view.ndim != 1 || format.size() != 1) {
+        return 0;
+    }
+    auto type = format[0];
+    bool is_signed = std::strchr("bhilqn", type) != nullptr;
+    if (!is_signed && std::strchr("BHILQN", type) == nullptr) {
+        return 0;
+    }
+    return copy_frame_indices(is_signed, view.itemsize, static_cast<const char *>(view.buf),
+                              view.shape[0], view.strides ? view.strides[0] : view.itemsize,
+                              indices);
+}
+
+/**
+ * Read frame indices from a 1-D integer CPU tensor exposing `__dlpack__`, e.g. torch.
+ *
+ * \return 1 if parsed, 0 if not such a tensor, -1 if Python error occurred
+ */
+static int parse_frame_indices_dlpack(PyObject *obj, std::vector<size_t> &indices) {
+    if (!PyObject_HasAttrString(obj, "__dlpack__")) {
+        return 0;
+    }
+    owned_pyref cap = PyObject_CallMethod(obj, "__dlpack__", nullptr);
+    if (!cap) {
+        PyErr_Clear(); // e.g. a tensor requiring grad
+        return 0;
+    }
+    auto dlpack =
+        static_cast<DLManagedTensor *>(PyCapsule_GetPointer(cap.get(), dltensor_capsule_name));
+    if (!dlpack) {
+        PyErr_Clear();
+        return 0;
+    }
+    // Not marked as used, so the capsule calls the deleter.
+    auto &dl = dlpack->dl_tensor;
+    if ((dl.ctx.device_type != kDLCPU && dl.ctx.device_type != kDLCPUPinned) || dl.ndim != 1 ||
+        dl.dtype.lanes != 1 || (dl.dtype.code != kDLInt && dl.dtype.code != kDLUInt)) {
+        return 0;
+    }
+    Py_ssize_t item_size = dl.dtype.bits / 8;
+    return copy_frame_indices(dl.dtype.code == kDLInt, item_size,
+                              static_cast<const char *>(dl.data) + dl.byte_offset, dl.shape[0],
+                              dl.strides ? dl.strides[0] * item_size : item_size, indices);
+}
+
+/** \return false if Python error occurred */
+static bool parse_frame_indices(PyObject *obj, std::vector<size_t> &indices) {
+    // Arrays are read without creating a Python int for every index.
+    for (auto parse_array : {parse_frame_indices_buffer, parse_frame_indices_dlpack}) {
+        auto parsed = parse_array(obj, indices);
+        if (parsed != 0) {
+            return parsed > 0;
+        }
+    }
+    owned_pyref iterator = PyObject_GetIter(obj);
     if (iterator.get() == nullptr) {
-        return nullptr;
+        return false;
     }
-    std::vector<size_t> indices;
     while (true) {
         owned_pyref item = PyIter_Next(iterator.get());
         if (PyErr_Occurred()) {
-            return nullptr;
+            return false;
         }
         if (item.get() == nullptr) {
             break;
         }
         auto idx = PyLong_AsSize_t(item.get());
         if (PyErr_Occurred()) {
-            return nullptr;
+            return false;
         }
         indices.push_back(idx);
     }
+    return true;
+}
+
+/**
+ * Decoded frames, imported zero-copy by any framework supporting DLPack, e.g.
+ * `numpy.from_dlpack(t)` or `torch.from_dlpack(t)`.
+ */
+struct PyTensor {
+    PyObject_HEAD;
+    DLManagedTensor *dlpack;
+};
+
+static void PyTensor_dealloc(PyTensor *self) {
+    if (self->dlpack) {
+        self->dlpack->deleter(self->dlpack);
+    }
+    Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+/** Keyword arguments of newer DLPack versions are accepted and ignored, the tensor is on CPU. */
+static PyObject *PyTensor_DLPack(PyTensor *self, PyObject *args, PyObject *kwds) {
+    // Every export shares the data, and keeps this tensor alive.
+    auto exported = new DLManagedTensor{
+        .dl_tensor = self->dlpack->dl_tensor,
+        .manager_ctx = self,
+        .deleter =
+            [](DLManagedTensor *t) {
+                if (Py_IsInitialized()) {
+                    ensure_GIL_guard GIL;
+                    Py_DECREF((PyObject *)t->manager_ctx);
+                }
+                delete t;
+            },
+    };
+    Py_INCREF(self);
+    auto cap = PyCapsule_New(exported, dltensor_capsule_name, [](PyObject *cap) {
+        if (strcmp(PyCapsule_GetName(cap), dltensor_capsule_name) != 0) {
+            return; // Used.
+        }
+        auto p = PyCapsule_GetPointer(cap, dltensor_capsule_name);
+        auto dlpack = static_cast<DLManagedTensor *>(p);
+        dlpack->deleter(dlpack);
+    });
+    if (!cap) {
+        exported->deleter(exported);
+    }
+    return cap;
+}
+
+static PyObject *PyTensor_DLPackDevice(PyTensor *self, PyObject *args) {
+    auto &ctx = self->dlpack->dl_tensor.ctx;
+    return Py_BuildValue("ii", (int)ctx.device_type, ctx.device_id);
+}
+
+static PyObject *PyTensor_GetShape(PyTensor *self, void *closure) {
+    auto &dl = self->dlpack->dl_tensor;
+    owned_pyref shape = PyTuple_New(dl.ndim);
+    if (!shape) {
+        return nullptr;
+    }
+    for (int i = 0; i < dl.ndim; i++) {
+        auto dim = PyLong_FromLongLong(dl.shape[i]);
+        if (!dim) {
+            return nullptr;
+        }
+        PyTuple_SET_ITEM(shape.get(), i, dim);
+    }
+    return shape.transfer();
+}
+
+static PyMethodDef Tensor_methods[] = {
+    {"__dlpack__", (PyCFunction)(void (*)(void))PyTensor_DLPack, METH_VARARGS | METH_KEYWORDS,
+     nullptr},
+    {"__dlpack_device__", (PyCFunction)PyTensor_DLPackDevice, METH_NOARGS, nullptr},
+    {nullptr},
+};
+
+static PyGetSetDef Tensor_getset[] = {
+    {"shape", (getter)PyTensor_GetShape, nullptr, nullptr, nullptr},
+    {nullptr},
+};
+
+static PyTypeObject PyTensorType = {
+    .ob_base = PyVarObject_HEAD_INIT(nullptr, 0) // clang-format off
+    .tp_name = "videoloader._ext.Tensor", // clang-format on
+    .tp_basicsize = sizeof(PyTensor),
+    .tp_itemsize = 0,
+    .tp_dealloc = (destructor)PyTensor_dealloc,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_methods = Tensor_methods,
+    .tp_getset = Tensor_getset,
+};
+
+static PyObject *dlpack_to_tensor(videoloader::video_dlpack::ptr &&dlPack) {
+    auto self = PyObject_New(PyTensor, &PyTensorType);
+    if (!self) {
+        return nullptr;
+    }
+    self->dlpack = dlPack.release();
+    return (PyObject *)self;
+}
+
+/** List of tensors, taking ownership of `batches`. */
+static PyObject *dlpacks_to_list(std::vector<videoloader::video_dlpack::ptr> &batches) {
+    owned_pyref batch_list = PyList_New(batches.size());
+    if (!batch_list) {
+        return nullptr;
+    }
+    for (size_t i = 0; i < batches.size(); i++) {
+        owned_pyref tensor = dlpack_to_tensor(std::move(batches[i]));
+        if (!tensor) {
+            return nullptr;
+        }
+        PyList_SET_ITEM(batch_list.get(), i, tensor.transfer());
+    }
+    return batch_list.transfer();
+}
+
+static PyObject *PyVideo_GetBatch(PyVideo *self, PyObject *args) {
+    std::vector<size_t> indices;
+    if (!parse_frame_indices(args, indices)) {
+        return nullptr;
+    }
 
     try {
         videoloader::video_dlpack::ptr dlPack;
@@ -203,27 +533,116 @@ static PyObject *PyVideo_GetBatch(PyVideo *self, PyObject *args) {
             release_GIL_guard no_GIL;
             dlPack = self->video->get_batch(indices);
         }
-        return PyCapsule_New(dlPack.release(), dltensor_capsule_name, [](PyObject *cap) {
-            if (strcmp(PyCapsule_GetName(cap), dltensor_capsule_name) != 0) {
-                return; // used.
+        return dlpack_to_tensor(std::move(dlPack));
+    } catch (std::exception &e) {
+        handle_exception(e);
+        return nullptr;
+    }
+}
+
+/** Parse a sequence of `(width, height[, pix_fmt])`, where `pix_fmt` is a FFmpeg name. */
+static bool parse_output_specs(PyObject *obj, std::vector<videoloader::output_spec> &outputs) {
+    owned_pyref items = PySequence_Fast(obj, "outputs should be a sequence");
+    if (!items) {
+        return false;
+    }
+    auto num_outputs = PySequence_Fast_GET_SIZE(items.get());
+    outputs.resize(num_outputs);
+    for (Py_ssize_t i = 0; i < num_outputs; i++) {
+        owned_pyref spec = PySequence_Tuple(PySequence_Fast_GET_ITEM(items.get(), i));
+        if (!spec) {
+            return false;
+        }
+        const char *pix_fmt_name = nullptr;
+        if (!PyArg_ParseTuple(spec.get(), "ii|s", &outputs[i].width, &outputs[i].height,
+                              &pix_fmt_name)) {
+            return false;
+        }
+        if (pix_fmt_name) {
+            outputs[i].pix_fmt = av_get_pix_fmt(pix_fmt_name);
+            if (outputs[i].pix_fmt == AV_PIX_FMT_NONE) {
+                PyErr_Format(PyExc_ValueError, "Unknown pixel format \"%s\"", pix_fmt_name);
+                return false;
             }
-            auto p = PyCapsule_GetPointer(cap, dltensor_capsule_name);
-            auto dlpack = static_cast<DLManagedTensor *>(p);
-            dlpack->deleter(dlpack);
-        });
+        }
+    }
+    return true;
+}
+
+/** Decode frames once, return a list of tensors, one for each output spec. */
+static PyObject *PyVideo_GetBatchOutputs(PyVideo *self, PyObject *args) {
+    PyObject *indices_obj;
+    PyObject *outputs_obj;
+    if (!PyArg_ParseTuple(args, "OO", &indices_obj, &outputs_obj)) {
+        return nullptr;
+    }
+    std::vector<size_t> indices;
+    std::vector<videoloader::output_spec> outputs;
+    if (!parse_frame_indices(indices_obj, indices) || !parse_output_specs(outputs_obj, outputs)) {
+        return nullptr;
+    }
+
+    std::vector<videoloader::video_dlpack::ptr> batches;
+    try {
+        release_GIL_guard no_GIL;
+        batches = self->video->get_batch(indices, outputs);
+    } catch (std::exception &e) {
+        handle_exception(e);
+        return nullptr;
+    }
+    return dlpacks_to_list(batches);
+}
+
+/** Decode a sequence of frame index batches in one pass, return a list of tensors. */
+static PyObject *PyVideo_GetBatches(PyVideo *self, PyObject *args) {
+    owned_pyref items = PySequence_Fast(args, "batches should be a sequence");
+    if (!items) {
+        return nullptr;
+    }
+    auto num_batches = PySequence_Fast_GET_SIZE(items.get());
+    std::vector<std::vector<size_t>> batches_indices(num_batches);
+    for (Py_ssize_t i = 0; i < num_batches; i++) {
+        if (!parse_frame_indices(PySequence_Fast_GET_ITEM(items.get(), i), batches_indices[i])) {
+            return nullptr;
+        }
+    }
+
+    std::vector<videoloader::video_dlpack::ptr> batches;
+    try {
+        release_GIL_guard no_GIL;
+        batches = self->video->get_batches(batches_indices);
+    } catch (std::exception &e) {
+        handle_exception(e);
+        return nullptr;
+    }
+    return dlpacks_to_list(batches);
+}
+
+/** Serialized state to reopen this video without demuxing it, see `_VideoCollection`. */
+static PyObject *PyVideo_State(PyVideo *self, PyObject *args) {
+    std::string state;
+    try {
+        videoloader::video_collection_builder builder;
+        builder.add(*self->video);
+        state = builder.build();
     } catch (std::exception &e) {
         handle_exception(e);
         return nullptr;
     }
+    return PyBytes_FromStringAndSize(state.data(), state.size());
 }
 
 static PyMethodDef Video_methods[] = {
     {"sleep", (PyCFunction)PyVideo_Sleep, METH_NOARGS, nullptr},
     {"is_sleeping", (PyCFunction)PyVideo_IsSleeping, METH_NOARGS, nullptr},
     {"get_batch", (PyCFunction)PyVideo_GetBatch, METH_O, nullptr},
+    {"get_batches", (PyCFunction)PyVideo_GetBatches, METH_O, nullptr},
+    {"get_batch_outputs", (PyCFunction)PyVideo_GetBatchOutputs, METH_VARARGS, nullptr},
     {"num_frames", (PyCFunction)PyVideo_NumFrames, METH_NOARGS, nullptr},
     {"__len__", (PyCFunction)PyVideo_NumFrames, METH_NOARGS, nullptr},
     {"average_frame_rate", (PyCFunction)PyVideo_AverageFrameRate, METH_NOARGS, nullptr},
+    {"memory_usage", (PyCFunction)PyVideo_MemoryUsage, METH_NOARGS, nullptr},
+    {"_state", (PyCFunction)PyVideo_State, METH_NOARGS, nullptr},
     {nullptr},
 };
 
@@ -239,134 +658,1442 @@ static PyTypeObject PyVideoType = {
     .tp_new = PyVideo_new,
 };
 
-static PyObject *DLTensor_to_numpy(PyObject *unused, PyObject *_arg) {
-    owned_pyref cap = borrowed_pyref(_arg).own();
-    auto p = PyCapsule_GetPointer(cap.get(), dltensor_capsule_name);
-    if (p == nullptr) {
-        PyErr_SetString(PyExc_ValueError, "No compatible DLTensor found.");
-        return nullptr;
-    }
-    auto dlpack = static_cast<DLManagedTensor *>(p);
-    auto &dl = dlpack->dl_tensor;
-    owned_pyref array = PyArray_New(&PyArray_Type, dl.ndim, dl.shape, NPY_UINT8, dl.strides,
-                                    dl.data, 0, 0, nullptr);
-    PyArray_SetBaseObject((PyArrayObject *)array.get(), cap.transfer());
-    return array.transfer();
-}
-
-static PyStructSequence_Field PyTarEntry_Fields[]{
-    {"path"},
-    {"file_size"},
-    {nullptr},
-};
-
-static PyStructSequence_Desc PyTarEntry_Desc{
-    .name = "videoloader._ext.TarEntry",
-    .fields = PyTarEntry_Fields,
-    .n_in_sequence = 2,
+struct PyFrameReader {
+    PyObject_HEAD;
+    std::optional<videoloader::frame_reader> reader;
+    /** Read by `reader` */
+    owned_pyref video;
+    /** `reader` is used by a thread with GIL released. Guarded by GIL. */
+    bool busy;
 };
 
-static PyTypeObject PyTarEntry_Type;
-
-// Define some overloads to let compiler choose the best version.
-static PyObject *PyLong_FromNumber(long long num) { return PyLong_FromLongLong(num); }
-
-static PyObject *PyLong_FromNumber(long num) { return PyLong_FromLong(num); }
-
-static PyObject *PyLong_FromNumber(unsigned long long num) {
-    return PyLong_FromUnsignedLongLong(num);
-}
-
-static PyObject *PyLong_FromNumber(unsigned long num) { return PyLong_FromUnsignedLong(num); }
+/** Mark a `PyFrameReader` in use until destructed, so other threads can't close it meanwhile. */
+class frame_reader_use {
+    PyFrameReader *self;
+    bool acquired = false;
 
-static PyObject *PyVideo_OpenVideoTar(PyObject *unused, PyObject *args) {
-    borrowed_pyref video_type = nullptr;
-    std::string tar_path_str;
-    borrowed_pyref filter = nullptr;
-    int max_threads = -1;
-    {
-        PyTypeObject *_video_type;
-        PyBytesObject *_tar_path_obj;
-        PyObject *_filter;
-        if (!PyArg_ParseTuple(args, "O!O&Oi", &PyType_Type, &_video_type, PyUnicode_FSConverter,
-                              &_tar_path_obj, &_filter, &max_threads)) {
-            return nullptr;
-        }
-        if (_filter != Py_None) {
-            if (!PyCallable_Check(_filter)) {
-                PyErr_SetString(PyExc_TypeError, "filter should be a callable");
-                return nullptr;
-            }
-            filter = _filter;
+  public:
+    frame_reader_use(const frame_reader_use &) = delete;
+    /** Call `acquire()` before using the reader */
+    explicit frame_reader_use(PyFrameReader *self) noexcept : self(self) {}
+    ~frame_reader_use() {
+        if (acquired) {
+            self->busy = false;
         }
+    }
 
-        if (!PyType_IsSubtype(_video_type, &PyVideoType)) {
-            PyErr_SetString(PyExc_TypeError, "video_type should be a sub-type of Video");
-            return nullptr;
+    /** \return false if Python error occurred */
+    bool acquire() {
+        if (!self->reader) {
+            PyErr_SetString(PyExc_ValueError, "FrameReader is closed");
+            return false;
         }
-        video_type = (PyObject *)_video_type;
+        if (self->busy) {
+            PyErr_SetString(PyExc_ValueError, "FrameReader is used by another thread");
+            return false;
+        }
+        self->busy = acquired = true;
+        return true;
+    }
+};
 
-        owned_pyref file_path_obj((PyObject *)_tar_path_obj);
-        auto file_path = PyBytes_AsString(file_path_obj.get());
-        if (file_path == nullptr)
+/** `_FrameReader(video, start_frame, chunk_size)` */
+static PyObject *PyFrameReader_new(PyTypeObject *type, PyObject *args, PyObject *kwds) {
+    static const char *kwlist[] = {"video", "start_frame", "chunk_size", nullptr};
+    PyObject *video_obj;
+    Py_ssize_t start_frame = 0;
+    Py_ssize_t chunk_size = 1;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O!|nn", (char **)kwlist, &PyVideoType,
+                                     &video_obj, &start_frame, &chunk_size)) {
+        return nullptr;
+    }
+    if (start_frame < 0 || chunk_size <= 0) {
+        PyErr_SetString(PyExc_ValueError,
+                        "start_frame should not be negative, chunk_size should be positive");
+        return nullptr;
+    }
+    owned_pyref self = type->tp_alloc(type, 0);
+    if (!self) {
+        return nullptr;
+    }
+    auto &pyReader = *(PyFrameReader *)self.get();
+    new (&pyReader.reader) decltype(pyReader.reader)();
+    new (&pyReader.video) owned_pyref(borrowed_pyref(video_obj).own());
+    pyReader.busy = false;
+    try {
+        auto &video = *((PyVideo *)video_obj)->video;
+        release_GIL_guard no_GIL;
+        pyReader.reader.emplace(video, start_frame, chunk_size);
+    } catch (std::exception &e) {
+        handle_exception(e);
+        return nullptr;
+    }
+    return self.transfer();
+}
+
+static void PyFrameReader_dealloc(PyFrameReader *self) {
+    std::destroy_at(&self->reader);
+    std::destroy_at(&self->video);
+    Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+static PyObject *PyFrameReader_Next(PyFrameReader *self) {
+    if (!self->reader) {
+        return nullptr; // Closed
+    }
+    frame_reader_use use(self);
+    if (!use.acquire()) {
+        return nullptr;
+    }
+    videoloader::video_dlpack::ptr chunk;
+    try {
+        release_GIL_guard no_GIL;
+        chunk = self->reader->next();
+    } catch (std::exception &e) {
+        handle_exception(e);
+        return nullptr;
+    }
+    if (!chunk) {
+        return nullptr; // StopIteration
+    }
+    return dlpack_to_tensor(std::move(chunk));
+}
+
+static PyObject *PyFrameReader_Seek(PyFrameReader *self, PyObject *arg) {
+    auto frame_index = PyLong_AsSize_t(arg);
+    if (frame_index == (size_t)-1 && PyErr_Occurred()) {
+        return nullptr;
+    }
+    frame_reader_use use(self);
+    if (!use.acquire()) {
+        return nullptr;
+    }
+    try {
+        release_GIL_guard no_GIL;
+        self->reader->seek(frame_index);
+    } catch (std::exception &e) {
+        handle_exception(e);
+        return nullptr;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject *PyFrameReader_Tell(PyFrameReader *self, PyObject *args) {
+    frame_reader_use use(self);
+    if (!use.acquire()) {
+        return nullptr;
+    }
+    return PyLong_FromSize_t(self->reader->tell());
+}
+
+/** Free the decoder, the reader stops. Raise if another thread is reading. */
+static PyObject *PyFrameReader_Close(PyFrameReader *self, PyObject *args) {
+    if (self->busy) {
+        PyErr_SetString(PyExc_ValueError, "FrameReader is used by another thread");
+        return nullptr;
+    }
+    self->reader.reset();
+    Py_RETURN_NONE;
+}
+
+static PyMethodDef FrameReader_methods[] = {
+    {"seek", (PyCFunction)PyFrameReader_Seek, METH_O, nullptr},
+    {"tell", (PyCFunction)PyFrameReader_Tell, METH_NOARGS, nullptr},
+    {"close", (PyCFunction)PyFrameReader_Close, METH_NOARGS, nullptr},
+    {nullptr},
+};
+
+static PyTypeObject PyFrameReaderType = {
+    .ob_base = PyVarObject_HEAD_INIT(nullptr, 0) // clang-format off
+    .tp_name = "videoloader._ext._FrameReader", // clang-format on
+    .tp_basicsize = sizeof(PyFrameReader),
+    .tp_itemsize = 0,
+    .tp_dealloc = (destructor)PyFrameReader_dealloc,
+    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,
+    .tp_iter = PyObject_SelfIter,
+    .tp_iternext = (iternextfunc)PyFrameReader_Next,
+    .tp_methods = FrameReader_methods,
+    .tp_new = PyFrameReader_new,
+};
+
+/**
+ * Parse a clip `(video, frame_indices)`.
+ *
+ * \return false if Python error occurred
+ */
+static bool parse_clip(PyObject *obj, PyVideo *&video, std::vector<size_t> &indices) {
+    owned_pyref item = PySequence_Fast(obj, "clip should be (video, frame_indices)");
+    if (!item) {
+        return false;
+    }
+    if (PySequence_Fast_GET_SIZE(item.get()) != 2) {
+        PyErr_SetString(PyExc_ValueError, "clip should be (video, frame_indices)");
+        return false;
+    }
+    auto py_video = PySequence_Fast_GET_ITEM(item.get(), 0);
+    if (!PyObject_TypeCheck(py_video, &PyVideoType)) {
+        PyErr_SetString(PyExc_TypeError, "video should be an instance of Video");
+        return false;
+    }
+    video = (PyVideo *)py_video;
+    return parse_frame_indices(PySequence_Fast_GET_ITEM(item.get(), 1), indices);
+}
+
+struct PyDatasetLoader {
+    PyObject_HEAD;
+    std::optional<videoloader::video_dataset_loader> loader;
+    owned_pyref batch_iter;
+    /** Videos referenced by the batches not yet returned. Guarded by GIL. */
+    std::deque<std::vector<owned_pyref>> batch_refs;
+};
+
+static PyObject *PyDatasetLoader_new(PyTypeObject *type, PyObject *args, PyObject *kwds) {
+    owned_pyref self = type->tp_alloc(type, 0);
+    if (!self) {
+        return nullptr;
+    }
+    auto &pyLoader = *(PyDatasetLoader *)self.get();
+    new (&pyLoader.loader) decltype(pyLoader.loader)();
+    new (&pyLoader.batch_iter) decltype(pyLoader.batch_iter)();
+    new (&pyLoader.batch_refs) decltype(pyLoader.batch_refs)();
+    return self.transfer();
+}
+
+/** Convert a Python batch of `(video, frame_indices)`. Called from worker threads. */
+static std::optional<videoloader::dataset_load_batch> PyDatasetLoader_Produce(PyDatasetLoader *self) {
+    ensure_GIL_guard GIL;
+    owned_pyref py_batch = PyIter_Next(self->batch_iter.get());
+    if (!py_batch) {
+        if (PyErr_Occurred()) {
+            throw PyErrorState();
+        }
+        return std::nullopt;
+    }
+    owned_pyref items = PySequence_Fast(py_batch.get(), "batch should be a sequence");
+    if (!items) {
+        throw PyErrorState();
+    }
+    auto num_items = PySequence_Fast_GET_SIZE(items.get());
+    videoloader::dataset_load_batch batch;
+    std::vector<owned_pyref> refs;
+    batch.reserve(num_items);
+    refs.reserve(num_items);
+    for (Py_ssize_t i = 0; i < num_items; i++) {
+        PyVideo *py_video;
+        std::vector<size_t> indices;
+        if (!parse_clip(PySequence_Fast_GET_ITEM(items.get(), i), py_video, indices)) {
+            throw PyErrorState();
+        }
+        batch.push_back({
+            .video = *py_video->video,
+            .frame_indices = std::move(indices),
+        });
+        refs.push_back(borrowed_pyref((PyObject *)py_video).own());
+    }
+    self->batch_refs.push_back(std::move(refs));
+    return batch;
+}
+
+static int PyDatasetLoader_init(PyDatasetLoader *self, PyObject *args, PyObject *kwds) {
+    static const char *kwlist[] = {"schedule",          "max_threads",
+                                   "preload_batches",   "max_preload",
+                                   "max_preload_bytes", "max_preload_decode_time",
+                                   "prefetch_threads",  nullptr};
+    PyObject *schedule;
+    int max_threads = 1;
+    Py_ssize_t preload_batches = videoloader::preload_limits().max_clips;
+    videoloader::preload_limits limits;
+    Py_ssize_t max_preload = limits.max_clips;
+    Py_ssize_t max_preload_bytes = 0;
+    double max_preload_decode_time = 0;
+    int prefetch_threads = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|innndi", (char **)kwlist, &schedule,
+                                     &max_threads, &preload_batches, &max_preload,
+                                     &max_preload_bytes, &max_preload_decode_time,
+                                     &prefetch_threads)) {
+        return -1;
+    }
+    if (self->loader) {
+        PyErr_SetString(PyExc_RuntimeError, "DatasetLoader already initialized");
+        return -1;
+    }
+    if (max_threads <= 0 || preload_batches <= 0 || max_preload <= 0 || max_preload_bytes < 0 ||
+        max_preload_decode_time < 0 || prefetch_threads < 0) {
+        PyErr_SetString(PyExc_ValueError, "Invalid loader parameters");
+        return -1;
+    }
+    limits.max_clips = max_preload;
+    limits.max_bytes = max_preload_bytes;
+    limits.max_decode_time = std::chrono::duration<double>(max_preload_decode_time);
+
+    self->batch_iter = PyObject_GetIter(schedule);
+    if (!self->batch_iter) {
+        return -1;
+    }
+    try {
+        self->loader.emplace([self] { return PyDatasetLoader_Produce(self); }, preload_batches);
+        self->loader->set_preload_limits(limits);
+        if (prefetch_threads > 0) {
+            self->loader->set_prefetcher(
+                std::make_shared<videoloader::prefetcher>(prefetch_threads));
+        }
+        self->loader->start(max_threads);
+        return 0;
+    } catch (std::exception &e) {
+        handle_exception(e);
+        return -1;
+    }
+}
+
+static void PyDatasetLoader_dealloc(PyDatasetLoader *self) {
+    {
+        // Workers may need GIL to produce batches.
+        release_GIL_guard no_GIL;
+        std::destroy_at(&self->loader);
+    }
+    std::destroy_at(&self->batch_refs);
+    std::destroy_at(&self->batch_iter);
+    Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+static PyObject *PyDatasetLoader_Stop(PyDatasetLoader *self, PyObject *args) {
+    try {
+        if (self->loader && self->loader->is_running()) {
+            release_GIL_guard no_GIL;
+            self->loader->stop();
+        }
+    } catch (std::exception &e) {
+        handle_exception(e);
+        return nullptr;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject *PyDatasetLoader_Next(PyDatasetLoader *self) {
+    if (!self->loader) {
+        PyErr_SetString(PyExc_RuntimeError, "DatasetLoader not initialized");
+        return nullptr;
+    }
+    if (!self->loader->is_running()) {
+        PyErr_SetString(PyExc_RuntimeError, "DatasetLoader stopped");
+        return nullptr;
+    }
+    std::vector<videoloader::video_dlpack::ptr> batch;
+    try {
+        release_GIL_guard no_GIL;
+        batch = self->loader->get_next_batch();
+    } catch (videoloader::video_dataset_loader::no_more_batch &) {
+        return nullptr; // StopIteration
+    } catch (std::exception &e) {
+        handle_exception(e);
+        return nullptr;
+    }
+    self->batch_refs.pop_front();
+
+    owned_pyref batch_list = PyList_New(batch.size());
+    if (!batch_list) {
+        return nullptr;
+    }
+    for (size_t i = 0; i < batch.size(); i++) {
+        owned_pyref tensor = dlpack_to_tensor(std::move(batch[i]));
+        if (!tensor) {
+            return nullptr;
+        }
+        PyList_SET_ITEM(batch_list.get(), i, tensor.transfer());
+    }
+    return batch_list.transfer();
+}
+
+static PyMethodDef DatasetLoader_methods[] = {
+    {"stop", (PyCFunction)PyDatasetLoader_Stop, METH_NOARGS, nullptr},
+    {nullptr},
+};
+
+static PyTypeObject PyDatasetLoaderType = {
+    .ob_base = PyVarObject_HEAD_INIT(nullptr, 0) // clang-format off
+    .tp_name = "videoloader._ext._DatasetLoader", // clang-format on
+    .tp_basicsize = sizeof(PyDatasetLoader),
+    .tp_itemsize = 0,
+    .tp_dealloc = (destructor)PyDatasetLoader_dealloc,
+    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,
+    .tp_iter = PyObject_SelfIter,
+    .tp_iternext = (iternextfunc)PyDatasetLoader_Next,
+    .tp_methods = DatasetLoader_methods,
+    .tp_init = (initproc)PyDatasetLoader_init,
+    .tp_new = PyDatasetLoader_new,
+};
+
+static PyObject *DLTensor_to_numpy(PyObject *unused, PyObject *_arg) {
+    owned_pyref cap = borrowed_pyref(_arg).own();
+    auto p = PyCapsule_GetPointer(cap.get(), dltensor_capsule_name);
+    if (p == nullptr) {
+        PyErr_SetString(PyExc_ValueError, "No compatible DLTensor found.");
+        return nullptr;
+    }
+    auto dlpack = static_cast<DLManagedTensor *>(p);
+    auto &dl = dlpack->dl_tensor;
+    owned_pyref array = PyArray_New(&PyArray_Type, dl.ndim, dl.shape, NPY_UINT8, dl.strides,
+                                    dl.data, 0, 0, nullptr);
+    PyArray_SetBaseObject((PyArrayObject *)array.get(), cap.transfer());
+    return array.transfer();
+}
+
+static PyStructSequence_Field PyTarEntry_Fields[]{
+    {"path"},
+    {"file_size"},
+    {nullptr},
+};
+
+static PyStructSequence_Desc PyTarEntry_Desc{
+    .name = "videoloader._ext.TarEntry",
+    .fields = PyTarEntry_Fields,
+    .n_in_sequence = 2,
+};
+
+static PyTypeObject PyTarEntry_Type;
+
+// Define some overloads to let compiler choose the best version.
+static PyObject *PyLong_FromNumber(long long num) { return PyLong_FromLongLong(num); }
+
+static PyObject *PyLong_FromNumber(long num) { return PyLong_FromLong(num); }
+
+static PyObject *PyLong_FromNumber(unsigned long long num) {
+    return PyLong_FromUnsignedLongLong(num);
+}
+
+static PyObject *PyLong_FromNumber(unsigned long num) { return PyLong_FromUnsignedLong(num); }
+
+struct open_video_tar_args {
+    owned_pyref video_type;
+    std::string tar_path;
+    owned_pyref filter;
+    int max_threads = -1;
+    tar_options options = tar_options::advise_sequential;
+    tar_entry_filter native_filter;
+};
+
+/** Parse a str or an iterable of str. None is an empty list. */
+static bool parse_string_list(PyObject *obj, std::vector<std::string> &strings) {
+    strings.clear();
+    if (obj == Py_None) {
+        return true;
+    }
+    if (PyUnicode_Check(obj)) {
+        auto str = PyUnicode_AsUTF8(obj);
+        if (!str) {
+            return false;
+        }
+        strings.push_back(str);
+        return true;
+    }
+    owned_pyref iter = PyObject_GetIter(obj);
+    if (!iter) {
+        return false;
+    }
+    while (owned_pyref item = PyIter_Next(iter.get())) {
+        auto str = PyUnicode_AsUTF8(item.get());
+        if (!str) {
+            return false;
+        }
+        strings.push_back(str);
+    }
+    return !PyErr_Occurred();
+}
+
+/** Set the conditions of `filter` from Python arguments. */
+static bool parse_native_filter(PyObject *extensions, PyObject *globs, const char *regex,
+                                long long min_size, long long max_size,
+                                tar_entry_filter &filter) {
+    std::vector<std::string> extension_list;
+    if (!parse_string_list(extensions, extension_list) ||
+        !parse_string_list(globs, filter.globs)) {
+        return false;
+    }
+    filter.set_extensions(extension_list);
+    if (regex) {
+        try {
+            filter.set_regex(regex);
+        } catch (std::regex_error &e) {
+            PyErr_Format(PyExc_ValueError, "Invalid regex: %s", e.what());
+            return false;
+        }
+    }
+    filter.min_size = min_size;
+    filter.max_size = max_size;
+    return true;
+}
+
+/**
+ * Parse `(video_type, tar_path, filter, max_threads[, memory_map[, sidecar_index[, extensions[,
+ * globs[, regex[, min_size[, max_size[, direct_io]]]]]]]])`
+ */
+static bool parse_open_video_tar_args(PyObject *args, open_video_tar_args &parsed) {
+    PyTypeObject *_video_type;
+    PyBytesObject *_tar_path_obj;
+    PyObject *_filter;
+    int memory_map = 0;
+    int sidecar_index = 0;
+    PyObject *extensions = Py_None;
+    PyObject *globs = Py_None;
+    const char *regex = nullptr;
+    long long min_size = 0;
+    long long max_size = -1;
+    int direct_io = 0;
+    if (!PyArg_ParseTuple(args, "O!O&Oi|ppOOzLLp", &PyType_Type, &_video_type,
+                          PyUnicode_FSConverter, &_tar_path_obj, &_filter, &parsed.max_threads,
+                          &memory_map, &sidecar_index, &extensions, &globs, &regex, &min_size,
+                          &max_size, &direct_io)) {
+        return false;
+    }
+    owned_pyref file_path_obj((PyObject *)_tar_path_obj);
+
+    if (!parse_native_filter(extensions, globs, regex, min_size, max_size,
+                             parsed.native_filter)) {
+        return false;
+    }
+    if (_filter != Py_None) {
+        if (!PyCallable_Check(_filter)) {
+            PyErr_SetString(PyExc_TypeError, "filter should be a callable");
+            return false;
+        }
+        parsed.filter = borrowed_pyref(_filter).own();
+    }
+
+    if (!PyType_IsSubtype(_video_type, &PyVideoType)) {
+        PyErr_SetString(PyExc_TypeError, "video_type should be a sub-type of Video");
+        return false;
+    }
+    parsed.video_type = borrowed_pyref((PyObject *)_video_type).own();
+
+    auto file_path = PyBytes_AsString(file_path_obj.get());
+    if (file_path == nullptr)
+        return false;
+    parsed.tar_path = file_path;
+
+    if (memory_map) {
+        parsed.options = parsed.options | tar_options::memory_map;
+    }
+    if (sidecar_index) {
+        parsed.options = parsed.options | tar_options::sidecar_index;
+    }
+    if (direct_io) {
+        parsed.options = parsed.options | tar_options::direct_io;
+    }
+    return true;
+}
+
+/**
+ * Select entries by the native filter, then by the Python filter if any. Callable from any thread,
+ * GIL should not be held by the calling thread. `filter` should outlive the returned function.
+ */
+static videoloader::video_tar_stream::filter_type
+make_tar_entry_filter(borrowed_pyref filter, const tar_entry_filter &native_filter) {
+    if (!filter) {
+        if (native_filter.empty()) {
+            return [](const tar_entry &) { return true; };
+        }
+        return native_filter;
+    }
+    return [filter, native_filter](const tar_entry &entry) {
+        // Most entries of large shards are rejected here without taking GIL.
+        if (!native_filter(entry)) {
+            return false;
+        }
+        ensure_GIL_guard GIL;
+        owned_pyref py_entry = PyStructSequence_New(&PyTarEntry_Type);
+        if (!py_entry) {
+            throw PyErrorState();
+        }
+        PyStructSequence_SET_ITEM(py_entry.get(), 0, PyUnicode_FromString(entry.path().c_str()));
+        PyStructSequence_SET_ITEM(py_entry.get(), 1, PyLong_FromNumber(entry.file_size()));
+        owned_pyref result = PyObject_CallFunctionObjArgs(filter.get(), py_entry.get(), nullptr);
+        if (!result) {
+            throw PyErrorState();
+        }
+        int is_true = PyObject_IsTrue(result.get());
+        if (is_true < 0) {
+            throw PyErrorState();
+        }
+        return is_true != 0;
+    };
+}
+
+static PyObject *wrap_video(borrowed_pyref video_type, videoloader::video &&v) {
+    owned_pyref py_video = PyVideo_new((PyTypeObject *)video_type.get(), nullptr, nullptr);
+    if (!py_video) {
+        return nullptr;
+    }
+    ((PyVideo *)py_video.get())->video = std::move(v);
+    return py_video.transfer();
+}
+
+static PyObject *PyVideo_OpenVideoTar(PyObject *unused, PyObject *args) {
+    open_video_tar_args parsed;
+    if (!parse_open_video_tar_args(args, parsed)) {
+        return nullptr;
+    }
+    std::vector<videoloader::video> videos;
+    try {
+        release_GIL_guard no_GIL;
+        auto filter = make_tar_entry_filter(parsed.filter, parsed.native_filter);
+        if (parsed.max_threads > 0) {
+            videos = videoloader::open_video_tar(parsed.tar_path, filter, parsed.max_threads,
+                                                 parsed.options);
+        } else {
+            videos = videoloader::open_video_tar(parsed.tar_path, filter, parsed.options);
+        }
+    } catch (std::exception &e) {
+        handle_exception(e);
+        return nullptr;
+    }
+    owned_pyref video_list = PyList_New(videos.size());
+    if (!video_list) {
+        return nullptr;
+    }
+    for (size_t i = 0; i < videos.size(); i++) {
+        owned_pyref py_video = wrap_video(parsed.video_type, std::move(videos[i]));
+        if (!py_video) {
+            return nullptr;
+        }
+        PyList_SET_ITEM(video_list.get(), i, py_video.transfer());
+    }
+    return video_list.transfer();
+}
+
+/** Take the current Python error as an exception object. */
+static PyObject *fetch_exception() {
+    PyObject *type, *value, *traceback;
+    PyErr_Fetch(&type, &value, &traceback);
+    PyErr_NormalizeException(&type, &value, &traceback);
+    if (traceback) {
+        PyException_SetTraceback(value, traceback);
+    }
+    Py_XDECREF(type);
+    Py_XDECREF(traceback);
+    return value;
+}
+
+/** Convert an error to the Python exception object `handle_exception` would raise. */
+static PyObject *exception_to_pyobject(std::exception_ptr error) {
+    try {
+        std::rethrow_exception(error);
+    } catch (std::exception &e) {
+        handle_exception(e);
+    } catch (...) {
+        PyErr_SetString(PyExc_RuntimeError, "Unknown error");
+    }
+    return fetch_exception();
+}
+
+/** Decode `[(video, frame_indices), ...]` in parallel, return a list of capsules. */
+static PyObject *PyGetBatches(PyObject *unused, PyObject *args) {
+    PyObject *requests_obj;
+    int max_threads;
+    if (!PyArg_ParseTuple(args, "Oi", &requests_obj, &max_threads)) {
+        return nullptr;
+    }
+    owned_pyref items = PySequence_Fast(requests_obj, "requests should be a sequence");
+    if (!items) {
+        return nullptr;
+    }
+    auto num_requests = PySequence_Fast_GET_SIZE(items.get());
+    // `items` keeps videos alive.
+    std::vector<videoloader::batch_request> requests;
+    requests.reserve(num_requests);
+    for (Py_ssize_t i = 0; i < num_requests; i++) {
+        PyVideo *py_video;
+        std::vector<size_t> indices;
+        if (!parse_clip(PySequence_Fast_GET_ITEM(items.get(), i), py_video, indices)) {
+            return nullptr;
+        }
+        requests.push_back({
+            .video = *py_video->video,
+            .frame_indices = std::move(indices),
+        });
+    }
+
+    std::vector<videoloader::batch_result> results;
+    try {
+        release_GIL_guard no_GIL;
+        results = videoloader::get_batches(requests, max_threads);
+    } catch (std::exception &e) {
+        handle_exception(e);
+        return nullptr;
+    }
+    for (auto &r : results) {
+        if (r.error) {
+            // Raise the first error, other batches are freed.
+            try {
+                std::rethrow_exception(r.error);
+            } catch (std::exception &e) {
+                handle_exception(e);
+            } catch (...) {
+                PyErr_SetString(PyExc_RuntimeError, "Unknown error");
+            }
+            return nullptr;
+        }
+    }
+    owned_pyref batch_list = PyList_New(results.size());
+    if (!batch_list) {
+        return nullptr;
+    }
+    for (size_t i = 0; i < results.size(); i++) {
+        owned_pyref tensor = dlpack_to_tensor(std::move(results[i].batch));
+        if (!tensor) {
+            return nullptr;
+        }
+        PyList_SET_ITEM(batch_list.get(), i, tensor.transfer());
+    }
+    return batch_list.transfer();
+}
+
+/** Python objects of an asynchronous request, released with GIL by whichever thread drops them. */
+struct py_async_batch {
+    owned_pyref video;
+    owned_pyref future;
+    owned_pyref convert;
+};
+
+/** Complete the future with `convert(tensor)`, or with the error. */
+static void complete_future(py_async_batch &request, videoloader::batch_result &&result) {
+    owned_pyref value;
+    if (result.batch) {
+        value = dlpack_to_tensor(std::move(result.batch));
+        if (value && request.convert.get() != Py_None) {
+            value = PyObject_CallFunctionObjArgs(request.convert.get(), value.get(), nullptr);
+        }
+    }
+    owned_pyref ret;
+    if (value) {
+        ret = PyObject_CallMethod(request.future.get(), "set_result", "O", value.get());
+    } else {
+        owned_pyref error = result.error ? exception_to_pyobject(result.error) : fetch_exception();
+        ret = PyObject_CallMethod(request.future.get(), "set_exception", "O", error.get());
+    }
+    if (!ret) {
+        PyErr_WriteUnraisable(request.future.get());
+    }
+}
+
+/**
+ * `(video, frame_indices, future, convert, sleep_when_idle)`, decode in background and complete
+ * the `concurrent.futures.Future` with `convert(tensor)`. The request is skipped if the future is
+ * cancelled before decoding starts.
+ */
+static PyObject *PyGetBatchAsync(PyObject *unused, PyObject *args) {
+    PyObject *video_obj, *indices_obj, *future_obj, *convert_obj;
+    int sleep_when_idle;
+    if (!PyArg_ParseTuple(args, "O!OOOp", &PyVideoType, &video_obj, &indices_obj, &future_obj,
+                          &convert_obj, &sleep_when_idle)) {
+        return nullptr;
+    }
+    std::vector<size_t> indices;
+    if (!parse_frame_indices(indices_obj, indices)) {
+        return nullptr;
+    }
+    std::shared_ptr<py_async_batch> request(
+        new py_async_batch{
+            .video = borrowed_pyref(video_obj).own(),
+            .future = borrowed_pyref(future_obj).own(),
+            .convert = borrowed_pyref(convert_obj).own(),
+        },
+        [](py_async_batch *r) {
+            ensure_GIL_guard GIL;
+            delete r;
+        });
+    videoloader::async_batch_callbacks callbacks{
+        .on_start =
+            [request] {
+                ensure_GIL_guard GIL;
+                owned_pyref running = PyObject_CallMethod(request->future.get(),
+                                                          "set_running_or_notify_cancel", nullptr);
+                if (!running) {
+                    PyErr_WriteUnraisable(request->future.get());
+                    return false;
+                }
+                return running.get() == Py_True;
+            },
+        .on_done =
+            [request](videoloader::batch_result &&result) {
+                ensure_GIL_guard GIL;
+                complete_future(*request, std::move(result));
+            },
+    };
+    try {
+        auto &video = *((PyVideo *)video_obj)->video;
+        release_GIL_guard no_GIL;
+        videoloader::async_batch_decoder::shared().submit(video, std::move(indices),
+                                                          std::move(callbacks), sleep_when_idle);
+    } catch (std::exception &e) {
+        handle_exception(e);
+        return nullptr;
+    }
+    Py_RETURN_NONE;
+}
+
+/** Shuffle Python clips `(video, frame_indices)`, return batches of the same clip objects. */
+static PyObject *PyLocalityShuffle(PyObject *unused, PyObject *args) {
+    PyObject *clips_obj;
+    Py_ssize_t batch_size, block_size, window_size;
+    int shuffle_windows;
+    unsigned long long seed;
+    if (!PyArg_ParseTuple(args, "OnnnpK", &clips_obj, &batch_size, &block_size, &window_size,
+                          &shuffle_windows, &seed)) {
+        return nullptr;
+    }
+    if (batch_size <= 0 || block_size <= 0 || window_size < 0) {
+        PyErr_SetString(PyExc_ValueError, "Invalid shuffle parameters");
+        return nullptr;
+    }
+    owned_pyref clips = PySequence_Fast(clips_obj, "clips should be a sequence");
+    if (!clips) {
+        return nullptr;
+    }
+    auto num_clips = PySequence_Fast_GET_SIZE(clips.get());
+    std::vector<videoloader::clip_location> locations;
+    locations.reserve(num_clips);
+    try {
+        for (Py_ssize_t i = 0; i < num_clips; i++) {
+            PyVideo *py_video;
+            std::vector<size_t> indices;
+            if (!parse_clip(PySequence_Fast_GET_ITEM(clips.get(), i), py_video, indices)) {
+                return nullptr;
+            }
+            locations.push_back(videoloader::locate_clip({
+                .video = *py_video->video,
+                .frame_indices = std::move(indices),
+            }));
+        }
+    } catch (std::exception &e) {
+        handle_exception(e);
+        return nullptr;
+    }
+
+    std::vector<size_t> order;
+    try {
+        release_GIL_guard no_GIL;
+        order = videoloader::locality_shuffle_order(
+            locations, {
+                           .block_size = size_t(block_size),
+                           .window_size = size_t(window_size),
+                           .shuffle_windows = bool(shuffle_windows),
+                           .seed = seed,
+                       });
+    } catch (std::exception &e) {
+        handle_exception(e);
+        return nullptr;
+    }
+    owned_pyref batches = PyList_New(0);
+    if (!batches) {
+        return nullptr;
+    }
+    for (size_t begin = 0; begin < order.size(); begin += batch_size) {
+        auto end = std::min(begin + batch_size, order.size());
+        owned_pyref batch = PyList_New(end - begin);
+        if (!batch) {
+            return nullptr;
+        }
+        for (auto i = begin; i < end; i++) {
+            auto clip = PySequence_Fast_GET_ITEM(clips.get(), order[i]);
+            Py_INCREF(clip);
+            PyList_SET_ITEM(batch.get(), i - begin, clip);
+        }
+        if (PyList_Append(batches.get(), batch.get()) != 0) {
+            return nullptr;
+        }
+    }
+    return batches.transfer();
+}
+
+static PyObject *PyVideo_OpenVideos(PyObject *unused, PyObject *args) {
+    PyTypeObject *video_type;
+    PyObject *paths_obj;
+    int max_threads;
+    int memory_map = 0;
+    if (!PyArg_ParseTuple(args, "O!Oi|p", &PyType_Type, &video_type, &paths_obj, &max_threads,
+                          &memory_map)) {
+        return nullptr;
+    }
+    if (!PyType_IsSubtype(video_type, &PyVideoType)) {
+        PyErr_SetString(PyExc_TypeError, "video_type should be a sub-type of Video");
+        return nullptr;
+    }
+    std::vector<std::string> paths;
+    {
+        owned_pyref iter = PyObject_GetIter(paths_obj);
+        if (!iter) {
+            return nullptr;
+        }
+        while (owned_pyref item = PyIter_Next(iter.get())) {
+            PyObject *_path_obj;
+            if (!PyUnicode_FSConverter(item.get(), &_path_obj)) {
+                return nullptr;
+            }
+            owned_pyref path_obj(_path_obj);
+            paths.push_back(PyBytes_AS_STRING(path_obj.get()));
+        }
+        if (PyErr_Occurred()) {
+            return nullptr;
+        }
+    }
+
+    std::vector<videoloader::open_video_result> results;
+    try {
+        release_GIL_guard no_GIL;
+        results = videoloader::open_videos(paths, max_threads, memory_map);
+    } catch (std::exception &e) {
+        handle_exception(e);
+        return nullptr;
+    }
+    owned_pyref result_list = PyList_New(results.size());
+    if (!result_list) {
+        return nullptr;
+    }
+    for (size_t i = 0; i < results.size(); i++) {
+        owned_pyref item = results[i].video
+                               ? wrap_video((PyObject *)video_type, std::move(*results[i].video))
+                               : exception_to_pyobject(results[i].error);
+        if (!item) {
+            return nullptr;
+        }
+        PyList_SET_ITEM(result_list.get(), i, item.transfer());
+    }
+    return result_list.transfer();
+}
+
+struct PyVideoTarIterator {
+    PyObject_HEAD;
+    std::optional<videoloader::video_tar_stream> stream;
+    owned_pyref video_type;
+    /** Referenced by `stream` */
+    owned_pyref filter;
+};
+
+static void PyVideoTarIterator_dealloc(PyVideoTarIterator *self) {
+    {
+        // Reader thread may need GIL to call the filter.
+        release_GIL_guard no_GIL;
+        std::destroy_at(&self->stream);
+    }
+    std::destroy_at(&self->filter);
+    std::destroy_at(&self->video_type);
+    Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+static PyObject *PyVideoTarIterator_Next(PyVideoTarIterator *self) {
+    std::optional<videoloader::video> v;
+    try {
+        release_GIL_guard no_GIL;
+        v = self->stream->next();
+    } catch (std::exception &e) {
+        handle_exception(e);
+        return nullptr;
+    }
+    if (!v) {
+        return nullptr; // StopIteration
+    }
+    return wrap_video(self->video_type, std::move(*v));
+}
+
+static PyObject *PyVideoTarIterator_Stop(PyVideoTarIterator *self, PyObject *args) {
+    {
+        release_GIL_guard no_GIL;
+        self->stream->stop();
+    }
+    Py_RETURN_NONE;
+}
+
+static PyMethodDef VideoTarIterator_methods[] = {
+    {"stop", (PyCFunction)PyVideoTarIterator_Stop, METH_NOARGS, nullptr},
+    {nullptr},
+};
+
+static PyTypeObject PyVideoTarIteratorType = {
+    .ob_base = PyVarObject_HEAD_INIT(nullptr, 0) // clang-format off
+    .tp_name = "videoloader._ext._VideoTarIterator", // clang-format on
+    .tp_basicsize = sizeof(PyVideoTarIterator),
+    .tp_itemsize = 0,
+    .tp_dealloc = (destructor)PyVideoTarIterator_dealloc,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_iter = PyObject_SelfIter,
+    .tp_iternext = (iternextfunc)PyVideoTarIterator_Next,
+    .tp_methods = VideoTarIterator_methods,
+};
+
+static PyObject *PyVideo_IterVideoTar(PyObject *unused, PyObject *args) {
+    open_video_tar_args parsed;
+    if (!parse_open_video_tar_args(args, parsed)) {
+        return nullptr;
+    }
+    owned_pyref self = PyVideoTarIteratorType.tp_alloc(&PyVideoTarIteratorType, 0);
+    if (!self) {
+        return nullptr;
+    }
+    auto &iter = *(PyVideoTarIterator *)self.get();
+    new (&iter.stream) decltype(iter.stream)();
+    new (&iter.video_type) owned_pyref(std::move(parsed.video_type));
+    new (&iter.filter) owned_pyref(std::move(parsed.filter));
+    try {
+        release_GIL_guard no_GIL;
+        iter.stream.emplace(parsed.tar_path,
+                            make_tar_entry_filter(iter.filter, parsed.native_filter),
+                            std::max(parsed.max_threads, 1), parsed.options);
+    } catch (std::exception &e) {
+        handle_exception(e);
+        return nullptr;
+    }
+    return self.transfer();
+}
+
+struct PyVideoCollection {
+    PyObject_HEAD;
+    std::optional<videoloader::video_collection> collection;
+};
+
+static PyObject *PyVideoCollection_alloc(PyTypeObject *type) {
+    owned_pyref self = type->tp_alloc(type, 0);
+    if (!self) {
+        return nullptr;
+    }
+    auto &pyCollection = *(PyVideoCollection *)self.get();
+    new (&pyCollection.collection) decltype(pyCollection.collection)();
+    return self.transfer();
+}
+
+/** `_VideoCollection(videos)`, collect metadata of opened videos. */
+static PyObject *PyVideoCollection_new(PyTypeObject *type, PyObject *args, PyObject *kwds) {
+    static const char *kwlist[] = {"videos", nullptr};
+    PyObject *videos_obj;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O", (char **)kwlist, &videos_obj)) {
+        return nullptr;
+    }
+    videoloader::video_collection_builder builder;
+    owned_pyref iter = PyObject_GetIter(videos_obj);
+    if (!iter) {
+        return nullptr;
+    }
+    while (owned_pyref item = PyIter_Next(iter.get())) {
+        if (!PyObject_TypeCheck(item.get(), &PyVideoType)) {
+            PyErr_SetString(PyExc_TypeError, "videos should be Video objects");
+            return nullptr;
+        }
+        try {
+            builder.add(*((PyVideo *)item.get())->video);
+        } catch (std::exception &e) {
+            handle_exception(e);
             return nullptr;
-        tar_path_str = file_path;
+        }
+    }
+    if (PyErr_Occurred()) {
+        return nullptr;
+    }
+
+    owned_pyref self = PyVideoCollection_alloc(type);
+    if (!self) {
+        return nullptr;
+    }
+    try {
+        ((PyVideoCollection *)self.get())->collection =
+            videoloader::video_collection::from_bytes(builder.build());
+    } catch (std::exception &e) {
+        handle_exception(e);
+        return nullptr;
+    }
+    return self.transfer();
+}
+
+/**
+ * Use the buffer of `obj` written by `to_bytes()`, e.g. `bytes` or `mmap`, without copying it
+ * unless it is not aligned. The buffer is released with the collection.
+ */
+static std::optional<videoloader::video_collection> buffer_to_video_collection(PyObject *obj) {
+    auto view = std::make_unique<Py_buffer>();
+    if (PyObject_GetBuffer(obj, view.get(), PyBUF_SIMPLE) < 0) {
+        return std::nullopt;
+    }
+    auto data = (const uint8_t *)view->buf;
+    auto size = (size_t)view->len;
+    std::shared_ptr<const void> owner(view.release(), [](Py_buffer *v) {
+        ensure_GIL_guard with_GIL;
+        PyBuffer_Release(v);
+        delete v;
+    });
+    try {
+        if ((uintptr_t)data % alignof(uint64_t) != 0) {
+            return videoloader::video_collection::from_bytes(
+                std::string((const char *)data, size));
+        }
+        return videoloader::video_collection::from_buffer(std::move(owner), data, size);
+    } catch (std::exception &e) {
+        handle_exception(e);
+        return std::nullopt;
+    }
+}
+
+static PyObject *PyVideoCollection_FromBytes(PyTypeObject *type, PyObject *data) {
+    auto collection = buffer_to_video_collection(data);
+    if (!collection) {
+        return nullptr;
+    }
+    owned_pyref self = PyVideoCollection_alloc(type);
+    if (!self) {
+        return nullptr;
+    }
+    ((PyVideoCollection *)self.get())->collection = std::move(collection);
+    return self.transfer();
+}
+
+static PyObject *PyVideoCollection_OpenCatalog(PyTypeObject *type, PyObject *path) {
+    PyObject *_path_obj;
+    if (!PyUnicode_FSConverter(path, &_path_obj)) {
+        return nullptr;
+    }
+    owned_pyref path_obj(_path_obj);
+    std::string path_str = PyBytes_AS_STRING(path_obj.get());
+    owned_pyref self = PyVideoCollection_alloc(type);
+    if (!self) {
+        return nullptr;
     }
-    std::vector<videoloader::video> videos;
     try {
         release_GIL_guard no_GIL;
-        if (filter) {
-            auto native_filter = [&no_GIL, filter](const tar_entry &entry) {
-                auto GIL = no_GIL.acquire();
-                owned_pyref py_entry = PyStructSequence_New(&PyTarEntry_Type);
-                if (!py_entry) {
-                    throw PyError();
-                }
-                PyStructSequence_SET_ITEM(py_entry.get(), 0,
-                                          PyUnicode_FromString(entry.path().c_str()));
-                PyStructSequence_SET_ITEM(py_entry.get(), 1, PyLong_FromNumber(entry.file_size()));
-                owned_pyref result =
-                    PyObject_CallFunctionObjArgs(filter.get(), py_entry.get(), nullptr);
-                if (!result) {
-                    throw PyError();
-                }
-                return PyObject_IsTrue(result.get());
-            };
-            if (max_threads > 0) {
-                videos = videoloader::open_video_tar(tar_path_str, native_filter, max_threads);
-            } else {
-                videos = videoloader::open_video_tar(tar_path_str, native_filter);
-            }
-        } else {
-            if (max_threads > 0) {
-                videos = videoloader::open_video_tar(tar_path_str, max_threads);
-            } else {
-                videos = videoloader::open_video_tar(tar_path_str);
+        ((PyVideoCollection *)self.get())->collection = videoloader::video_collection::map(path_str);
+    } catch (std::exception &e) {
+        handle_exception(e);
+        return nullptr;
+    }
+    return self.transfer();
+}
+
+static void PyVideoCollection_dealloc(PyVideoCollection *self) {
+    std::destroy_at(&self->collection);
+    Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+static PyObject *PyVideoCollection_ToBytes(PyVideoCollection *self, PyObject *args) {
+    auto bytes = self->collection->bytes();
+    return PyBytes_FromStringAndSize(bytes.data(), bytes.size());
+}
+
+static Py_ssize_t PyVideoCollection_Len(PyVideoCollection *self) {
+    return self->collection->size();
+}
+
+/** Index of a video in the collection, negative `i` counts from the end. */
+static size_t collection_index(PyVideoCollection *self, Py_ssize_t i) {
+    if (i < 0) {
+        i += self->collection->size();
+    }
+    return i < 0 ? SIZE_MAX : (size_t)i;
+}
+
+static PyObject *PyVideoCollection_Open(PyVideoCollection *self, PyObject *args) {
+    PyTypeObject *video_type;
+    Py_ssize_t i;
+    if (!PyArg_ParseTuple(args, "O!n", &PyType_Type, &video_type, &i)) {
+        return nullptr;
+    }
+    if (!PyType_IsSubtype(video_type, &PyVideoType)) {
+        PyErr_SetString(PyExc_TypeError, "video_type should be a sub-type of Video");
+        return nullptr;
+    }
+    auto index = collection_index(self, i);
+    std::optional<videoloader::video> v;
+    try {
+        release_GIL_guard no_GIL;
+        v = self->collection->open(index);
+        v->sleep();
+    } catch (std::exception &e) {
+        handle_exception(e);
+        return nullptr;
+    }
+    return wrap_video((PyObject *)video_type, std::move(*v));
+}
+
+static PyObject *PyVideoCollection_Path(PyVideoCollection *self, PyObject *arg) {
+    auto i = PyNumber_AsSsize_t(arg, PyExc_OverflowError);
+    if (i == -1 && PyErr_Occurred()) {
+        return nullptr;
+    }
+    try {
+        auto path = self->collection->path(collection_index(self, i));
+        return PyUnicode_DecodeFSDefaultAndSize(path.data(), path.size());
+    } catch (std::exception &e) {
+        handle_exception(e);
+        return nullptr;
+    }
+}
+
+static PyObject *PyVideoCollection_NumFrames(PyVideoCollection *self, PyObject *arg) {
+    auto i = PyNumber_AsSsize_t(arg, PyExc_OverflowError);
+    if (i == -1 && PyErr_Occurred()) {
+        return nullptr;
+    }
+    try {
+        return PyLong_FromSize_t(self->collection->num_frames(collection_index(self, i)));
+    } catch (std::exception &e) {
+        handle_exception(e);
+        return nullptr;
+    }
+}
+
+static PyMethodDef VideoCollection_methods[] = {
+    {"from_bytes", (PyCFunction)PyVideoCollection_FromBytes, METH_O | METH_CLASS, nullptr},
+    {"open_catalog", (PyCFunction)PyVideoCollection_OpenCatalog, METH_O | METH_CLASS, nullptr},
+    {"to_bytes", (PyCFunction)PyVideoCollection_ToBytes, METH_NOARGS, nullptr},
+    {"open", (PyCFunction)PyVideoCollection_Open, METH_VARARGS, nullptr},
+    {"path", (PyCFunction)PyVideoCollection_Path, METH_O, nullptr},
+    {"num_frames", (PyCFunction)PyVideoCollection_NumFrames, METH_O, nullptr},
+    {nullptr},
+};
+
+static PySequenceMethods VideoCollection_as_sequence = {
+    .sq_length = (lenfunc)PyVideoCollection_Len,
+};
+
+static PyTypeObject PyVideoCollectionType = {
+    .ob_base = PyVarObject_HEAD_INIT(nullptr, 0) // clang-format off
+    .tp_name = "videoloader._ext._VideoCollection", // clang-format on
+    .tp_basicsize = sizeof(PyVideoCollection),
+    .tp_itemsize = 0,
+    .tp_dealloc = (destructor)PyVideoCollection_dealloc,
+    .tp_as_sequence = &VideoCollection_as_sequence,
+    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,
+    .tp_methods = VideoCollection_methods,
+    .tp_new = PyVideoCollection_new,
+};
+
+/**
+ * `(catalog_path, sources, max_threads, memory_map, extensions, globs, regex, min_size, max_size)`
+ */
+static PyObject *PyWriteDatasetCatalog(PyObject *unused, PyObject *args) {
+    PyBytesObject *_catalog_path_obj;
+    PyObject *sources_obj;
+    videoloader::dataset_catalog_options options;
+    int memory_map = 0;
+    PyObject *extensions = Py_None;
+    PyObject *globs = Py_None;
+    const char *regex = nullptr;
+    long long min_size = 0;
+    long long max_size = -1;
+    if (!PyArg_ParseTuple(args, "O&Oi|pOOzLL", PyUnicode_FSConverter, &_catalog_path_obj,
+                          &sources_obj, &options.max_threads, &memory_map, &extensions, &globs,
+                          &regex, &min_size, &max_size)) {
+        return nullptr;
+    }
+    owned_pyref catalog_path_obj((PyObject *)_catalog_path_obj);
+    std::string catalog_path = PyBytes_AS_STRING(catalog_path_obj.get());
+    options.memory_map = memory_map != 0;
+    if (!parse_native_filter(extensions, globs, regex, min_size, max_size, options.filter)) {
+        return nullptr;
+    }
+    std::vector<std::string> sources;
+    {
+        owned_pyref iter = PyObject_GetIter(sources_obj);
+        if (!iter) {
+            return nullptr;
+        }
+        while (owned_pyref item = PyIter_Next(iter.get())) {
+            PyObject *_path_obj;
+            if (!PyUnicode_FSConverter(item.get(), &_path_obj)) {
+                return nullptr;
             }
+            owned_pyref path_obj(_path_obj);
+            sources.push_back(PyBytes_AS_STRING(path_obj.get()));
+        }
+        if (PyErr_Occurred()) {
+            return nullptr;
         }
+    }
+
+    size_t num_videos;
+    try {
+        release_GIL_guard no_GIL;
+        num_videos = videoloader::write_dataset_catalog(catalog_path, sources, options);
     } catch (std::exception &e) {
         handle_exception(e);
         return nullptr;
     }
-    owned_pyref video_list = PyList_New(videos.size());
-    if (!video_list) {
+    return PyLong_FromSize_t(num_videos);
+}
+
+static PyObject *stage_stats_to_dict(const videoloader::stage_stats &stats) {
+    owned_pyref dict = PyDict_New();
+    if (!dict) {
         return nullptr;
     }
-    for (size_t i = 0; i < videos.size(); i++) {
-        auto &v = videos[i];
-        owned_pyref py_video = PyVideo_new((PyTypeObject *)video_type.get(), nullptr, nullptr);
-        if (!py_video) {
+    for (size_t i = 0; i < stats.size(); i++) {
+        auto &h = stats[i];
+        owned_pyref histogram = PyList_New(h.buckets.size());
+        if (!histogram) {
+            return nullptr;
+        }
+        for (size_t b = 0; b < h.buckets.size(); b++) {
+            PyList_SET_ITEM(histogram.get(), b, PyLong_FromUnsignedLongLong(h.buckets[b]));
+        }
+        owned_pyref stage = Py_BuildValue("{sKsKsKsO}", "count", (unsigned long long)h.count,
+                                          "total_ns", (unsigned long long)h.total_ns, "max_ns",
+                                          (unsigned long long)h.max_ns, "histogram_log2_ns",
+                                          histogram.get());
+        if (!stage) {
+            return nullptr;
+        }
+        if (PyDict_SetItemString(dict.get(),
+                                 videoloader::stage_name(static_cast<videoloader::stage>(i)),
+                                 stage.get()) < 0) {
             return nullptr;
         }
-        ((PyVideo *)py_video.get())->video = std::move(v);
-        PyList_SET_ITEM(video_list.get(), i, py_video.transfer());
     }
-    return video_list.transfer();
+    return dict.transfer();
+}
+
+static PyObject *PyStageStats(PyObject *unused, PyObject *args, PyObject *kwds) {
+    static const char *kwlist[] = {"per_thread", nullptr};
+    int per_thread = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|p", (char **)kwlist, &per_thread)) {
+        return nullptr;
+    }
+    if (!per_thread) {
+        return stage_stats_to_dict(videoloader::total_stage_stats());
+    }
+    auto threads = videoloader::per_thread_stage_stats();
+    owned_pyref result = PyList_New(threads.size());
+    if (!result) {
+        return nullptr;
+    }
+    for (size_t i = 0; i < threads.size(); i++) {
+        owned_pyref stats = stage_stats_to_dict(threads[i].stats);
+        if (!stats) {
+            return nullptr;
+        }
+        auto item = Py_BuildValue("(sO)", threads[i].thread_name.c_str(), stats.get());
+        if (!item) {
+            return nullptr;
+        }
+        PyList_SET_ITEM(result.get(), i, item);
+    }
+    return result.transfer();
+}
+
+static PyObject *PyResetStageStats(PyObject *unused, PyObject *args) {
+    videoloader::reset_stage_stats();
+    Py_RETURN_NONE;
+}
+
+static PyObject *PyStartTrace(PyObject *unused, PyObject *args, PyObject *kwds) {
+    static const char *kwlist[] = {"events_per_thread", nullptr};
+    Py_ssize_t events_per_thread = 1 << 16;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|n", (char **)kwlist, &events_per_thread)) {
+        return nullptr;
+    }
+    if (events_per_thread <= 0) {
+        PyErr_SetString(PyExc_ValueError, "events_per_thread should be greater than 0");
+        return nullptr;
+    }
+    try {
+        videoloader::start_trace(events_per_thread);
+    } catch (std::exception &e) {
+        handle_exception(e);
+        return nullptr;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject *PyStopTrace(PyObject *unused, PyObject *args) {
+    videoloader::stop_trace();
+    Py_RETURN_NONE;
+}
+
+static PyObject *PyWriteTrace(PyObject *unused, PyObject *args) {
+    std::string path_str;
+    {
+        PyBytesObject *_path_obj;
+        if (!PyArg_ParseTuple(args, "O&", PyUnicode_FSConverter, &_path_obj)) {
+            return nullptr;
+        }
+        owned_pyref path_obj((PyObject *)_path_obj);
+        auto path = PyBytes_AsString(path_obj.get());
+        if (path == nullptr)
+            return nullptr;
+        path_str = path;
+    }
+    try {
+        release_GIL_guard no_GIL;
+        videoloader::write_chrome_trace(path_str);
+    } catch (std::exception &e) {
+        handle_exception(e);
+        return nullptr;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject *video_memory_totals_to_dict(const videoloader::video_memory_totals &totals) {
+    owned_pyref dict = video_memory_usage_to_dict(totals.usage);
+    if (!dict) {
+        return nullptr;
+    }
+    owned_pyref count = PyLong_FromSize_t(totals.count);
+    if (!count || PyDict_SetItemString(dict.get(), "count", count.get()) < 0) {
+        return nullptr;
+    }
+    return dict.transfer();
+}
+
+static PyObject *PyMemoryStats(PyObject *unused, PyObject *args) {
+    auto stats = videoloader::get_memory_stats();
+    owned_pyref open_videos = video_memory_totals_to_dict(stats.open_videos);
+    if (!open_videos) {
+        return nullptr;
+    }
+    owned_pyref sleeping_videos = video_memory_totals_to_dict(stats.sleeping_videos);
+    if (!sleeping_videos) {
+        return nullptr;
+    }
+    return Py_BuildValue("{sOsOsnsnsn}", "open_videos", open_videos.get(), "sleeping_videos",
+                         sleeping_videos.get(), "dlpack_pool_bytes",
+                         (Py_ssize_t)stats.dlpack_pool_bytes, "tensor_bytes",
+                         (Py_ssize_t)stats.tensor_bytes, "loader_preload_bytes",
+                         (Py_ssize_t)stats.loader_preload_bytes);
+}
+
+static PyObject *PySetFdCacheCapacity(PyObject *unused, PyObject *args) {
+    Py_ssize_t capacity;
+    if (!PyArg_ParseTuple(args, "n", &capacity)) {
+        return nullptr;
+    }
+    if (capacity < 0) {
+        PyErr_SetString(PyExc_ValueError, "capacity should not be negative");
+        return nullptr;
+    }
+    videoloader::fd_cache::global().set_capacity(capacity);
+    Py_RETURN_NONE;
+}
+
+static PyObject *PyFdCacheStats(PyObject *unused, PyObject *args) {
+    auto &cache = videoloader::fd_cache::global();
+    return Py_BuildValue("{snsnsnsn}", "capacity", (Py_ssize_t)cache.capacity(), "size",
+                         (Py_ssize_t)cache.size(), "hits", (Py_ssize_t)cache.hits(), "misses",
+                         (Py_ssize_t)cache.misses());
 }
 
 static PyMethodDef videoLoader_methods[] = {
     {"dltensor_to_numpy", DLTensor_to_numpy, METH_O, nullptr},
     {"open_video_tar", PyVideo_OpenVideoTar, METH_VARARGS, nullptr},
+    {"iter_video_tar", PyVideo_IterVideoTar, METH_VARARGS, nullptr},
+    {"open_videos", PyVideo_OpenVideos, METH_VARARGS, nullptr},
+    {"locality_shuffle", PyLocalityShuffle, METH_VARARGS, nullptr},
+    {"get_batches", PyGetBatches, METH_VARARGS, nullptr},
+    {"get_batch_async", PyGetBatchAsync, METH_VARARGS, nullptr},
+    {"write_dataset_catalog", PyWriteDatasetCatalog, METH_VARARGS, nullptr},
+    {"stage_stats", (PyCFunction)(void (*)(void))PyStageStats, METH_VARARGS | METH_KEYWORDS,
+     nullptr},
+    {"reset_stage_stats", PyResetStageStats, METH_NOARGS, nullptr},
+    {"start_trace", (PyCFunction)(void (*)(void))PyStartTrace, METH_VARARGS | METH_KEYWORDS,
+     nullptr},
+    {"stop_trace", PyStopTrace, METH_NOARGS, nullptr},
+    {"write_trace", PyWriteTrace, METH_VARARGS, nullptr},
+    {"memory_stats", PyMemoryStats, METH_NOARGS, nullptr},
+    {"set_fd_cache_capacity", PySetFdCacheCapacity, METH_VARARGS, nullptr},
+    {"fd_cache_stats", PyFdCacheStats, METH_NOARGS, nullptr},
     {nullptr},
 };
 
@@ -382,6 +2109,16 @@ static struct PyModuleDef videoLoaderModule = {
 PyMODINIT_FUNC PyInit__ext(void) {
     if (PyType_Ready(&PyVideoType) < 0)
         return nullptr;
+    if (PyType_Ready(&PyDatasetLoaderType) < 0)
+        return nullptr;
+    if (PyType_Ready(&PyVideoTarIteratorType) < 0)
+        return nullptr;
+    if (PyType_Ready(&PyTensorType) < 0)
+        return nullptr;
+    if (PyType_Ready(&PyVideoCollectionType) < 0)
+        return nullptr;
+    if (PyType_Ready(&PyFrameReaderType) < 0)
+        return nullptr;
     if (PyStructSequence_InitType2(&PyTarEntry_Type, &PyTarEntry_Desc) < 0)
         return nullptr;
 
@@ -398,6 +2135,23 @@ PyMODINIT_FUNC PyInit__ext(void) {
     if (PyModule_AddObject(m.get(), "TarEntry", (PyObject *)&PyTarEntry_Type) < 0) {
         return nullptr;
     }
+    if (PyModule_AddObject(m.get(), "_DatasetLoader", (PyObject *)&PyDatasetLoaderType) < 0) {
+        return nullptr;
+    }
+    if (PyModule_AddObject(m.get(), "Tensor", (PyObject *)&PyTensorType) < 0) {
+        return nullptr;
+    }
+    if (PyModule_AddObject(m.get(), "_VideoCollection", (PyObject *)&PyVideoCollectionType) < 0) {
+        return nullptr;
+    }
+    if (PyModule_AddObject(m.get(), "_FrameReader", (PyObject *)&PyFrameReaderType) < 0) {
+        return nullptr;
+    }
+
+    if (PyModule_AddObject(m.get(), "STAGE_STATS_ENABLED",
+                           PyBool_FromLong(videoloader::stage_stats_enabled())) < 0) {
+        return nullptr;
+    }
 
     owned_pyref fractionsModule = PyImport_ImportModule("fractions");
     if (!fractionsModule) {
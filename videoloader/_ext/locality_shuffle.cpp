@@ -0,0 +1,98 @@
+#include "locality_shuffle.h"
+
+#include <algorithm>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+#include <tuple>
+
+namespace huww {
+namespace videoloader {
+
+/**
+ * Fisher-Yates shuffle. `std::shuffle` is not used, its result depends on the standard library,
+ * but the order should be reproducible anywhere with the same seed.
+ */
+template <typename It> static void shuffle(It first, It last, std::mt19937_64 &rng) {
+    for (auto n = last - first; n > 1; n--) {
+        std::iter_swap(first + (n - 1), first + rng() % n);
+    }
+}
+
+clip_location locate_clip(const dataset_load_schedule_detail::video &clip) {
+    auto location = clip.video.file_location();
+    auto first_frame = clip.frame_indices.empty()
+                           ? 0
+                           : *std::min_element(clip.frame_indices.begin(), clip.frame_indices.end());
+    return {
+        .path = std::move(location.path),
+        .offset = location.offset,
+        .first_frame = first_frame,
+    };
+}
+
+std::vector<size_t> locality_shuffle_order(const std::vector<clip_location> &locations,
+                                           const locality_shuffle_options &options) {
+    if (options.block_size == 0) {
+        throw std::logic_error("block_size should be greater than 0");
+    }
+    std::vector<size_t> order(locations.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        auto &la = locations[a], &lb = locations[b];
+        return std::tie(la.path, la.offset, la.first_frame) <
+               std::tie(lb.path, lb.offset, lb.first_frame);
+    });
+
+    // [begin, end) of each block in `order`
+    std::vector<std::pair<size_t, size_t>> blocks;
+    for (size_t i = 0; i < order.size(); i += options.block_size) {
+        blocks.emplace_back(i, std::min(i + options.block_size, order.size()));
+    }
+    auto window_size = options.window_size > 0 ? options.window_size : blocks.size();
+    std::vector<std::pair<size_t, size_t>> windows; // [begin, end) of each window in `blocks`
+    for (size_t i = 0; i < blocks.size(); i += window_size) {
+        windows.emplace_back(i, std::min(i + window_size, blocks.size()));
+    }
+
+    std::mt19937_64 rng(options.seed);
+    for (auto [begin, end] : windows) {
+        shuffle(blocks.begin() + begin, blocks.begin() + end, rng);
+    }
+    if (options.shuffle_windows) {
+        shuffle(windows.begin(), windows.end(), rng);
+    }
+
+    std::vector<size_t> shuffled;
+    shuffled.reserve(order.size());
+    for (auto [window_begin, window_end] : windows) {
+        for (auto b = window_begin; b < window_end; b++) {
+            auto [begin, end] = blocks[b];
+            shuffled.insert(shuffled.end(), order.begin() + begin, order.begin() + end);
+        }
+    }
+    return shuffled;
+}
+
+dataset_load_schedule locality_shuffle(const std::vector<dataset_load_schedule_detail::video> &clips,
+                                       size_t batch_size, const locality_shuffle_options &options) {
+    if (batch_size == 0) {
+        throw std::logic_error("batch_size should be greater than 0");
+    }
+    std::vector<clip_location> locations;
+    locations.reserve(clips.size());
+    for (auto &clip : clips) {
+        locations.push_back(locate_clip(clip));
+    }
+    dataset_load_schedule schedule;
+    for (auto i : locality_shuffle_order(locations, options)) {
+        if (schedule.empty() || schedule.back().size() == batch_size) {
+            schedule.emplace_back().reserve(batch_size);
+        }
+        schedule.back().push_back(clips[i]);
+    }
+    return schedule;
+}
+
+} // namespace videoloader
+} // namespace huww
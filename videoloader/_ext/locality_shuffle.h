@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "video_dataset_loader.h"
+
+namespace huww {
+namespace videoloader {
+
+/**
+ * Shuffle clips while keeping reads mostly sequential, for videos stored in large tars on HDD.
+ *
+ * Clips are sorted by where they are stored, then grouped into blocks of `block_size` adjacent
+ * clips, which are read in file order. Blocks are shuffled within windows of `window_size`
+ * contiguous blocks, and windows are shuffled. So a seek spans at most one window, except when
+ * moving to the next window.
+ */
+struct locality_shuffle_options {
+    size_t block_size = 1;
+    /** Larger is more random and seeks further. 0 to shuffle all blocks together. */
+    size_t window_size = 64;
+    bool shuffle_windows = true;
+    /** Same seed and clips give the same order, e.g. use the epoch number. */
+    uint64_t seed = 0;
+};
+
+/** Where a clip is stored, compared in this order. */
+struct clip_location {
+    std::string path;
+    int64_t offset;      /**< Of the video in the file */
+    size_t first_frame;  /**< Smallest frame index of the clip */
+};
+
+clip_location locate_clip(const dataset_load_schedule_detail::video &clip);
+
+/** \return Permutation of `locations` to read them in. */
+std::vector<size_t> locality_shuffle_order(const std::vector<clip_location> &locations,
+                                           const locality_shuffle_options &options);
+
+/** Shuffle clips and split them into batches of `batch_size`, the last one may be smaller. */
+dataset_load_schedule locality_shuffle(const std::vector<dataset_load_schedule_detail::video> &clips,
+                                       size_t batch_size, const locality_shuffle_options &options);
+
+} // namespace videoloader
+} // namespace huww
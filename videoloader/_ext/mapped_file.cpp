@@ -0,0 +1,51 @@
+#include "mapped_file.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <sstream>
+#include <system_error>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "file_descriptor.h"
+
+namespace huww {
+namespace videoloader {
+
+mapped_file::mapped_file(const std::string &path) {
+    file_descriptor fd(path);
+    _size = fd.size();
+    if (_size == 0) {
+        return; // Nothing to map
+    }
+    auto addr = mmap(nullptr, _size, PROT_READ, MAP_SHARED, fd.get(), 0);
+    if (addr == MAP_FAILED) {
+        std::ostringstream msg;
+        msg << "Unable to map file \"" << path << "\"";
+        throw std::system_error(errno, std::system_category(), msg.str());
+    }
+    _data = static_cast<uint8_t *>(addr);
+    // Videos are read GOP by GOP at scattered positions, kernel read-around would mostly be wasted.
+    // Needed ranges are announced by `will_need()`.
+    madvise(_data, _size, MADV_RANDOM);
+}
+
+mapped_file::~mapped_file() {
+    if (_data) {
+        munmap(_data, _size);
+    }
+}
+
+void mapped_file::will_need(int64_t offset, int64_t size) const noexcept {
+    static const int64_t page_size = sysconf(_SC_PAGESIZE);
+    auto begin = std::max<int64_t>(offset, 0) / page_size * page_size;
+    auto end = std::min(offset + size, _size);
+    if (end <= begin) {
+        return;
+    }
+    madvise(_data + begin, end - begin, MADV_WILLNEED);
+}
+
+} // namespace videoloader
+} // namespace huww
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace huww {
+namespace videoloader {
+
+/**
+ * A whole file mapped read-only into memory.
+ *
+ * Shared by all videos inside it, e.g. entries of a tar shard. The descriptor is closed right after
+ * mapping.
+ */
+class mapped_file {
+    uint8_t *_data = nullptr;
+    int64_t _size = 0;
+
+  public:
+    explicit mapped_file(const std::string &path);
+    mapped_file(const mapped_file &) = delete;
+    mapped_file &operator=(const mapped_file &) = delete;
+    ~mapped_file();
+
+    const uint8_t *data() const noexcept { return _data; }
+    int64_t size() const noexcept { return _size; }
+
+    /** `madvise(..., MADV_WILLNEED)` on pages covering the range, to start reading them ahead. */
+    void will_need(int64_t offset, int64_t size) const noexcept;
+};
+
+} // namespace videoloader
+} // namespace huww
@@ -0,0 +1,105 @@
+#include "memory_stats.h"
+
+#include <atomic>
+#include <utility>
+
+namespace huww {
+namespace videoloader {
+
+namespace {
+
+struct atomic_video_totals {
+    std::atomic<size_t> count = 0;
+    std::atomic<size_t> index_bytes = 0;
+    std::atomic<size_t> demuxer_bytes = 0;
+    std::atomic<size_t> io_buffer_bytes = 0;
+
+    void add(const video_memory_usage &usage, int sign) noexcept {
+        count.fetch_add(sign, std::memory_order_relaxed);
+        index_bytes.fetch_add(sign * usage.index_bytes, std::memory_order_relaxed);
+        demuxer_bytes.fetch_add(sign * usage.demuxer_bytes, std::memory_order_relaxed);
+        io_buffer_bytes.fetch_add(sign * usage.io_buffer_bytes, std::memory_order_relaxed);
+    }
+
+    video_memory_totals load() const noexcept {
+        return {
+            .count = count.load(std::memory_order_relaxed),
+            .usage =
+                {
+                    .index_bytes = index_bytes.load(std::memory_order_relaxed),
+                    .demuxer_bytes = demuxer_bytes.load(std::memory_order_relaxed),
+                    .io_buffer_bytes = io_buffer_bytes.load(std::memory_order_relaxed),
+                },
+        };
+    }
+};
+
+atomic_video_totals open_videos;
+atomic_video_totals sleeping_videos;
+std::atomic<size_t> allocated_tensor_bytes = 0;
+std::atomic<size_t> dlpack_pool_bytes = 0;
+std::atomic<size_t> loader_preload_bytes = 0;
+
+} // namespace
+
+memory_stats get_memory_stats() noexcept {
+    memory_stats stats;
+    stats.open_videos = open_videos.load();
+    stats.sleeping_videos = sleeping_videos.load();
+    stats.dlpack_pool_bytes = dlpack_pool_bytes.load(std::memory_order_relaxed);
+    auto allocated = allocated_tensor_bytes.load(std::memory_order_relaxed);
+    // Counters are updated separately, avoid underflow.
+    stats.tensor_bytes =
+        allocated > stats.dlpack_pool_bytes ? allocated - stats.dlpack_pool_bytes : 0;
+    stats.loader_preload_bytes = loader_preload_bytes.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void video_memory_account::remove() noexcept {
+    if (accounted) {
+        (sleeping ? sleeping_videos : open_videos).add(usage, -1);
+        accounted = false;
+    }
+}
+
+void video_memory_account::update(const video_memory_usage &usage, bool sleeping) noexcept {
+    remove();
+    this->usage = usage;
+    this->sleeping = sleeping;
+    (sleeping ? sleeping_videos : open_videos).add(usage, 1);
+    accounted = true;
+}
+
+video_memory_account::video_memory_account(video_memory_account &&other) noexcept {
+    *this = std::move(other);
+}
+
+video_memory_account &video_memory_account::operator=(video_memory_account &&other) noexcept {
+    if (this != &other) {
+        remove();
+        usage = other.usage;
+        sleeping = other.sleeping;
+        accounted = other.accounted;
+        other.accounted = false;
+    }
+    return *this;
+}
+
+namespace memory_detail {
+
+void add_allocated_tensor_bytes(std::ptrdiff_t bytes) noexcept {
+    allocated_tensor_bytes.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void add_dlpack_pool_bytes(std::ptrdiff_t bytes) noexcept {
+    dlpack_pool_bytes.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void add_loader_preload_bytes(std::ptrdiff_t bytes) noexcept {
+    loader_preload_bytes.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+} // namespace memory_detail
+
+} // namespace videoloader
+} // namespace huww
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace huww {
+namespace videoloader {
+
+/** Memory held by a `video`. Demuxer bytes are estimated, excluding demuxer private data. */
+struct video_memory_usage {
+    size_t index_bytes = 0;
+    size_t demuxer_bytes = 0;
+    size_t io_buffer_bytes = 0;
+
+    size_t total() const noexcept { return index_bytes + demuxer_bytes + io_buffer_bytes; }
+};
+
+struct video_memory_totals {
+    size_t count = 0;
+    video_memory_usage usage;
+};
+
+/**
+ * Memory held by videoloader in this process.
+ *
+ * Maintained incrementally with atomic counters, so it is cheap to query at any time from any
+ * thread.
+ */
+struct memory_stats {
+    video_memory_totals open_videos;
+    video_memory_totals sleeping_videos;
+    /** Tensors kept in `dlpack_pool` for reuse */
+    size_t dlpack_pool_bytes = 0;
+    /** Tensors handed out and not yet freed or returned to pool */
+    size_t tensor_bytes = 0;
+    /** Predicted bytes of clips loaded ahead by all `video_dataset_loader` */
+    size_t loader_preload_bytes = 0;
+};
+
+memory_stats get_memory_stats() noexcept;
+
+/** Keep the contribution of one video to `memory_stats`. */
+class video_memory_account {
+    video_memory_usage usage;
+    bool sleeping = false;
+    bool accounted = false;
+
+    void remove() noexcept;
+
+  public:
+    video_memory_account() = default;
+    video_memory_account(video_memory_account &&other) noexcept;
+    video_memory_account &operator=(video_memory_account &&other) noexcept;
+    video_memory_account(const video_memory_account &) = delete;
+    video_memory_account &operator=(const video_memory_account &) = delete;
+    ~video_memory_account() { remove(); }
+
+    void update(const video_memory_usage &usage, bool sleeping) noexcept;
+    const video_memory_usage &get() const noexcept { return usage; }
+};
+
+namespace memory_detail {
+/** Bytes of all tensors allocated and not freed */
+void add_allocated_tensor_bytes(std::ptrdiff_t bytes) noexcept;
+void add_dlpack_pool_bytes(std::ptrdiff_t bytes) noexcept;
+void add_loader_preload_bytes(std::ptrdiff_t bytes) noexcept;
+} // namespace memory_detail
+
+} // namespace videoloader
+} // namespace huww
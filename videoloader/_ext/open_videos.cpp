@@ -0,0 +1,55 @@
+#include "open_videos.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+
+#include <pthread.h>
+
+namespace huww {
+namespace videoloader {
+
+std::vector<open_video_result> open_videos(const std::vector<std::string> &paths,
+                                           int max_threads, bool memory_map) {
+    if (max_threads <= 0) {
+        throw std::logic_error("max_threads should be greater than 0");
+    }
+    std::vector<open_video_result> results(paths.size());
+    std::atomic<size_t> next = 0;
+    auto open_next = [&] {
+        while (true) {
+            auto i = next.fetch_add(1, std::memory_order_relaxed);
+            if (i >= paths.size()) {
+                return;
+            }
+            try {
+                file_io::file_spec spec{.path = paths[i]};
+                if (memory_map) {
+                    spec.mapping = std::make_shared<const mapped_file>(paths[i]);
+                }
+                results[i].video.emplace(spec);
+                results[i].video->sleep();
+            } catch (...) {
+                results[i].video.reset();
+                results[i].error = std::current_exception();
+            }
+        }
+    };
+
+    auto num_threads = std::min<size_t>(max_threads, paths.size());
+    std::vector<std::thread> threads;
+    for (size_t t = 1; t < num_threads; t++) {
+        threads.emplace_back(open_next);
+        pthread_setname_np(threads.back().native_handle(), "vl_open");
+    }
+    open_next();
+    for (auto &t : threads) {
+        t.join();
+    }
+    return results;
+}
+
+} // namespace videoloader
+} // namespace huww
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <exception>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "video.h"
+
+namespace huww {
+namespace videoloader {
+
+/** Either the opened video or why it failed. */
+struct open_video_result {
+    std::optional<videoloader::video> video;
+    std::exception_ptr error;
+};
+
+/**
+ * Open many files in parallel. Opened videos are sleeping. A file failing to open does not stop
+ * others, its error is returned in place.
+ *
+ * \param max_threads Max number of threads opening files.
+ * \param memory_map Read each video from a memory mapping of its file.
+ * \return Results in the order of `paths`.
+ */
+std::vector<open_video_result> open_videos(const std::vector<std::string> &paths,
+                                           int max_threads, bool memory_map = false);
+
+} // namespace videoloader
+} // namespace huww
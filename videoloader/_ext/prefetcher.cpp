@@ -0,0 +1,224 @@
+#include "prefetcher.h"
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <stdexcept>
+
+#include <pthread.h>
+#include <spdlog/spdlog.h>
+#include <sys/uio.h>
+
+#if VIDEOLOADER_IO_URING
+#include <liburing.h>
+#endif
+
+#include "fd_cache.h"
+#include "stage_stats.h"
+
+namespace huww {
+namespace videoloader {
+
+/** Ranges are read in chunks of this size. Content is discarded, only the page cache matters. */
+constexpr size_t prefetch_chunk_size = 1 << 20;
+constexpr unsigned io_uring_depth = 64;
+
+prefetcher::prefetcher(int num_threads, size_t max_pending) : max_pending(max_pending) {
+    if (num_threads <= 0) {
+        throw std::logic_error("num_threads should be greater than 0");
+    }
+    if (max_pending == 0) {
+        throw std::logic_error("max_pending should be greater than 0");
+    }
+#if VIDEOLOADER_IO_URING
+    auto ring = std::make_unique<::io_uring>();
+    int ret = io_uring_queue_init(io_uring_depth, ring.get(), 0);
+    if (ret == 0) {
+        _using_io_uring = true;
+        threads.emplace_back([this, ring = std::move(ring)] {
+            this->io_uring_main(ring.get());
+            io_uring_queue_exit(ring.get());
+        });
+        pthread_setname_np(threads.back().native_handle(), "vl_prefetch");
+        return;
+    }
+    SPDLOG_DEBUG("io_uring unavailable ({}), prefetch with {} threads", -ret, num_threads);
+#endif
+    for (int i = 0; i < num_threads; i++) {
+        threads.emplace_back([this] { this->thread_pool_main(); });
+        pthread_setname_np(threads.back().native_handle(), "vl_prefetch");
+    }
+}
+
+prefetcher::~prefetcher() {
+    {
+        std::lock_guard lk(m);
+        stopping = true;
+        pending.clear();
+    }
+    has_work.notify_all();
+    for (auto &t : threads) {
+        t.join();
+    }
+}
+
+void prefetcher::prefetch(std::vector<file_range> ranges) {
+    size_t num_queued = 0;
+    {
+        std::lock_guard lk(m);
+        for (auto &r : ranges) {
+            if (r.size <= 0 || r.mapping) {
+                continue;
+            }
+            if (pending.size() >= max_pending) {
+                _dropped_ranges.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+            pending.push_back(std::move(r));
+            num_queued++;
+        }
+    }
+    if (num_queued > 0) {
+        has_work.notify_all();
+    }
+    for (auto &r : ranges) {
+        if (r.size > 0 && r.mapping) {
+            // Kernel reads mapped pages asynchronously, no need to queue.
+            r.mapping->will_need(r.offset, r.size);
+        }
+    }
+}
+
+std::vector<file_range> prefetcher::take(size_t max_ranges) {
+    std::unique_lock lk(m);
+    has_work.wait(lk, [this] { return stopping || !pending.empty(); });
+    std::vector<file_range> ranges;
+    while (!stopping && !pending.empty() && ranges.size() < max_ranges) {
+        ranges.push_back(std::move(pending.front()));
+        pending.pop_front();
+    }
+    return ranges;
+}
+
+void prefetcher::thread_pool_main() {
+    auto buffer = std::make_unique<uint8_t[]>(prefetch_chunk_size);
+    while (true) {
+        auto ranges = take(1);
+        if (ranges.empty()) {
+            return;
+        }
+        auto &r = ranges.front();
+        VIDEOLOADER_STAGE_TIMER(prefetch);
+        std::shared_ptr<const file_descriptor> fd;
+        try {
+            fd = fd_cache::global().open(r.path);
+        } catch (std::system_error &e) {
+            SPDLOG_DEBUG("Prefetch failed: {}", e.what());
+            continue;
+        }
+        auto end = r.offset + r.size;
+        for (auto offset = r.offset; offset < end;) {
+            auto size = std::min<int64_t>(prefetch_chunk_size, end - offset);
+            auto ret = fd->pread(buffer.get(), size, offset);
+            if (ret <= 0) {
+                break;
+            }
+            offset += ret;
+            _prefetched_bytes.fetch_add(ret, std::memory_order_relaxed);
+        }
+    }
+}
+
+#if VIDEOLOADER_IO_URING
+void prefetcher::io_uring_main(::io_uring *ring) {
+    // All reads go to the same buffer, the content is never used.
+    auto buffer = std::make_unique<uint8_t[]>(prefetch_chunk_size);
+    struct chunk {
+        int fd;
+        int64_t offset;
+        size_t size;
+    };
+    // Kept across rounds, reads may be still in flight when giving up a round.
+    std::vector<chunk> chunks;
+    std::vector<iovec> iovecs;
+    while (true) {
+        auto ranges = take(io_uring_depth);
+        if (ranges.empty()) {
+            return;
+        }
+        VIDEOLOADER_STAGE_TIMER(prefetch);
+
+        // Kernel holds its own reference to files of submitted reads, these can be closed any time.
+        std::map<std::string, std::shared_ptr<const file_descriptor>> fds;
+        chunks.clear();
+        for (auto &r : ranges) {
+            auto it = fds.find(r.path);
+            if (it == fds.end()) {
+                try {
+                    it = fds.emplace(r.path, fd_cache::global().open(r.path)).first;
+                } catch (std::system_error &e) {
+                    SPDLOG_DEBUG("Prefetch failed: {}", e.what());
+                    continue;
+                }
+            }
+            auto end = r.offset + r.size;
+            for (auto offset = r.offset; offset < end; offset += prefetch_chunk_size) {
+                auto size = std::min<int64_t>(prefetch_chunk_size, end - offset);
+                chunks.push_back({
+                    .fd = it->second->get(),
+                    .offset = offset,
+                    .size = static_cast<size_t>(size),
+                });
+            }
+        }
+        iovecs.resize(chunks.size());
+
+        size_t next_chunk = 0;
+        size_t in_flight = 0;
+        bool failed = false;
+        while ((!failed && next_chunk < chunks.size()) || in_flight > 0) {
+            while (!failed && next_chunk < chunks.size()) {
+                auto sqe = io_uring_get_sqe(ring);
+                if (!sqe) {
+                    break; // Submission queue is full.
+                }
+                auto &c = chunks[next_chunk];
+                iovecs[next_chunk] = {.iov_base = buffer.get(), .iov_len = c.size};
+                io_uring_prep_readv(sqe, c.fd, &iovecs[next_chunk], 1, c.offset);
+                next_chunk++;
+                in_flight++;
+            }
+            int ret = io_uring_submit(ring);
+            if (ret < 0 && ret != -EINTR && ret != -EAGAIN && ret != -EBUSY) {
+                SPDLOG_DEBUG("io_uring_submit failed ({})", -ret);
+                failed = true;
+                break; // Nothing we queued is guaranteed to be submitted, stop waiting for them.
+            }
+            io_uring_cqe *cqe;
+            ret = io_uring_wait_cqe(ring, &cqe);
+            if (ret == -EINTR) {
+                continue;
+            }
+            if (ret < 0) {
+                SPDLOG_DEBUG("io_uring_wait_cqe failed ({})", -ret);
+                failed = true;
+                break;
+            }
+            if (cqe->res > 0) {
+                _prefetched_bytes.fetch_add(cqe->res, std::memory_order_relaxed);
+            }
+            io_uring_cqe_seen(ring, cqe);
+            in_flight--;
+        }
+        if (failed) {
+            // The ring is in unknown state, continue with pread in this thread.
+            SPDLOG_WARN("io_uring failed, prefetch with pread instead");
+            this->thread_pool_main();
+            return;
+        }
+    }
+}
+#endif
+
+} // namespace videoloader
+} // namespace huww
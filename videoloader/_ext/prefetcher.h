@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "file_io.h"
+
+struct io_uring;
+
+namespace huww {
+namespace videoloader {
+
+/**
+ * Read byte ranges into page cache ahead of the demuxer, so that `get_batch` does not stall on
+ * synchronous reads.
+ *
+ * Ranges are read with io_uring when available, otherwise by a pool of threads calling `pread`.
+ * Ranges of mapped files are only advised with `madvise`. Prefetching is a hint: ranges are
+ * dropped when too many are pending, and read errors are ignored.
+ */
+class prefetcher {
+    std::mutex m;
+    std::condition_variable has_work;
+    std::deque<file_range> pending;
+    size_t max_pending;
+    bool stopping = false;
+    bool _using_io_uring = false;
+    std::vector<std::thread> threads;
+
+    std::atomic<size_t> _prefetched_bytes = 0;
+    std::atomic<size_t> _dropped_ranges = 0;
+
+    /** Block until some ranges are pending, take up to `max_ranges` of them. */
+    std::vector<file_range> take(size_t max_ranges);
+    void thread_pool_main();
+    void io_uring_main(::io_uring *ring);
+
+  public:
+    /**
+     * \param num_threads Threads used when io_uring is unavailable.
+     * \param max_pending Max number of ranges queued, extra ranges are dropped.
+     */
+    explicit prefetcher(int num_threads = 4, size_t max_pending = 4096);
+    prefetcher(const prefetcher &) = delete;
+    prefetcher &operator=(const prefetcher &) = delete;
+    /** Pending ranges are discarded, in flight reads are waited. */
+    ~prefetcher();
+
+    /** Queue ranges to read, never blocks. Submit ranges of many videos at once to batch them. */
+    void prefetch(std::vector<file_range> ranges);
+
+    bool using_io_uring() const noexcept { return _using_io_uring; }
+    size_t prefetched_bytes() const noexcept {
+        return _prefetched_bytes.load(std::memory_order_relaxed);
+    }
+    size_t dropped_ranges() const noexcept {
+        return _dropped_ranges.load(std::memory_order_relaxed);
+    }
+};
+
+} // namespace videoloader
+} // namespace huww
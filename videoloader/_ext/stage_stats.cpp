@@ -0,0 +1,211 @@
+#include "stage_stats.h"
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+
+#include <pthread.h>
+
+namespace huww {
+namespace videoloader {
+
+const char *stage_name(stage s) noexcept {
+    switch (s) {
+    case stage::wake_up:
+        return "wake_up";
+    case stage::file_read:
+        return "file_read";
+    case stage::seek:
+        return "seek";
+    case stage::demux:
+        return "demux";
+    case stage::decoder_init:
+        return "decoder_init";
+    case stage::decode:
+        return "decode";
+    case stage::filter:
+        return "filter";
+    case stage::copy:
+        return "copy";
+    case stage::get_batch:
+        return "get_batch";
+    case stage::load_task:
+        return "load_task";
+    case stage::worker_pause:
+        return "worker_pause";
+    case stage::batch_wait:
+        return "batch_wait";
+    case stage::prefetch:
+        return "prefetch";
+    default:
+        return "unknown";
+    }
+}
+
+void stage_histogram::merge(const stage_histogram &other) noexcept {
+    count += other.count;
+    total_ns += other.total_ns;
+    max_ns = std::max(max_ns, other.max_ns);
+    for (size_t i = 0; i < num_buckets; i++) {
+        buckets[i] += other.buckets[i];
+    }
+}
+
+static void merge(stage_stats &to, const stage_stats &from) noexcept {
+    for (size_t i = 0; i < num_stages; i++) {
+        to[i].merge(from[i]);
+    }
+}
+
+/** Only written by its owner thread, can be read from any thread. */
+class atomic_stage_histogram {
+    std::atomic<uint64_t> count = 0;
+    std::atomic<uint64_t> total_ns = 0;
+    std::atomic<uint64_t> max_ns = 0;
+    std::array<std::atomic<uint64_t>, stage_histogram::num_buckets> buckets{};
+
+  public:
+    void add(uint64_t ns) noexcept {
+        count.fetch_add(1, std::memory_order_relaxed);
+        total_ns.fetch_add(ns, std::memory_order_relaxed);
+        if (ns > max_ns.load(std::memory_order_relaxed)) {
+            max_ns.store(ns, std::memory_order_relaxed);
+        }
+        size_t bucket = ns == 0 ? 0 : 63 - __builtin_clzll(ns);
+        bucket = std::min(bucket, stage_histogram::num_buckets - 1);
+        buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    stage_histogram load() const noexcept {
+        stage_histogram h;
+        h.count = count.load(std::memory_order_relaxed);
+        h.total_ns = total_ns.load(std::memory_order_relaxed);
+        h.max_ns = max_ns.load(std::memory_order_relaxed);
+        for (size_t i = 0; i < h.buckets.size(); i++) {
+            h.buckets[i] = buckets[i].load(std::memory_order_relaxed);
+        }
+        return h;
+    }
+
+    void reset() noexcept {
+        count.store(0, std::memory_order_relaxed);
+        total_ns.store(0, std::memory_order_relaxed);
+        max_ns.store(0, std::memory_order_relaxed);
+        for (auto &b : buckets) {
+            b.store(0, std::memory_order_relaxed);
+        }
+    }
+};
+
+struct thread_stage_counters {
+    pthread_t thread = pthread_self();
+    std::array<atomic_stage_histogram, num_stages> stages;
+
+    stage_stats load() const noexcept {
+        stage_stats stats;
+        for (size_t i = 0; i < num_stages; i++) {
+            stats[i] = stages[i].load();
+        }
+        return stats;
+    }
+};
+
+class stage_stats_registry {
+    std::mutex m;
+    std::vector<thread_stage_counters *> threads;
+    stage_stats exited;
+
+  public:
+    thread_stage_counters *add() {
+        auto counters = new thread_stage_counters();
+        std::lock_guard lk(m);
+        threads.push_back(counters);
+        return counters;
+    }
+
+    void remove(thread_stage_counters *counters) {
+        {
+            std::lock_guard lk(m);
+            merge(exited, counters->load());
+            threads.erase(std::find(threads.begin(), threads.end(), counters));
+        }
+        delete counters;
+    }
+
+    std::vector<thread_stage_stats> snapshot() {
+        std::vector<thread_stage_stats> result;
+        std::lock_guard lk(m);
+        result.reserve(threads.size() + 1);
+        for (auto t : threads) {
+            // Registered threads are still alive, it is safe to query its name.
+            char name[16] = {};
+            pthread_getname_np(t->thread, name, sizeof(name));
+            result.push_back({name, t->load()});
+        }
+        result.push_back({"", exited});
+        return result;
+    }
+
+    void reset() {
+        std::lock_guard lk(m);
+        for (auto t : threads) {
+            for (auto &h : t->stages) {
+                h.reset();
+            }
+        }
+        exited = {};
+    }
+};
+
+static stage_stats_registry &registry() {
+    // Never destroyed, thread local counters may outlive static objects.
+    static auto r = new stage_stats_registry();
+    return *r;
+}
+
+std::vector<thread_stage_stats> per_thread_stage_stats() { return registry().snapshot(); }
+
+stage_stats total_stage_stats() {
+    stage_stats total;
+    for (auto &t : per_thread_stage_stats()) {
+        merge(total, t.stats);
+    }
+    return total;
+}
+
+void reset_stage_stats() { registry().reset(); }
+
+#if VIDEOLOADER_STAGE_STATS
+
+class local_stage_counters {
+    thread_stage_counters *counters = nullptr;
+
+  public:
+    ~local_stage_counters() {
+        if (counters) {
+            registry().remove(counters);
+        }
+    }
+    thread_stage_counters &get() {
+        if (!counters) {
+            counters = registry().add();
+        }
+        return *counters;
+    }
+};
+
+static thread_local local_stage_counters local_counters;
+
+void record_stage(stage s, std::chrono::steady_clock::duration duration) noexcept {
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+    try {
+        local_counters.get().stages[static_cast<size_t>(s)].add(ns < 0 ? 0 : ns);
+    } catch (std::bad_alloc &) {
+        // Statistics are best effort.
+    }
+}
+
+#endif
+
+} // namespace videoloader
+} // namespace huww
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "trace.h"
+
+#ifndef VIDEOLOADER_STAGE_STATS
+#define VIDEOLOADER_STAGE_STATS 1
+#endif
+
+namespace huww {
+namespace videoloader {
+
+/**
+ * Stages of loading that are timed.
+ *
+ * Stages nest: e.g. `file_read` is usually part of `demux` or `seek`, which are part of
+ * `get_batch`. So durations of different stages should not be summed up.
+ */
+enum class stage : uint8_t {
+    wake_up,      /**< Reopen file and IO buffer of a sleeping video */
+    file_read,    /**< Read from file into IO buffer */
+    seek,         /**< Seek to key frame */
+    demux,        /**< Read a packet from container */
+    decoder_init, /**< Open decoder and build filter graph */
+    decode,       /**< Send packet to and receive frame from decoder */
+    filter,       /**< Convert frame to RGB */
+    copy,         /**< Copy RGB frame to output tensor */
+    get_batch,    /**< Whole `video::get_batch` or `video::get_batches` */
+    load_task,    /**< Load a clip by `video_dataset_loader` worker */
+    worker_pause, /**< `video_dataset_loader` worker paused by scheduler */
+    batch_wait,   /**< `video_dataset_loader::get_next_batch` waiting for batch */
+    prefetch,     /**< Read scheduled byte ranges ahead by `prefetcher` */
+    count,
+};
+constexpr size_t num_stages = static_cast<size_t>(stage::count);
+
+const char *stage_name(stage s) noexcept;
+
+/** Duration histogram. Bucket `i` counts durations in [2^i, 2^(i+1)) nanoseconds. */
+struct stage_histogram {
+    static constexpr size_t num_buckets = 40;
+
+    uint64_t count = 0;
+    uint64_t total_ns = 0;
+    uint64_t max_ns = 0;
+    std::array<uint64_t, num_buckets> buckets{};
+
+    void merge(const stage_histogram &other) noexcept;
+};
+
+using stage_stats = std::array<stage_histogram, num_stages>;
+
+struct thread_stage_stats {
+    std::string thread_name; /**< Empty for the sum of exited threads */
+    stage_stats stats;
+};
+
+/**
+ * Statistics of every thread that have recorded any stage, including the sum of exited threads.
+ *
+ * Thread safe. Counters are read without stopping the recording threads, so the snapshot is not
+ * necessarily consistent across stages.
+ */
+std::vector<thread_stage_stats> per_thread_stage_stats();
+
+/** Statistics summed over all threads. */
+stage_stats total_stage_stats();
+
+void reset_stage_stats();
+
+/** Whether stage timing is compiled in. If not, all statistics are zero. */
+constexpr bool stage_stats_enabled() noexcept { return VIDEOLOADER_STAGE_STATS; }
+
+#if VIDEOLOADER_STAGE_STATS
+/** Record to statistics of the calling thread. */
+void record_stage(stage s, std::chrono::steady_clock::duration duration) noexcept;
+#endif
+
+/**
+ * Time from construction to destruction or `stop()`, and record it as a trace slice if tracing.
+ * Does nothing if compiled out.
+ */
+class stage_timer {
+#if VIDEOLOADER_STAGE_STATS
+    stage s;
+    bool running = true;
+    bool traced;
+    std::chrono::steady_clock::time_point start;
+
+  public:
+    explicit stage_timer(stage s) noexcept
+        : s(s), traced(trace_enabled()), start(std::chrono::steady_clock::now()) {
+        if (traced) {
+            trace_begin(stage_name(s));
+        }
+    }
+    void stop() noexcept {
+        if (running) {
+            running = false;
+            record_stage(s, std::chrono::steady_clock::now() - start);
+            if (traced) {
+                trace_end(stage_name(s));
+            }
+        }
+    }
+#else
+  public:
+    explicit stage_timer(stage) noexcept {}
+    void stop() noexcept {}
+#endif
+    stage_timer(const stage_timer &) = delete;
+    stage_timer &operator=(const stage_timer &) = delete;
+    ~stage_timer() noexcept { stop(); }
+};
+
+#define VIDEOLOADER_STAGE_TIMER_NAME_(line) _stage_timer_##line
+#define VIDEOLOADER_STAGE_TIMER_NAME(line) VIDEOLOADER_STAGE_TIMER_NAME_(line)
+/** Time from here to the end of current scope */
+#define VIDEOLOADER_STAGE_TIMER(s)                                                                 \
+    ::huww::videoloader::stage_timer VIDEOLOADER_STAGE_TIMER_NAME(__LINE__)(                       \
+        ::huww::videoloader::stage::s)
+
+} // namespace videoloader
+} // namespace huww
@@ -0,0 +1,62 @@
+#include "tar_entry_filter.h"
+
+#include <algorithm>
+#include <cctype>
+
+#include <fnmatch.h>
+
+namespace huww {
+
+static std::string normalize_extension(std::string ext) {
+    if (!ext.empty() && ext.front() == '.') {
+        ext.erase(0, 1);
+    }
+    std::transform(ext.begin(), ext.end(), ext.begin(),
+                   [](unsigned char c) { return std::tolower(c); });
+    return ext;
+}
+
+void tar_entry_filter::set_extensions(const std::vector<std::string> &extensions) {
+    this->extensions.clear();
+    for (auto &ext : extensions) {
+        this->extensions.push_back(normalize_extension(ext));
+    }
+}
+
+void tar_entry_filter::set_regex(const std::string &pattern) {
+    regex.emplace(pattern, std::regex::ECMAScript | std::regex::optimize);
+}
+
+bool tar_entry_filter::empty() const noexcept {
+    return extensions.empty() && globs.empty() && !regex && min_size <= 0 && max_size < 0;
+}
+
+bool tar_entry_filter::operator()(const tar_entry &entry) const {
+    auto size = entry.file_size();
+    if (size < min_size || (max_size >= 0 && size > max_size)) {
+        return false;
+    }
+    auto path = entry.path();
+    if (!extensions.empty()) {
+        auto dot = path.rfind('.');
+        auto slash = path.rfind('/');
+        if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+            return false;
+        }
+        auto ext = normalize_extension(path.substr(dot));
+        if (std::find(extensions.begin(), extensions.end(), ext) == extensions.end()) {
+            return false;
+        }
+    }
+    if (!globs.empty() && std::none_of(globs.begin(), globs.end(), [&path](auto &glob) {
+            return fnmatch(glob.c_str(), path.c_str(), 0) == 0;
+        })) {
+        return false;
+    }
+    if (regex && !std::regex_search(path, *regex)) {
+        return false;
+    }
+    return true;
+}
+
+} // namespace huww
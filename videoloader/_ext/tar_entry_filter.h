@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <regex>
+#include <string>
+#include <vector>
+
+#include "tar_iterator.h"
+
+namespace huww {
+
+/**
+ * Select tar entries by path and size, without calling back into the caller. An entry is selected
+ * if it passes all conditions that are set.
+ */
+struct tar_entry_filter {
+    /** Case-insensitive file extensions, with or without the leading dot. Any one matches. */
+    std::vector<std::string> extensions;
+    /** `fnmatch` patterns of the whole path. `*` also matches '/'. Any one matches. */
+    std::vector<std::string> globs;
+    /** Searched anywhere in the path, ECMAScript syntax. */
+    std::optional<std::regex> regex;
+    std::streamsize min_size = 0;
+    /** -1 for unlimited */
+    std::streamsize max_size = -1;
+
+    void set_extensions(const std::vector<std::string> &extensions);
+    void set_regex(const std::string &pattern);
+    /** Whether no condition is set, i.e. all entries are selected. */
+    bool empty() const noexcept;
+
+    bool operator()(const tar_entry &entry) const;
+};
+
+} // namespace huww
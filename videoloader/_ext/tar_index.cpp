@@ -0,0 +1,136 @@
+#include "tar_index.h"
+
+#include <array>
+#include <system_error>
+
+#include <spdlog/spdlog.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace huww {
+namespace videoloader {
+
+/** Frame index file of a tar, see `frame_index_file.h`. */
+constexpr std::array<char, 8> tar_index_magic = {'V', 'L', 'T', 'A', 'R', 'I', 'D', 'X'};
+constexpr uint32_t tar_index_version = 2;
+
+struct tar_stat {
+    int64_t size;
+    int64_t mtime_ns;
+};
+
+static tar_stat stat_tar(const std::string &tar_path) {
+    struct stat st;
+    if (::stat(tar_path.c_str(), &st) != 0) {
+        throw std::system_error(errno, std::system_category(),
+                                "Unable to stat \"" + tar_path + "\"");
+    }
+    return {
+        .size = st.st_size,
+        .mtime_ns = st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec,
+    };
+}
+
+std::string tar_index::sidecar_path(const std::string &tar_path) { return tar_path + ".vlidx"; }
+
+std::optional<tar_index> tar_index::open(const std::string &tar_path) {
+    auto path = sidecar_path(tar_path);
+    if (access(path.c_str(), F_OK) != 0) {
+        return std::nullopt;
+    }
+    auto tar = stat_tar(tar_path);
+    tar_index index;
+    try {
+        index.mapping = std::make_shared<const mapped_file>(path);
+        index.file = frame_index_file(index.mapping->data(), index.mapping->size(),
+                                      tar_index_magic, tar_index_version);
+    } catch (std::exception &e) {
+        SPDLOG_WARN("Ignore tar index \"{}\": {}", path, e.what());
+        return std::nullopt;
+    }
+    auto &h = index.file.header();
+    if (h.source_size != tar.size || h.source_mtime_ns != tar.mtime_ns) {
+        SPDLOG_DEBUG("Tar index \"{}\" is outdated", path);
+        return std::nullopt;
+    }
+    return index;
+}
+
+tar_entry tar_index::entry(size_t i) const {
+    if (i >= size()) {
+        throw std::out_of_range("tar index entry out of range");
+    }
+    auto &r = file.record(i);
+    return tar_entry(file.path(i), r.start_pos, r.file_size);
+}
+
+bool tar_index::has_frame_index(size_t i) const noexcept {
+    return i < size() && file.record(i).stream_index >= 0;
+}
+
+video tar_index::open_video(size_t i, const file_io::file_spec &tar_spec) const {
+    if (!has_frame_index(i)) {
+        throw std::logic_error("tar index entry has no frame index");
+    }
+    auto &r = file.record(i);
+    auto spec = tar_spec;
+    spec.start_pos = r.start_pos;
+    spec.file_size = r.file_size;
+    return video(spec, r.stream_index, file.frame_index(i, mapping));
+}
+
+tar_index_writer::tar_index_writer(const tar_index &index) {
+    entries.reserve(index.size());
+    for (size_t i = 0; i < index.size(); i++) {
+        auto &r = index.file.record(i);
+        entries.push_back({
+            .path = index.file.path(i),
+            .start_pos = r.start_pos,
+            .file_size = r.file_size,
+            .stream_index = r.stream_index,
+            .frame_index = index.file.frame_index(i, index.mapping),
+        });
+    }
+}
+
+size_t tar_index_writer::add_entry(const tar_entry &entry) {
+    entries.push_back({
+        .path = entry.path(),
+        .start_pos = entry.content_start_position(),
+        .file_size = entry.file_size(),
+    });
+    return entries.size() - 1;
+}
+
+void tar_index_writer::set_frame_index(size_t i, const video &v) {
+    auto &e = entries.at(i);
+    e.stream_index = v.video_stream_index();
+    e.frame_index = v.frame_index();
+}
+
+bool tar_index_writer::write(const std::string &tar_path) const {
+    auto path = tar_index::sidecar_path(tar_path);
+    try {
+        auto tar = stat_tar(tar_path);
+        frame_index_file_builder builder(tar_index_magic, tar_index_version, tar.size,
+                                         tar.mtime_ns);
+        for (auto &e : entries) {
+            frame_index_file_record record{
+                .stream_index = e.stream_index,
+                .start_pos = e.start_pos,
+                .file_size = e.file_size,
+            };
+            builder.add(record, e.path, e.frame_index);
+        }
+        // Readers still map the replaced index safely.
+        write_file_atomically(path, builder.build());
+    } catch (std::exception &e) {
+        SPDLOG_WARN("Failed to write tar index \"{}\": {}", path, e.what());
+        return false;
+    }
+    SPDLOG_DEBUG("Wrote tar index \"{}\" with {} entries", path, entries.size());
+    return true;
+}
+
+} // namespace videoloader
+} // namespace huww
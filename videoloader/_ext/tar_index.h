@@ -0,0 +1,80 @@
+#pragma once
+
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "frame_index_file.h"
+#include "mapped_file.h"
+#include "tar_iterator.h"
+#include "video.h"
+
+namespace huww {
+namespace videoloader {
+
+/**
+ * Sidecar index of a tar, `<tar path>.vlidx`, so that reopening a shard neither scans its headers
+ * nor demuxes its videos.
+ *
+ * It lists path, content position and size of every file entry, and the frame index of entries
+ * opened as videos. The index is memory mapped, and is ignored if the size or modification time of
+ * the tar has changed since it was written.
+ */
+class tar_index {
+    friend class tar_index_writer;
+
+    std::shared_ptr<const mapped_file> mapping;
+    frame_index_file file;
+
+    tar_index() = default;
+
+  public:
+    static std::string sidecar_path(const std::string &tar_path);
+
+    /** Map the sidecar index of the tar. Empty if it is missing, invalid or outdated. */
+    static std::optional<tar_index> open(const std::string &tar_path);
+
+    size_t size() const noexcept { return file.size(); }
+    /** The i-th file entry of the tar, in tar order. */
+    tar_entry entry(size_t i) const;
+    bool has_frame_index(size_t i) const noexcept;
+    /**
+     * Open the i-th entry without demuxing it.
+     *
+     * \param tar_spec Spec of the whole tar, position and size are replaced by those of the entry.
+     */
+    video open_video(size_t i, const file_io::file_spec &tar_spec) const;
+};
+
+/** Build a sidecar index while scanning a tar, or update one with new frame indices. */
+class tar_index_writer {
+    struct entry {
+        std::string path;
+        int64_t start_pos;
+        int64_t file_size;
+        int stream_index = -1;
+        shared_frame_index frame_index;
+    };
+    std::vector<entry> entries;
+
+  public:
+    tar_index_writer() = default;
+    /** Start with all entries and frame indices of an existing index. */
+    explicit tar_index_writer(const tar_index &index);
+
+    /** Append a file entry, return its position to be used by `set_frame_index()`. */
+    size_t add_entry(const tar_entry &entry);
+    void set_frame_index(size_t i, const video &v);
+
+    /**
+     * Atomically replace the sidecar index of the tar. Failures are logged and ignored, e.g. the
+     * directory of the tar may be read-only.
+     *
+     * \return Whether the index is written.
+     */
+    bool write(const std::string &tar_path) const;
+};
+
+} // namespace videoloader
+} // namespace huww
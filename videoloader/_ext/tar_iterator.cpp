@@ -204,12 +204,18 @@ std::istream &tar_entry::begin_read_content() const {
     if (this->type() != tar_entry_type::file) {
         throw std::logic_error("Can only read content of file entry.");
     }
-    return _tar_file.stream().seekg(this->content_start_position());
+    if (!_tar_file) {
+        throw std::logic_error("Can not read content of an entry not from tar_iterator.");
+    }
+    return _tar_file->stream().seekg(this->content_start_position());
 }
 
 void tar_entry::will_need_content() const {
     if constexpr (use_stdio_filebuf) {
-        posix_fadvise(this->_tar_file.fd(), this->content_start_position(), this->file_size(),
+        if (!this->_tar_file) {
+            return;
+        }
+        posix_fadvise(this->_tar_file->fd(), this->content_start_position(), this->file_size(),
                       POSIX_FADV_WILLNEED);
     }
 }
@@ -228,7 +234,10 @@ tar_iterator::tar_iterator(std::string tar_path) {
 
 tar_iterator::tar_iterator(std::string tar_path, tar_options options) : tar_iterator(tar_path) {
     if constexpr (use_stdio_filebuf) {
-        if ((options & tar_options::advise_sequential) != tar_options::none) {
+        if ((options & tar_options::direct_io) != tar_options::none) {
+            // Only headers are read through page cache, readahead would pull content in.
+            posix_fadvise(this->_tar_file->fd(), 0, 0, POSIX_FADV_RANDOM);
+        } else if ((options & tar_options::advise_sequential) != tar_options::none) {
             posix_fadvise(this->_tar_file->fd(), 0, 0, POSIX_FADV_SEQUENTIAL);
         }
     }
@@ -24,7 +24,7 @@ enum class tar_entry_type : uint8_t {
 };
 
 class tar_entry {
-    tar_file &_tar_file;
+    tar_file *_tar_file;
 
     std::string _path;
     std::streamsize _file_size;
@@ -34,9 +34,17 @@ class tar_entry {
     friend class tar_iterator;
     friend class tar_file;
 
-    tar_entry(tar_file &file) : _tar_file(file), _path() {}
+    tar_entry(tar_file &file) : _tar_file(&file), _path() {}
 
   public:
+    /**
+     * A file entry known from elsewhere, e.g. a sidecar index, instead of a `tar_iterator`. Its
+     * content can not be read with `begin_read_content()`.
+     */
+    tar_entry(std::string path, std::streampos start_pos, std::streamsize file_size)
+        : _tar_file(nullptr), _path(std::move(path)), _file_size(file_size), _start_pos(start_pos),
+          _type(tar_entry_type::file) {}
+
     auto path() const { return _path; }
     auto content_start_position() const { return _start_pos; }
     auto file_size() const { return _file_size; }
@@ -72,6 +80,18 @@ class tar_entry {
 enum class tar_options : uint8_t {
     none = 0,
     advise_sequential = 1,
+    /** Used by `open_video_tar`, read videos from a memory mapping of the whole tar. */
+    memory_map = 2,
+    /**
+     * Used by `open_video_tar`, open from the sidecar index of the tar if it is up to date,
+     * otherwise write one. See `videoloader::tar_index`.
+     */
+    sidecar_index = 4,
+    /**
+     * Used by `open_video_tar`, read content of entries with O_DIRECT instead of through page cache.
+     * Headers are read without readahead. Overrides `advise_sequential`.
+     */
+    direct_io = 8,
 };
 
 constexpr tar_options operator&(tar_options x, tar_options y) noexcept {
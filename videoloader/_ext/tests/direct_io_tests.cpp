@@ -0,0 +1,66 @@
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+#include "direct_io.h"
+
+namespace vl = huww::videoloader;
+
+TEST(AlignedBufferPool, Aligned) {
+    auto pool = std::make_shared<vl::aligned_buffer_pool>(1 << 20);
+    auto buffer = pool->acquire(100);
+    EXPECT_EQ(0, reinterpret_cast<uintptr_t>(buffer->data()) % vl::direct_io_alignment);
+    EXPECT_EQ(vl::direct_io_alignment, buffer->size());
+    EXPECT_EQ(vl::direct_io_alignment, pool->used());
+    buffer.reset();
+    EXPECT_EQ(0, pool->used());
+}
+
+TEST(AlignedBufferPool, Reuse) {
+    auto pool = std::make_shared<vl::aligned_buffer_pool>(1 << 20);
+    auto data = pool->acquire(8192)->data();
+    EXPECT_EQ(data, pool->acquire(4096)->data());
+}
+
+TEST(AlignedBufferPool, BlockWhenFull) {
+    auto pool = std::make_shared<vl::aligned_buffer_pool>(8192);
+    auto first = pool->acquire(8192);
+    std::atomic<bool> acquired = false;
+    std::thread t([&] {
+        pool->acquire(4096);
+        acquired = true;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    EXPECT_FALSE(acquired);
+    first.reset();
+    t.join();
+    EXPECT_TRUE(acquired);
+}
+
+TEST(AlignedBufferPool, Oversize) {
+    auto pool = std::make_shared<vl::aligned_buffer_pool>(4096);
+    EXPECT_EQ(16384, pool->acquire(16384)->size());
+}
+
+TEST(DirectIO, ReadUnaligned) {
+    std::ifstream f("./tests/test_video.mp4", std::ios::binary);
+    std::vector<char> expected((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+    auto pool = std::make_shared<vl::aligned_buffer_pool>(1 << 20);
+    auto fd = vl::open_direct("./tests/test_video.mp4");
+
+    auto range = vl::read_direct(*fd, 1000, 10000, *pool);
+    EXPECT_EQ(1000, range.offset);
+    ASSERT_EQ(10000, range.size);
+    EXPECT_EQ(0, memcmp(range.data, expected.data() + 1000, range.size));
+
+    // Truncated at EOF
+    int64_t size = expected.size();
+    auto tail = vl::read_direct(*fd, size - 100, 1000, *pool);
+    ASSERT_EQ(100, tail.size);
+    EXPECT_EQ(0, memcmp(tail.data, expected.data() + size - 100, tail.size));
+}
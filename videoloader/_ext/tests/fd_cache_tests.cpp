@@ -0,0 +1,47 @@
+#include <gtest/gtest.h>
+
+#include "fd_cache.h"
+
+namespace vl = huww::videoloader;
+
+TEST(FdCache, SharedByPath) {
+    vl::fd_cache cache(2);
+    auto a = cache.open("./tests/test_video.mp4");
+    auto b = cache.open("./tests/test_video.mp4");
+    EXPECT_EQ(a, b);
+    EXPECT_EQ(1, cache.hits());
+    EXPECT_EQ(1, cache.misses());
+}
+
+TEST(FdCache, SharedByPathAndDirect) {
+    vl::fd_cache cache(2);
+    auto direct = cache.open("./tests/test_video.mp4", true);
+    EXPECT_EQ(direct, cache.open("./tests/test_video.mp4", true));
+    EXPECT_NE(direct, cache.open("./tests/test_video.mp4"));
+    EXPECT_EQ(2, cache.size());
+}
+
+TEST(FdCache, EvictLeastRecentlyUsed) {
+    vl::fd_cache cache(2);
+    auto video = cache.open("./tests/test_video.mp4");
+    cache.open("./tests/tar/test_videos.tar");
+    cache.open("./tests/test_video.mp4");
+    cache.open("./README.md"); // evicts the tar
+    EXPECT_EQ(2, cache.size());
+    EXPECT_EQ(video, cache.open("./tests/test_video.mp4"));
+    auto misses = cache.misses();
+    cache.open("./tests/tar/test_videos.tar");
+    EXPECT_EQ(misses + 1, cache.misses());
+}
+
+TEST(FdCache, Disabled) {
+    vl::fd_cache cache(0);
+    auto a = cache.open("./tests/test_video.mp4");
+    EXPECT_NE(a, cache.open("./tests/test_video.mp4"));
+    EXPECT_EQ(0, cache.size());
+}
+
+TEST(FdCache, NotExistFile) {
+    vl::fd_cache cache;
+    EXPECT_THROW(cache.open("/some-non-exist-file"), std::system_error);
+}
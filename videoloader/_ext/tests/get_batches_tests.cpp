@@ -0,0 +1,119 @@
+#include <atomic>
+#include <deque>
+
+#include <gtest/gtest.h>
+
+#include "get_batches.h"
+#include "thread_pool.h"
+
+namespace vl = huww::videoloader;
+
+TEST(ThreadPool, Submit) {
+    vl::thread_pool pool(2, "test_pool");
+    std::atomic<int> sum = 0;
+    std::vector<std::future<int>> results;
+    for (int i = 0; i < 100; i++) {
+        results.push_back(pool.submit([&sum, i] {
+            sum += i;
+            return i * 2;
+        }));
+    }
+    for (int i = 0; i < 100; i++) {
+        EXPECT_EQ(i * 2, results[i].get());
+    }
+    EXPECT_EQ(4950, sum);
+    pool.reserve(4);
+    EXPECT_EQ(4, pool.size());
+    pool.reserve(1);
+    EXPECT_EQ(4, pool.size());
+}
+
+TEST(ThreadPool, Exception) {
+    vl::thread_pool pool(1, "test_pool");
+    auto result = pool.submit([]() -> int { throw std::runtime_error("test"); });
+    EXPECT_THROW(result.get(), std::runtime_error);
+}
+
+TEST(GetBatches, Parallel) {
+    std::deque<vl::video> videos;
+    std::vector<vl::batch_request> requests;
+    for (int i = 0; i < 4; i++) {
+        auto &v = videos.emplace_back("./tests/test_video.mp4");
+        requests.push_back({.video = v, .frame_indices = {size_t(i), 10, 5}});
+        // Same video requested twice.
+        requests.push_back({.video = v, .frame_indices = {0}});
+    }
+    auto results = vl::get_batches(requests, 3);
+    ASSERT_EQ(requests.size(), results.size());
+    for (size_t i = 0; i < results.size(); i++) {
+        EXPECT_FALSE(results[i].error);
+        ASSERT_TRUE(results[i].batch);
+        EXPECT_EQ(requests[i].frame_indices.size(), results[i].batch->dl_tensor.shape[0]);
+    }
+}
+
+TEST(GetBatches, PerRequestError) {
+    vl::video v("./tests/test_video.mp4");
+    auto results = vl::get_batches({{v, {0}}, {v, {100000}}, {v, {1, 2}}}, 2);
+    ASSERT_EQ(3, results.size());
+    EXPECT_TRUE(results[0].batch);
+    EXPECT_TRUE(results[2].batch);
+    EXPECT_FALSE(results[1].batch);
+    EXPECT_THROW(std::rethrow_exception(results[1].error), std::out_of_range);
+}
+
+TEST(GetBatches, Threads0Throws) {
+    EXPECT_THROW(vl::get_batches({}, 0), std::logic_error);
+}
+
+TEST(AsyncBatchDecoder, Submit) {
+    vl::video a("./tests/test_video.mp4");
+    vl::video b("./tests/test_video.mp4");
+    vl::async_batch_decoder decoder(2);
+    std::vector<vl::async_batch> batches;
+    for (size_t i = 0; i < 4; i++) {
+        batches.push_back(decoder.submit(a, {i, i + 1}));
+        batches.push_back(decoder.submit(b, {i}, {}, true));
+    }
+    auto failed = decoder.submit(a, {100000});
+    for (size_t i = 0; i < batches.size(); i++) {
+        auto batch = batches[i].future().get();
+        EXPECT_EQ(i % 2 ? 1 : 2, batch->dl_tensor.shape[0]);
+        EXPECT_FALSE(batches[i].cancel());
+    }
+    EXPECT_THROW(failed.future().get(), std::out_of_range);
+    EXPECT_TRUE(b.is_sleeping());
+    EXPECT_FALSE(a.is_sleeping());
+}
+
+TEST(AsyncBatchDecoder, Cancel) {
+    vl::video v("./tests/test_video.mp4");
+    vl::thread_pool pool(1, "test_pool");
+    vl::async_batch_decoder decoder(1, pool);
+    std::promise<void> unblock;
+    pool.submit([f = unblock.get_future().share()] { f.wait(); });
+
+    auto cancelled = decoder.submit(v, {0});
+    bool done_called = false;
+    vl::async_batch_callbacks refuse{
+        .on_start = [] { return false; },
+        .on_done = [&done_called](vl::batch_result &&) { done_called = true; },
+    };
+    decoder.submit(v, {0}, std::move(refuse));
+    std::promise<vl::batch_result> on_done_result;
+    vl::async_batch_callbacks callbacks{
+        .on_done = [&on_done_result](vl::batch_result &&r) {
+            on_done_result.set_value(std::move(r));
+        },
+    };
+    decoder.submit(v, {1, 2}, std::move(callbacks));
+    EXPECT_TRUE(cancelled.cancel());
+    EXPECT_FALSE(cancelled.cancel());
+    EXPECT_THROW(cancelled.future().get(), vl::batch_cancelled);
+
+    unblock.set_value();
+    auto result = on_done_result.get_future().get();
+    ASSERT_TRUE(result.batch);
+    EXPECT_EQ(2, result.batch->dl_tensor.shape[0]);
+    EXPECT_FALSE(done_called);
+}
@@ -0,0 +1,95 @@
+#include <algorithm>
+#include <set>
+
+#include <gtest/gtest.h>
+
+#include "locality_shuffle.h"
+#include "video_tar.h"
+
+namespace vl = huww::videoloader;
+
+/** Clips of `num_videos` videos of a tar, `clips_per_video` each, listed in reverse file order. */
+static std::vector<vl::clip_location> make_locations(size_t num_videos, size_t clips_per_video) {
+    std::vector<vl::clip_location> locations;
+    for (size_t v = num_videos; v-- > 0;) {
+        for (size_t c = clips_per_video; c-- > 0;) {
+            locations.push_back({
+                .path = "a.tar",
+                .offset = int64_t(v) * 1000000,
+                .first_frame = c * 16,
+            });
+        }
+    }
+    return locations;
+}
+
+static std::vector<size_t> file_ranks(const std::vector<vl::clip_location> &locations,
+                                      const std::vector<size_t> &order) {
+    // Locations are in reverse file order.
+    std::vector<size_t> ranks;
+    for (auto i : order) {
+        ranks.push_back(locations.size() - 1 - i);
+    }
+    return ranks;
+}
+
+TEST(LocalityShuffle, Permutation) {
+    auto locations = make_locations(50, 3);
+    auto order = vl::locality_shuffle_order(locations, {.block_size = 4, .window_size = 5});
+    ASSERT_EQ(locations.size(), order.size());
+    EXPECT_EQ(locations.size(), std::set<size_t>(order.begin(), order.end()).size());
+}
+
+TEST(LocalityShuffle, Sequential) {
+    auto locations = make_locations(10, 2);
+    auto order = vl::locality_shuffle_order(locations, {.window_size = 1, .shuffle_windows = false});
+    auto ranks = file_ranks(locations, order);
+    EXPECT_TRUE(std::is_sorted(ranks.begin(), ranks.end()));
+}
+
+TEST(LocalityShuffle, Windows) {
+    auto locations = make_locations(100, 2);
+    vl::locality_shuffle_options options{.block_size = 2, .window_size = 5, .seed = 7};
+    auto ranks = file_ranks(locations, vl::locality_shuffle_order(locations, options));
+    auto window_clips = options.block_size * options.window_size;
+    for (size_t w = 0; w < ranks.size() / window_clips; w++) {
+        // Each window covers a contiguous range of clips, read in blocks.
+        auto begin = ranks.begin() + w * window_clips;
+        auto first = *std::min_element(begin, begin + window_clips);
+        EXPECT_EQ(0, first % window_clips);
+        EXPECT_EQ(first + window_clips - 1, *std::max_element(begin, begin + window_clips));
+        for (size_t b = 0; b < window_clips; b += options.block_size) {
+            EXPECT_EQ(begin[b] + 1, begin[b + 1]);
+        }
+    }
+    EXPECT_FALSE(std::is_sorted(ranks.begin(), ranks.end()));
+}
+
+TEST(LocalityShuffle, Reproducible) {
+    auto locations = make_locations(100, 1);
+    auto a = vl::locality_shuffle_order(locations, {.window_size = 0, .seed = 1});
+    EXPECT_EQ(a, vl::locality_shuffle_order(locations, {.window_size = 0, .seed = 1}));
+    EXPECT_NE(a, vl::locality_shuffle_order(locations, {.window_size = 0, .seed = 2}));
+}
+
+TEST(LocalityShuffle, InvalidOptions) {
+    EXPECT_THROW(vl::locality_shuffle_order({}, {.block_size = 0}), std::logic_error);
+    EXPECT_THROW(vl::locality_shuffle({}, 0, {}), std::logic_error);
+}
+
+TEST(LocalityShuffle, TarSchedule) {
+    auto videos = vl::open_video_tar("./tests/tar/test_videos.tar");
+    std::vector<vl::dataset_load_schedule_detail::video> clips;
+    for (auto &v : videos) {
+        clips.push_back({.video = v, .frame_indices = {0, 1}});
+    }
+    auto schedule =
+        vl::locality_shuffle(clips, 2, {.window_size = 1, .shuffle_windows = false});
+    ASSERT_EQ(2, schedule.size());
+    ASSERT_EQ(2, schedule[0].size());
+    ASSERT_EQ(1, schedule[1].size());
+    EXPECT_EQ(&videos[0], &schedule[0][0].video);
+    EXPECT_EQ(&videos[1], &schedule[0][1].video);
+    EXPECT_EQ(&videos[2], &schedule[1][0].video);
+    EXPECT_LT(videos[0].file_location().offset, videos[1].file_location().offset);
+}
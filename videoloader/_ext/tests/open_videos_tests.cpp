@@ -0,0 +1,34 @@
+#include <gtest/gtest.h>
+
+#include "open_videos.h"
+
+namespace vl = huww::videoloader;
+
+TEST(OpenVideos, Open) {
+    std::vector<std::string> paths(5, "./tests/test_video.mp4");
+    auto results = vl::open_videos(paths, 3);
+    ASSERT_EQ(5, results.size());
+    for (auto &r : results) {
+        ASSERT_TRUE(r.video);
+        EXPECT_FALSE(r.error);
+        EXPECT_TRUE(r.video->is_sleeping());
+        EXPECT_EQ(results[0].video->num_frames(), r.video->num_frames());
+    }
+}
+
+TEST(OpenVideos, PerFileError) {
+    auto results = vl::open_videos(
+        {"./tests/test_video.mp4", "./tests/not_exist.mp4", "./tests/test_video.mp4"}, 2, true);
+    ASSERT_EQ(3, results.size());
+    EXPECT_TRUE(results[0].video);
+    EXPECT_TRUE(results[2].video);
+    EXPECT_FALSE(results[1].video);
+    ASSERT_TRUE(results[1].error);
+    EXPECT_THROW(std::rethrow_exception(results[1].error), std::system_error);
+}
+
+TEST(OpenVideos, Empty) { EXPECT_TRUE(vl::open_videos({}, 4).empty()); }
+
+TEST(OpenVideos, Threads0Throws) {
+    EXPECT_THROW(vl::open_videos({"./tests/test_video.mp4"}, 0), std::logic_error);
+}
@@ -0,0 +1,61 @@
+#include <gtest/gtest.h>
+
+#include "tar_entry_filter.h"
+
+static huww::tar_entry file_entry(std::string path, std::streamsize size = 100) {
+    return huww::tar_entry(std::move(path), 512, size);
+}
+
+TEST(TarEntryFilter, Empty) {
+    huww::tar_entry_filter filter;
+    EXPECT_TRUE(filter.empty());
+    EXPECT_TRUE(filter(file_entry("a/b.json")));
+}
+
+TEST(TarEntryFilter, Extensions) {
+    huww::tar_entry_filter filter;
+    filter.set_extensions({".mp4", "MKV"});
+    EXPECT_FALSE(filter.empty());
+    EXPECT_TRUE(filter(file_entry("a/b.mp4")));
+    EXPECT_TRUE(filter(file_entry("a/b.MP4")));
+    EXPECT_TRUE(filter(file_entry("b.mkv")));
+    EXPECT_FALSE(filter(file_entry("a/b.json")));
+    EXPECT_FALSE(filter(file_entry("a.mp4/b")));
+    EXPECT_FALSE(filter(file_entry("mp4")));
+}
+
+TEST(TarEntryFilter, Glob) {
+    huww::tar_entry_filter filter;
+    filter.globs = {"train/*.mp4", "*/keep_*"};
+    EXPECT_TRUE(filter(file_entry("train/x/y.mp4")));
+    EXPECT_TRUE(filter(file_entry("val/keep_1.json")));
+    EXPECT_FALSE(filter(file_entry("val/y.mp4")));
+}
+
+TEST(TarEntryFilter, Regex) {
+    huww::tar_entry_filter filter;
+    filter.set_regex("_0001[0-9]{2}_");
+    EXPECT_TRUE(filter(file_entry("answering_questions/-en4qGdlPiQ_000161_000171.mp4")));
+    EXPECT_FALSE(filter(file_entry("answering_questions/-g3JhkJRVY4_000333_000343.mp4")));
+    EXPECT_THROW(filter.set_regex("("), std::regex_error);
+}
+
+TEST(TarEntryFilter, SizeRange) {
+    huww::tar_entry_filter filter;
+    filter.min_size = 10;
+    filter.max_size = 20;
+    EXPECT_FALSE(filter(file_entry("a", 9)));
+    EXPECT_TRUE(filter(file_entry("a", 10)));
+    EXPECT_TRUE(filter(file_entry("a", 20)));
+    EXPECT_FALSE(filter(file_entry("a", 21)));
+}
+
+TEST(TarEntryFilter, AllConditions) {
+    huww::tar_entry_filter filter;
+    filter.set_extensions({"mp4"});
+    filter.globs = {"train/*"};
+    filter.min_size = 1;
+    EXPECT_TRUE(filter(file_entry("train/a.mp4")));
+    EXPECT_FALSE(filter(file_entry("train/a.mp4", 0)));
+    EXPECT_FALSE(filter(file_entry("val/a.mp4")));
+}
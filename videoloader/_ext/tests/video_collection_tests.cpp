@@ -0,0 +1,106 @@
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include "dataset_catalog.h"
+#include "video_collection.h"
+#include "video_tar.h"
+
+namespace vl = huww::videoloader;
+
+static void expect_same_frames(vl::video &expected, vl::video &actual) {
+    ASSERT_EQ(expected.num_frames(), actual.num_frames());
+    EXPECT_EQ(expected.width(), actual.width());
+    auto a = expected.get_batch({0, 5});
+    auto b = actual.get_batch({0, 5});
+    auto &t = a->dl_tensor;
+    auto size = t.shape[0] * t.shape[1] * t.shape[2] * t.shape[3];
+    EXPECT_EQ(0, memcmp(t.data, b->dl_tensor.data, size));
+}
+
+TEST(VideoCollection, RoundTrip) {
+    vl::video file("./tests/test_video.mp4");
+    auto options = huww::tar_options::advise_sequential | huww::tar_options::memory_map;
+    auto tar = vl::open_video_tar("./tests/tar/test_videos.tar",
+                                  [](const huww::tar_entry &) { return true; }, options);
+
+    vl::video_collection_builder builder;
+    EXPECT_EQ(0, builder.add(file));
+    for (auto &v : tar) {
+        builder.add(v);
+    }
+    auto collection = vl::video_collection::from_bytes(builder.build());
+    ASSERT_EQ(4, collection.size());
+    EXPECT_EQ("./tests/test_video.mp4", collection.path(0));
+    EXPECT_EQ("./tests/tar/test_videos.tar", collection.path(1));
+    EXPECT_EQ(tar[0].file_location().offset, collection.location(1).offset);
+
+    auto reopened = collection.open(0);
+    expect_same_frames(file, reopened);
+    // The frame index is read in place, not copied.
+    auto bytes = collection.bytes();
+    auto index_begin = reinterpret_cast<const char *>(reopened.frame_index().begin());
+    EXPECT_TRUE(index_begin >= bytes.data() && index_begin < bytes.data() + bytes.size());
+    EXPECT_EQ(0, reopened.memory_usage().index_bytes);
+    for (size_t i = 0; i < tar.size(); i++) {
+        EXPECT_EQ(tar[i].num_frames(), collection.num_frames(i + 1));
+        auto v = collection.open(i + 1);
+        ASSERT_TRUE(v.file_location().mapping);
+        expect_same_frames(tar[i], v);
+    }
+    // Videos of the same tar share one mapping.
+    auto a = collection.open(1);
+    auto b = collection.open(2);
+    EXPECT_EQ(a.file_location().mapping, b.file_location().mapping);
+
+    // A copy of the bytes, e.g. unpickled in another process.
+    auto copy = vl::video_collection::from_bytes(std::string(collection.bytes()));
+    EXPECT_EQ(collection.num_frames(3), copy.num_frames(3));
+    EXPECT_THROW(copy.open(4), std::out_of_range);
+}
+
+TEST(VideoCollection, Invalid) {
+    EXPECT_THROW(vl::video_collection::from_bytes("VLVIDCOL"), std::invalid_argument);
+    vl::video_collection_builder builder;
+    builder.add(vl::video("./tests/test_video.mp4"));
+    auto bytes = builder.build();
+    EXPECT_THROW(vl::video_collection::from_bytes(bytes.substr(0, bytes.size() - 1)),
+                 std::invalid_argument);
+    bytes[0] = 'X';
+    EXPECT_THROW(vl::video_collection::from_bytes(bytes), std::invalid_argument);
+    EXPECT_EQ(0, vl::video_collection::from_bytes(vl::video_collection_builder().build()).size());
+}
+
+TEST(VideoCollection, Catalog) {
+    namespace fs = std::filesystem;
+    auto dir = fs::temp_directory_path() / ("videoloader_catalog_" + std::to_string(getpid()));
+    fs::create_directories(dir / "videos");
+    fs::copy_file("./tests/test_video.mp4", dir / "videos" / "b.mp4");
+    fs::copy_file("./tests/test_video.mp4", dir / "videos" / "a.mp4");
+    fs::copy_file("./tests/tar/test_videos.tar", dir / "videos" / "shard.tar");
+    { std::ofstream(dir / "videos" / "notes.txt") << "not a video"; }
+    auto catalog_path = (dir / "catalog.vlcol").string();
+
+    vl::dataset_catalog_options options;
+    options.max_threads = 2;
+    EXPECT_EQ(5, vl::write_dataset_catalog(catalog_path, {(dir / "videos").string()}, options));
+    auto catalog = vl::video_collection::map(catalog_path);
+    ASSERT_EQ(5, catalog.size());
+    EXPECT_EQ((dir / "videos" / "a.mp4").string(), catalog.path(0));
+    EXPECT_EQ((dir / "videos" / "shard.tar").string(), catalog.path(2));
+    vl::video file("./tests/test_video.mp4");
+    auto v = catalog.open(1);
+    expect_same_frames(file, v);
+
+    // The filter applies to files of directories and entries of tars.
+    options.filter.set_extensions({"mp4"});
+    options.filter.globs = {"*/a.*"};
+    EXPECT_EQ(1, vl::write_dataset_catalog(catalog_path, {(dir / "videos").string()}, options));
+    EXPECT_EQ(1, vl::video_collection::map(catalog_path).size());
+    // Still mapped by `catalog`, which is unaffected by the replacement.
+    EXPECT_EQ(5, catalog.size());
+    fs::remove_all(dir);
+}
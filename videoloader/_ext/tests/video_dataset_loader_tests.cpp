@@ -0,0 +1,180 @@
+#include <gtest/gtest.h>
+
+#include <deque>
+
+#include "video_dataset_loader.h"
+
+namespace vl = huww::videoloader;
+
+class TestDatasetLoader : public ::testing::Test {
+  protected:
+    std::deque<vl::video> videos;
+
+    vl::dataset_load_batch make_batch(size_t batch_size) {
+        vl::dataset_load_batch batch;
+        for (size_t i = 0; i < batch_size; i++) {
+            auto &v = videos.emplace_back("./tests/test_video.mp4");
+            v.sleep();
+            batch.push_back({
+                .video = v,
+                .frame_indices = {0, 1, 2},
+            });
+        }
+        return batch;
+    }
+};
+
+TEST_F(TestDatasetLoader, Schedule) {
+    vl::dataset_load_schedule schedule = {make_batch(2), make_batch(3), make_batch(1)};
+    vl::video_dataset_loader loader(schedule);
+    loader.start(2);
+    for (auto &expected : schedule) {
+        auto batch = loader.get_next_batch();
+        ASSERT_EQ(expected.size(), batch.size());
+        for (auto &clip : batch) {
+            EXPECT_EQ(3, clip->dl_tensor.shape[0]);
+        }
+    }
+    EXPECT_THROW(loader.get_next_batch(), vl::video_dataset_loader::no_more_batch);
+    loader.stop();
+}
+
+TEST_F(TestDatasetLoader, Producer) {
+    constexpr int num_batches = 20;
+    int produced = 0;
+    vl::video_dataset_loader loader(
+        [&]() -> std::optional<vl::dataset_load_batch> {
+            if (produced == num_batches) {
+                return std::nullopt;
+            }
+            produced++;
+            return make_batch(2);
+        },
+        2);
+    loader.start(2);
+    for (int i = 0; i < num_batches; i++) {
+        EXPECT_EQ(2, loader.get_next_batch().size());
+    }
+    EXPECT_THROW(loader.get_next_batch(), vl::video_dataset_loader::no_more_batch);
+    auto status = loader.status();
+    EXPECT_EQ(num_batches, status.consumed_batches);
+    EXPECT_EQ(0, status.preloaded_clips);
+    loader.stop();
+}
+
+TEST_F(TestDatasetLoader, ConsumerFirst) {
+    std::atomic<bool> consumer_waiting = false;
+    bool produced = false;
+    vl::video_dataset_loader loader(
+        [&]() -> std::optional<vl::dataset_load_batch> {
+            if (produced) {
+                return std::nullopt;
+            }
+            // Let the consumer wait on the output buffer before it is reset for this batch.
+            while (!consumer_waiting) {
+                std::this_thread::yield();
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            produced = true;
+            return make_batch(3);
+        },
+        2);
+    loader.start(2);
+    consumer_waiting = true;
+    EXPECT_EQ(3, loader.get_next_batch().size());
+    EXPECT_THROW(loader.get_next_batch(), vl::video_dataset_loader::no_more_batch);
+    loader.stop();
+}
+
+TEST_F(TestDatasetLoader, Queue) {
+    constexpr int num_batches = 10;
+    vl::bounded_queue<vl::dataset_load_batch> queue(2);
+    std::thread producer([&] {
+        for (int i = 0; i < num_batches; i++) {
+            queue.push(make_batch(1));
+        }
+        queue.close();
+    });
+    vl::video_dataset_loader loader(queue, 3);
+    loader.start(2);
+    for (int i = 0; i < num_batches; i++) {
+        EXPECT_EQ(1, loader.get_next_batch().size());
+    }
+    EXPECT_THROW(loader.get_next_batch(), vl::video_dataset_loader::no_more_batch);
+    loader.stop();
+    producer.join();
+}
+
+TEST_F(TestDatasetLoader, TinyBytesLimit) {
+    vl::dataset_load_schedule schedule = {make_batch(3), make_batch(3)};
+    vl::video_dataset_loader loader(schedule);
+    vl::preload_limits limits;
+    limits.max_bytes = 1;
+    loader.set_preload_limits(limits);
+    loader.start(2);
+    EXPECT_EQ(3, loader.get_next_batch().size());
+    EXPECT_EQ(3, loader.get_next_batch().size());
+    EXPECT_THROW(loader.get_next_batch(), vl::video_dataset_loader::no_more_batch);
+    EXPECT_THROW(loader.set_preload_limits(limits), std::logic_error);
+    loader.stop();
+}
+
+TEST_F(TestDatasetLoader, SharedVideo) {
+    // Clips of the same video in batches loaded at the same time.
+    auto &v = videos.emplace_back("./tests/test_video.mp4");
+    v.sleep();
+    vl::dataset_load_schedule schedule(8);
+    for (size_t i = 0; i < 4 * schedule.size(); i++) {
+        schedule[i % schedule.size()].push_back({
+            .video = v,
+            .frame_indices = {i, i + 1},
+        });
+    }
+    vl::video_dataset_loader loader(schedule);
+    loader.start(4);
+    for (auto &expected : schedule) {
+        auto batch = loader.get_next_batch();
+        ASSERT_EQ(expected.size(), batch.size());
+        for (auto &clip : batch) {
+            EXPECT_EQ(2, clip->dl_tensor.shape[0]);
+        }
+    }
+    EXPECT_THROW(loader.get_next_batch(), vl::video_dataset_loader::no_more_batch);
+    loader.stop();
+}
+
+TEST_F(TestDatasetLoader, ProducerThrows) {
+    vl::video_dataset_loader loader(
+        []() -> std::optional<vl::dataset_load_batch> { throw std::runtime_error("TestError"); },
+        2);
+    loader.start(2);
+    try {
+        loader.get_next_batch();
+        FAIL();
+    } catch (std::runtime_error &e) {
+        EXPECT_STREQ(e.what(), "TestError");
+    }
+    loader.stop();
+}
+
+TEST(DatasetLoader, ZeroPreloadThrows) {
+    EXPECT_THROW(vl::video_dataset_loader([] { return std::optional<vl::dataset_load_batch>(); }, 0),
+                 std::logic_error);
+}
+
+TEST_F(TestDatasetLoader, Prefetch) {
+    vl::dataset_load_schedule schedule = {make_batch(2), make_batch(2)};
+    auto prefetcher = std::make_shared<vl::prefetcher>(2);
+    vl::video_dataset_loader loader(schedule);
+    loader.set_prefetcher(prefetcher);
+    loader.start(2);
+    for (auto &expected : schedule) {
+        EXPECT_EQ(expected.size(), loader.get_next_batch().size());
+    }
+    loader.stop();
+
+    auto ranges = videos.front().byte_ranges({0, 1, 2});
+    ASSERT_FALSE(ranges.empty());
+    EXPECT_EQ("./tests/test_video.mp4", ranges.front().path);
+    EXPECT_GT(ranges.front().size, 0);
+}
@@ -1,4 +1,9 @@
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
 #include <gtest/gtest.h>
+#include <unistd.h>
 
 #include "video_tar.h"
 
@@ -44,3 +49,116 @@ TEST(OpenVideosInTar, OpenFilterThrows) {
         EXPECT_STREQ(e.what(), "TestError");
     }
 }
+
+TEST(OpenVideosInTar, OpenMemoryMapped) {
+    auto options = huww::tar_options::advise_sequential | huww::tar_options::memory_map;
+    auto videos = vl::open_video_tar("./tests/tar/test_videos.tar",
+                                     [](const huww::tar_entry &) { return true; }, 2, options);
+    ASSERT_EQ(3, videos.size());
+    for (auto &v : videos) {
+        EXPECT_TRUE(v.is_sleeping());
+        v.get_batch({0, 1, 2});
+    }
+}
+
+TEST(OpenVideosInTar, SidecarIndex) {
+    namespace fs = std::filesystem;
+    auto dir = fs::temp_directory_path() / ("videoloader_test_" + std::to_string(getpid()));
+    fs::create_directories(dir);
+    auto tar_path = (dir / "test_videos.tar").string();
+    fs::copy_file("./tests/tar/test_videos.tar", tar_path, fs::copy_options::overwrite_existing);
+    fs::remove(vl::tar_index::sidecar_path(tar_path));
+
+    auto options = huww::tar_options::advise_sequential | huww::tar_options::sidecar_index;
+    auto only_first = [](const huww::tar_entry &entry) {
+        return entry.path() == "answering_questions/-g3JhkJRVY4_000333_000343.mp4";
+    };
+    auto scanned = vl::open_video_tar(tar_path, only_first, options);
+    ASSERT_EQ(1, scanned.size());
+    auto index = vl::tar_index::open(tar_path);
+    ASSERT_TRUE(index);
+    EXPECT_EQ(3, index->size());
+    size_t num_indexed = 0;
+    for (size_t i = 0; i < index->size(); i++) {
+        num_indexed += index->has_frame_index(i);
+    }
+    EXPECT_EQ(1, num_indexed);
+
+    // Entries not opened before are demuxed and added to the index.
+    auto all = [](const huww::tar_entry &) { return true; };
+    auto videos = vl::open_video_tar(tar_path, all, 2, options);
+    ASSERT_EQ(3, videos.size());
+    index = vl::tar_index::open(tar_path);
+    ASSERT_TRUE(index);
+    for (size_t i = 0; i < index->size(); i++) {
+        EXPECT_TRUE(index->has_frame_index(i));
+    }
+
+    auto reopened = vl::open_video_tar(tar_path, all, options);
+    ASSERT_EQ(3, reopened.size());
+    for (size_t i = 0; i < videos.size(); i++) {
+        ASSERT_EQ(videos[i].num_frames(), reopened[i].num_frames());
+        EXPECT_EQ(videos[i].width(), reopened[i].width());
+        auto expected = videos[i].get_batch({0, 5});
+        auto actual = reopened[i].get_batch({0, 5});
+        auto &t = expected->dl_tensor;
+        auto size = t.shape[0] * t.shape[1] * t.shape[2] * t.shape[3];
+        EXPECT_EQ(0, memcmp(t.data, actual->dl_tensor.data, size));
+    }
+
+    // Modified tar invalidates the index.
+    { std::ofstream(tar_path, std::ios::app | std::ios::binary) << std::string(1024, '\0'); }
+    EXPECT_FALSE(vl::tar_index::open(tar_path));
+    fs::remove_all(dir);
+}
+
+TEST(OpenVideosInTar, Stream) {
+    auto expected = vl::open_video_tar("./tests/tar/test_videos.tar");
+    vl::video_tar_stream stream("./tests/tar/test_videos.tar",
+                                [](const huww::tar_entry &) { return true; }, 2);
+    for (auto &e : expected) {
+        auto v = stream.next();
+        ASSERT_TRUE(v);
+        EXPECT_TRUE(v->is_sleeping());
+        EXPECT_EQ(e.num_frames(), v->num_frames());
+    }
+    EXPECT_FALSE(stream.next());
+    EXPECT_FALSE(stream.next());
+}
+
+TEST(OpenVideosInTar, StreamStop) {
+    vl::video_tar_stream stream("./tests/tar/test_videos.tar",
+                                [](const huww::tar_entry &) { return true; }, 1,
+                                huww::tar_options::advise_sequential, 1);
+    EXPECT_TRUE(stream.next());
+    stream.stop();
+    EXPECT_FALSE(stream.next());
+}
+
+TEST(OpenVideosInTar, StreamFilterThrows) {
+    vl::video_tar_stream stream(
+        "./tests/tar/test_videos.tar",
+        [](const huww::tar_entry &entry) -> bool { throw std::runtime_error("TestError"); }, 2);
+    EXPECT_THROW(stream.next(), std::runtime_error);
+    EXPECT_FALSE(stream.next());
+}
+
+TEST(OpenVideosInTar, OpenDirectIO) {
+    auto options = huww::tar_options::advise_sequential | huww::tar_options::direct_io;
+    auto all = [](const huww::tar_entry &) { return true; };
+    auto expected = vl::open_video_tar("./tests/tar/test_videos.tar");
+    for (int max_threads : {0, 2}) {
+        std::vector<vl::video> videos;
+        if (max_threads > 0) {
+            videos = vl::open_video_tar("./tests/tar/test_videos.tar", all, max_threads, options);
+        } else {
+            videos = vl::open_video_tar("./tests/tar/test_videos.tar", all, options);
+        }
+        ASSERT_EQ(3, videos.size());
+        for (size_t i = 0; i < videos.size(); i++) {
+            EXPECT_TRUE(videos[i].is_sleeping());
+            EXPECT_EQ(expected[i].num_frames(), videos[i].num_frames());
+            videos[i].get_batch({0, 1, 2});
+        }
+    }
+}
@@ -1,5 +1,12 @@
+#include <cstring>
+#include <numeric>
+#include <thread>
+
 #include <gtest/gtest.h>
 
+#include "fd_cache.h"
+#include "memory_stats.h"
+#include "stage_stats.h"
 #include "video.h"
 
 namespace vl = huww::videoloader;
@@ -41,3 +48,156 @@ TEST_F(TestVideo, SleepAndGetBatch) {
     this->v.sleep();
     this->v.get_batch({1,2,3,4});
 }
+
+static std::vector<uint8_t> frame_bytes(const DLManagedTensor &t, int64_t i) {
+    auto &dl = t.dl_tensor;
+    auto data = static_cast<const uint8_t *>(dl.data) + dl.strides[0] * i;
+    return std::vector<uint8_t>(data, data + dl.strides[0]);
+}
+
+TEST_F(TestVideo, FrameReader) {
+    std::vector<size_t> all(v.num_frames());
+    std::iota(all.begin(), all.end(), 0);
+    auto expected = v.get_batch(all);
+
+    vl::frame_reader reader(v, 0, 16);
+    size_t num_read = 0;
+    while (auto chunk = reader.next()) {
+        auto n = chunk->dl_tensor.shape[0];
+        ASSERT_LE(n, 16);
+        for (int64_t i = 0; i < n; i++) {
+            ASSERT_EQ(frame_bytes(*expected, num_read + i), frame_bytes(*chunk, i));
+        }
+        num_read += n;
+        EXPECT_EQ(num_read, reader.tell());
+    }
+    EXPECT_EQ(v.num_frames(), num_read);
+    EXPECT_FALSE(reader.next());
+
+    // Resume backwards, forwards within a GOP, and after the video slept.
+    for (size_t start : {size_t(40), size_t(3), size_t(5), v.num_frames() - 1}) {
+        reader.seek(start);
+        auto chunk = reader.next();
+        ASSERT_TRUE(chunk);
+        EXPECT_EQ(frame_bytes(*expected, start), frame_bytes(*chunk, 0));
+        v.sleep();
+    }
+    EXPECT_THROW(reader.seek(v.num_frames() + 1), std::out_of_range);
+    EXPECT_THROW(vl::frame_reader(v, 0, 0), std::logic_error);
+}
+
+TEST_F(TestVideo, GetBatches) {
+    // Overlapping, repeated and out of order frames in the same and different GOPs.
+    std::vector<std::vector<size_t>> clips = {{10, 11, 12, 13}, {12, 13, 14}, {200, 3, 200}};
+    auto batches = v.get_batches(clips);
+    ASSERT_EQ(clips.size(), batches.size());
+    for (size_t c = 0; c < clips.size(); c++) {
+        auto expected = v.get_batch(clips[c]);
+        ASSERT_EQ(static_cast<int64_t>(clips[c].size()), batches[c]->dl_tensor.shape[0]);
+        for (size_t i = 0; i < clips[c].size(); i++) {
+            EXPECT_EQ(frame_bytes(*expected, i), frame_bytes(*batches[c], i));
+        }
+    }
+    EXPECT_TRUE(v.get_batches({}).empty());
+    EXPECT_THROW(v.get_batches({{0}, {}}), std::invalid_argument);
+    EXPECT_THROW(v.get_batches({{0}, {v.num_frames()}}), std::out_of_range);
+}
+
+TEST_F(TestVideo, MultipleOutputs) {
+    std::vector<size_t> frames = {3, 0, 100};
+    auto batches = v.get_batch(frames, {{}, {.width = 112, .height = 64},
+                                        {.width = 114, .height = -1, .pix_fmt = AV_PIX_FMT_GRAY8}});
+    ASSERT_EQ(3, batches.size());
+    auto expected = v.get_batch(frames);
+    for (size_t i = 0; i < frames.size(); i++) {
+        EXPECT_EQ(frame_bytes(*expected, i), frame_bytes(*batches[0], i));
+    }
+    auto &small = batches[1]->dl_tensor;
+    EXPECT_EQ((std::vector<int64_t>{3, 112, 64, 3}),
+              std::vector<int64_t>(small.shape, small.shape + small.ndim));
+    auto &gray = batches[2]->dl_tensor;
+    EXPECT_EQ((std::vector<int64_t>{3, 114, 64, 1}),
+              std::vector<int64_t>(gray.shape, gray.shape + gray.ndim));
+    EXPECT_EQ(1, gray.strides[1]);
+
+    EXPECT_THROW(v.get_batch(frames, std::vector<vl::output_spec>{}), std::invalid_argument);
+    EXPECT_THROW(v.get_batch(frames, {{.pix_fmt = AV_PIX_FMT_YUV420P}}), std::invalid_argument);
+}
+
+TEST_F(TestVideo, StageStats) {
+    if (!vl::stage_stats_enabled()) {
+        GTEST_SKIP();
+    }
+    auto get_batch_count = [] {
+        return vl::total_stage_stats()[static_cast<size_t>(vl::stage::get_batch)].count;
+    };
+    auto before = get_batch_count();
+    this->v.sleep();
+    this->v.get_batch({1, 2, 3, 4});
+    EXPECT_EQ(before + 1, get_batch_count());
+    auto stats = vl::total_stage_stats();
+    EXPECT_GT(stats[static_cast<size_t>(vl::stage::wake_up)].count, 0);
+    EXPECT_GT(stats[static_cast<size_t>(vl::stage::decode)].count, 0);
+}
+
+TEST_F(TestVideo, MemoryUsage) {
+    auto before = vl::get_memory_stats();
+    EXPECT_GT(v.memory_usage().index_bytes, 0);
+    EXPECT_GT(v.memory_usage().io_buffer_bytes, 0);
+
+    v.sleep();
+    EXPECT_EQ(v.memory_usage().io_buffer_bytes, 0);
+    auto after = vl::get_memory_stats();
+    EXPECT_EQ(before.open_videos.count - 1, after.open_videos.count);
+    EXPECT_EQ(before.sleeping_videos.count + 1, after.sleeping_videos.count);
+
+    {
+        auto batch = v.get_batch({1, 2});
+        EXPECT_GE(vl::get_memory_stats().tensor_bytes, after.tensor_bytes + 2);
+    }
+    EXPECT_EQ(vl::get_memory_stats().tensor_bytes, after.tensor_bytes);
+}
+
+TEST(VideoOpenFile, SharedDescriptor) {
+    auto fd = std::make_shared<const vl::file_descriptor>("./tests/test_video.mp4");
+    vl::video v1({.path = "./tests/test_video.mp4", .shared_fd = fd});
+    vl::video v2({.path = "./tests/test_video.mp4", .shared_fd = fd});
+    std::thread t([&] { v1.get_batch({1, 2, 3}); });
+    v2.get_batch({4, 5, 6});
+    t.join();
+}
+
+TEST(VideoOpenFile, MemoryMapped) {
+    auto mapping = std::make_shared<const vl::mapped_file>("./tests/test_video.mp4");
+    vl::video v({.path = "./tests/test_video.mp4", .mapping = mapping});
+    v.get_batch({1, 2, 3});
+    v.sleep();
+    EXPECT_TRUE(v.is_sleeping());
+    v.get_batch({10, 11});
+}
+
+TEST(VideoOpenFile, DirectIO) {
+    vl::video expected("./tests/test_video.mp4");
+    vl::video v(vl::file_io::file_spec{.path = "./tests/test_video.mp4", .direct_io = true});
+    ASSERT_EQ(expected.num_frames(), v.num_frames());
+    EXPECT_GT(v.memory_usage().io_buffer_bytes, 0);
+    v.sleep();
+    auto expected_batch = expected.get_batch({1, 30, 31});
+    auto batch = v.get_batch({1, 30, 31});
+    auto &t = batch->dl_tensor;
+    EXPECT_EQ(0, memcmp(expected_batch->dl_tensor.data, t.data,
+                        t.shape[0] * t.shape[1] * t.shape[2] * t.shape[3]));
+}
+
+TEST(VideoOpenFile, DirectIOWakeUpFromCache) {
+    vl::file_io::file_spec spec{.path = "./tests/test_video.mp4", .direct_io = true};
+    vl::video v1(spec);
+    vl::video v2(spec);
+    v1.sleep();
+    v2.sleep();
+    auto &cache = vl::fd_cache::global();
+    auto misses = cache.misses();
+    v1.wake_up();
+    v2.wake_up();
+    EXPECT_EQ(misses, cache.misses());
+}
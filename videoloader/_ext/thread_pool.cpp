@@ -0,0 +1,59 @@
+#include "thread_pool.h"
+
+#include <pthread.h>
+
+namespace huww {
+namespace videoloader {
+
+thread_pool::thread_pool(size_t num_threads, std::string thread_name)
+    : thread_name(std::move(thread_name)) {
+    this->reserve(num_threads);
+}
+
+thread_pool::~thread_pool() {
+    {
+        std::lock_guard lk(m);
+        stopping = true;
+    }
+    has_task.notify_all();
+    for (auto &t : threads) {
+        t.join();
+    }
+}
+
+void thread_pool::reserve(size_t num_threads) {
+    std::lock_guard lk(m);
+    while (threads.size() < num_threads) {
+        threads.emplace_back([this] { this->worker_main(); });
+        pthread_setname_np(threads.back().native_handle(), thread_name.c_str());
+    }
+}
+
+size_t thread_pool::size() {
+    std::lock_guard lk(m);
+    return threads.size();
+}
+
+void thread_pool::worker_main() {
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock lk(m);
+            has_task.wait(lk, [this] { return stopping || !tasks.empty(); });
+            if (tasks.empty()) {
+                return; // Stopping
+            }
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+        task();
+    }
+}
+
+thread_pool &thread_pool::shared() {
+    static thread_pool pool(0, "vl_decode");
+    return pool;
+}
+
+} // namespace videoloader
+} // namespace huww
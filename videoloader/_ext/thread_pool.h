@@ -0,0 +1,61 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace huww {
+namespace videoloader {
+
+/**
+ * Threads running submitted tasks in FIFO order. Tasks should not wait for other tasks of the same
+ * pool, or they may wait forever.
+ */
+class thread_pool {
+    std::mutex m;
+    std::condition_variable has_task;
+    std::deque<std::function<void()>> tasks;
+    std::vector<std::thread> threads;
+    bool stopping = false;
+    std::string thread_name;
+
+    void worker_main();
+
+  public:
+    /** \param thread_name Name of threads, at most 15 characters on Linux. */
+    thread_pool(size_t num_threads, std::string thread_name);
+    thread_pool(const thread_pool &) = delete;
+    thread_pool &operator=(const thread_pool &) = delete;
+    /** Run all submitted tasks, then join threads. */
+    ~thread_pool();
+
+    /** Start more threads if there are less than `num_threads`. Threads are never removed. */
+    void reserve(size_t num_threads);
+    size_t size();
+
+    template <typename F> auto submit(F task) -> std::future<std::invoke_result_t<F>> {
+        // std::function requires a copyable callable.
+        auto packaged =
+            std::make_shared<std::packaged_task<std::invoke_result_t<F>()>>(std::move(task));
+        auto result = packaged->get_future();
+        {
+            std::lock_guard lk(m);
+            tasks.emplace_back([packaged] { (*packaged)(); });
+        }
+        has_task.notify_one();
+        return result;
+    }
+
+    /** Shared by the whole process for decoding, created empty on first use. */
+    static thread_pool &shared();
+};
+
+} // namespace videoloader
+} // namespace huww
@@ -0,0 +1,249 @@
+#include "trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <system_error>
+#include <vector>
+
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace huww {
+namespace videoloader {
+
+namespace trace_detail {
+std::atomic<bool> enabled = false;
+} // namespace trace_detail
+
+using trace_clock = std::chrono::steady_clock;
+
+struct trace_event {
+    int64_t ts_ns; /**< Since trace started */
+    const char *name;
+    int64_t value;
+    char phase;
+};
+
+/** Single writer ring buffer of one thread */
+struct thread_trace_buffer {
+    std::unique_ptr<trace_event[]> events;
+    size_t capacity = 0;
+    std::atomic<uint64_t> head = 0; /**< Number of events ever pushed */
+    uint64_t session = 0;
+
+    pthread_t thread = pthread_self();
+    long tid = syscall(SYS_gettid);
+    std::string exited_thread_name;
+
+    void push(const trace_event &e) noexcept {
+        auto h = head.load(std::memory_order_relaxed);
+        events[h % capacity] = e;
+        head.store(h + 1, std::memory_order_release);
+    }
+};
+
+class trace_registry {
+  public:
+    std::mutex m;
+    std::vector<thread_trace_buffer *> threads;
+    std::vector<std::unique_ptr<thread_trace_buffer>> exited_threads;
+
+    std::atomic<uint64_t> session = 0;
+    size_t capacity = 0;
+    trace_clock::time_point start_time;
+
+    thread_trace_buffer *add() {
+        auto buffer = new thread_trace_buffer();
+        std::lock_guard lk(m);
+        threads.push_back(buffer);
+        return buffer;
+    }
+
+    void remove(thread_trace_buffer *buffer) {
+        char name[16] = {};
+        pthread_getname_np(buffer->thread, name, sizeof(name));
+        buffer->exited_thread_name = name;
+
+        std::lock_guard lk(m);
+        threads.erase(std::find(threads.begin(), threads.end(), buffer));
+        if (buffer->session == session.load(std::memory_order_relaxed)) {
+            exited_threads.emplace_back(buffer);
+        } else {
+            delete buffer;
+        }
+    }
+};
+
+static trace_registry &registry() {
+    // Never destroyed, thread local buffers may outlive static objects.
+    static auto r = new trace_registry();
+    return *r;
+}
+
+class local_trace_buffer {
+    thread_trace_buffer *buffer = nullptr;
+
+  public:
+    ~local_trace_buffer() {
+        if (buffer) {
+            registry().remove(buffer);
+        }
+    }
+
+    /** \return nullptr if out of memory */
+    thread_trace_buffer *get() noexcept {
+        auto &r = registry();
+        try {
+            if (!buffer) {
+                buffer = r.add();
+            }
+            auto session = r.session.load(std::memory_order_acquire);
+            if (buffer->session != session) {
+                // First event of this thread in a new session.
+                std::lock_guard lk(r.m);
+                buffer->events = std::make_unique<trace_event[]>(r.capacity);
+                buffer->capacity = r.capacity;
+                buffer->head.store(0, std::memory_order_relaxed);
+                buffer->session = session;
+            }
+        } catch (std::exception &) {
+            return nullptr;
+        }
+        return buffer;
+    }
+};
+
+static thread_local local_trace_buffer local_buffer;
+
+static void record(char phase, const char *name, int64_t value) noexcept {
+    if (!trace_enabled()) {
+        return;
+    }
+    auto buffer = local_buffer.get();
+    if (!buffer) {
+        return;
+    }
+    auto ts = std::chrono::duration_cast<std::chrono::nanoseconds>(trace_clock::now() -
+                                                                   registry().start_time);
+    buffer->push({
+        .ts_ns = std::max<int64_t>(ts.count(), 0),
+        .name = name,
+        .value = value,
+        .phase = phase,
+    });
+}
+
+void trace_begin(const char *name) noexcept { record('B', name, 0); }
+void trace_end(const char *name) noexcept { record('E', name, 0); }
+void trace_counter(const char *name, int64_t value) noexcept { record('C', name, value); }
+
+void start_trace(size_t events_per_thread) {
+    if (events_per_thread == 0) {
+        throw std::logic_error("events_per_thread should be greater than 0");
+    }
+    auto &r = registry();
+    {
+        std::lock_guard lk(r.m);
+        r.exited_threads.clear();
+        r.capacity = events_per_thread;
+        r.start_time = trace_clock::now();
+        r.session.fetch_add(1, std::memory_order_release);
+    }
+    trace_detail::enabled.store(true, std::memory_order_relaxed);
+}
+
+void stop_trace() { trace_detail::enabled.store(false, std::memory_order_relaxed); }
+
+static void write_json_string(std::ostream &out, const std::string &str) {
+    out << '"';
+    for (char c : str) {
+        if (c == '"' || c == '\\') {
+            out << '\\' << c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            out << ' ';
+        } else {
+            out << c;
+        }
+    }
+    out << '"';
+}
+
+static void write_thread_events(std::ostream &out, const thread_trace_buffer &buffer,
+                                const std::string &thread_name, long pid, bool &first) {
+    auto write_sep = [&out, &first] {
+        if (!first) {
+            out << ",\n";
+        }
+        first = false;
+    };
+    if (!thread_name.empty()) {
+        write_sep();
+        out << R"({"name":"thread_name","ph":"M","pid":)" << pid << R"(,"tid":)" << buffer.tid
+            << R"(,"args":{"name":)";
+        write_json_string(out, thread_name);
+        out << "}}";
+    }
+
+    auto head = buffer.head.load(std::memory_order_acquire);
+    auto begin = head > buffer.capacity ? head - buffer.capacity : 0;
+    for (auto i = begin; i < head; i++) {
+        auto &e = buffer.events[i % buffer.capacity];
+        write_sep();
+        out << R"({"name":)";
+        write_json_string(out, e.name);
+        out << R"(,"ph":")" << e.phase << R"(","ts":)" << e.ts_ns / 1000 << '.' << std::setw(3)
+            << std::setfill('0') << e.ts_ns % 1000 << std::setfill(' ') << R"(,"pid":)" << pid
+            << R"(,"tid":)" << buffer.tid;
+        if (e.phase == 'C') {
+            out << R"(,"args":{"value":)" << e.value << '}';
+        }
+        out << '}';
+    }
+}
+
+void write_chrome_trace(std::ostream &out) {
+    auto &r = registry();
+    auto pid = static_cast<long>(getpid());
+    bool first = true;
+    out << "{\"traceEvents\":[\n";
+    {
+        std::lock_guard lk(r.m);
+        auto session = r.session.load(std::memory_order_relaxed);
+        for (auto t : r.threads) {
+            if (t->session != session) {
+                continue; // No event recorded in this session.
+            }
+            // Registered threads are still alive, it is safe to query its name.
+            char name[16] = {};
+            pthread_getname_np(t->thread, name, sizeof(name));
+            write_thread_events(out, *t, name, pid, first);
+        }
+        for (auto &t : r.exited_threads) {
+            write_thread_events(out, *t, t->exited_thread_name, pid, first);
+        }
+    }
+    out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+}
+
+void write_chrome_trace(const std::string &path) {
+    std::ofstream out(path, std::ios::out | std::ios::trunc);
+    if (!out) {
+        std::ostringstream msg;
+        msg << "Unable to open file \"" << path << "\"";
+        throw std::system_error(errno, std::system_category(), msg.str());
+    }
+    write_chrome_trace(out);
+    out.close();
+    if (!out) {
+        throw std::system_error(errno, std::system_category(), "Failed to write trace");
+    }
+}
+
+} // namespace videoloader
+} // namespace huww
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+namespace huww {
+namespace videoloader {
+
+namespace trace_detail {
+extern std::atomic<bool> enabled;
+} // namespace trace_detail
+
+/**
+ * Record timeline events of all threads, to be viewed in Perfetto or chrome://tracing.
+ *
+ * Every thread records into its own ring buffer without locking. When a buffer is full, the
+ * oldest events of that thread are overwritten.
+ *
+ * Any previously recorded events are discarded.
+ */
+void start_trace(size_t events_per_thread = 1 << 16);
+void stop_trace();
+inline bool trace_enabled() noexcept {
+    return trace_detail::enabled.load(std::memory_order_relaxed);
+}
+
+/**
+ * Write recorded events in Chrome trace event JSON format.
+ *
+ * Should be called after `stop_trace()`, events being recorded concurrently may be corrupted.
+ */
+void write_chrome_trace(std::ostream &out);
+void write_chrome_trace(const std::string &path);
+
+/** `name` must be a string literal, or otherwise live until the trace is written. */
+void trace_begin(const char *name) noexcept;
+void trace_end(const char *name) noexcept;
+void trace_counter(const char *name, int64_t value) noexcept;
+
+} // namespace videoloader
+} // namespace huww
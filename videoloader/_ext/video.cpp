@@ -3,14 +3,17 @@
 #include <algorithm>
 #include <assert.h>
 #include <iostream>
+#include <limits>
 #include <map>
 #include <memory>
+#include <optional>
 #include <sstream>
 #include <unordered_set>
 
 #include <spdlog/spdlog.h>
 
 #include "av_utils.h"
+#include "stage_stats.h"
 
 namespace huww {
 namespace videoloader {
@@ -44,6 +47,7 @@ video::video(const file_io::file_spec &spec) : format(spec) {
                  "Unable to find video stream for \"" << spec.path << "\"");
 
     auto packet = new_avpacket();
+    std::vector<packet_index_entry> index;
 
     int last_key_frame_index = -1;
     int next_packet_index = 0;
@@ -57,54 +61,136 @@ video::video(const file_io::file_spec &spec) : format(spec) {
             continue;
         }
         if (packet->flags & AV_PKT_FLAG_KEY) {
-            last_key_frame_index = packet_index.size();
+            last_key_frame_index = index.size();
         }
         // First frame should be a key frame
         assert(last_key_frame_index >= 0);
-        packet_index.push_back({
+        index.push_back({
             .pts = packet->pts,
             .key_frame_index = last_key_frame_index,
             .packet_index = next_packet_index++,
+            .pos = packet->pos,
+            .size = packet->size,
         });
         av_packet_unref(packet.get());
     }
     CHECK_AV(av_seek_frame(fmt_ctx, stream_index, 0, AVSEEK_FLAG_BACKWARD), "failed to seek back");
-    std::sort(packet_index.begin(), packet_index.end(),
-              [](auto &a, auto &b) { return a.pts < b.pts; });
+    std::sort(index.begin(), index.end(), [](auto &a, auto &b) { return a.pts < b.pts; });
     {
         // Adjust key frame index. although I think key frame position should
         // not change during sorting.
-        std::vector<int> sort_map(packet_index.size());
-        for (size_t i = 0; i < packet_index.size(); i++) {
-            sort_map[packet_index[i].packet_index] = i;
+        std::vector<int> sort_map(index.size());
+        for (size_t i = 0; i < index.size(); i++) {
+            sort_map[index[i].packet_index] = i;
         }
-        for (auto &entry : packet_index) {
+        for (auto &entry : index) {
             entry.key_frame_index = sort_map[entry.key_frame_index];
         }
     }
+    // Index lives as long as the video, drop the slack from growing.
+    index.shrink_to_fit();
+    this->packet_index = std::move(index);
+    this->update_memory_account();
+}
+
+video::video(const file_io::file_spec &spec, int stream_index, shared_frame_index frame_index)
+    : format(spec), stream_index(stream_index), packet_index(std::move(frame_index)) {
+    auto fmt_ctx = format.format_context();
+    if (stream_index < 0 || static_cast<unsigned>(stream_index) >= fmt_ctx->nb_streams ||
+        current_stream().codecpar->codec_type != AVMEDIA_TYPE_VIDEO) {
+        std::ostringstream msg;
+        msg << "Stream " << stream_index << " of \"" << spec.path << "\" is not a video stream";
+        throw std::runtime_error(msg.str());
+    }
+    for (auto &entry : packet_index) {
+        if (entry.key_frame_index < 0 ||
+            static_cast<size_t>(entry.key_frame_index) >= packet_index.size()) {
+            throw std::runtime_error("Invalid frame index, key frame out of range");
+        }
+    }
+    if (current_stream().codecpar->codec_id == AV_CODEC_ID_NONE ||
+        current_stream().codecpar->width == 0) {
+        // Some formats only know codec parameters after decoding a few packets.
+        CHECK_AV(avformat_find_stream_info(fmt_ctx, nullptr), "find stream info failed");
+    }
+    this->decoder = const_cast<AVCodec *>(avcodec_find_decoder(current_stream().codecpar->codec_id));
+    if (!this->decoder) {
+        std::ostringstream msg;
+        msg << "Unable to find decoder for \"" << spec.path << "\"";
+        throw std::runtime_error(msg.str());
+    }
+    this->update_memory_account();
+}
+
+struct packet_schedule_entry {
+    std::unordered_set<int64_t> needed_pts;
+    int last_packet_index;
+    int64_t key_frame_pts; /**< Used to seek */
+    int64_t begin_pos;     /**< Byte range to be read, -1 if unknown */
+    int64_t end_pos;
+};
+/** Map from key frame index */
+using packet_schedule = std::map<int, packet_schedule_entry>;
+
+/** Group requested frames by the key frame to seek to, and merge adjacent groups. */
+static packet_schedule make_packet_schedule(const std::vector<size_t> &frame_indices_requested,
+                                            const shared_frame_index &index) {
+    packet_schedule schedule;
+    for (size_t f : frame_indices_requested) {
+        auto &pkt_index = index[f];
+        auto [it, inserted] = schedule.try_emplace(pkt_index.key_frame_index);
+        auto &entry = it->second;
+        if (inserted) {
+            auto &key_frame = index[pkt_index.key_frame_index];
+            entry.key_frame_pts = key_frame.pts;
+            entry.last_packet_index = key_frame.packet_index;
+            entry.begin_pos = entry.end_pos = key_frame.pos;
+        }
+        entry.needed_pts.insert(pkt_index.pts);
+        if (pkt_index.packet_index >= entry.last_packet_index) {
+            // Frames referenced by this one are decoded before it, thus stored before it.
+            entry.last_packet_index = pkt_index.packet_index;
+            entry.end_pos = pkt_index.pos < 0 ? -1 : pkt_index.pos + pkt_index.size;
+        }
+    }
+    if (!schedule.empty()) {
+        // Merge adjecent schedule.
+        for (auto it = std::next(schedule.begin()); it != schedule.end();) {
+            auto &previous_entry = std::prev(it)->second;
+            auto key_pkt_idx = index[it->first].packet_index;
+            if (key_pkt_idx - 1 == previous_entry.last_packet_index) {
+                previous_entry.needed_pts.merge(it->second.needed_pts);
+                previous_entry.last_packet_index = it->second.last_packet_index;
+                previous_entry.end_pos = it->second.end_pos;
+                it = schedule.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+    return schedule;
+}
+
+static bool has_byte_range(const packet_schedule_entry &entry) {
+    return entry.begin_pos >= 0 && entry.end_pos > entry.begin_pos;
 }
 
 class video_packet_scheduler {
   private:
-    struct schedule_entry {
-        std::unordered_set<int64_t> needed_pts;
-        int last_packet_index;
-        int64_t key_frame_pts; /**< Used to seek */
-    };
     AVFormatContext *fmt_ctx;
     int stream_index;
     avpacket_ptr packet;
     bool packet_consumed = true;
     bool _finished = false;
 
-    /** Map from key frame index */
-    std::map<int, schedule_entry> schedule;
+    packet_schedule schedule;
     decltype(schedule.begin()) current_schedule;
 
     void seek() {
         if (current_schedule == schedule.end()) {
             return;
         }
+        VIDEOLOADER_STAGE_TIMER(seek);
         CHECK_AV(av_seek_frame(fmt_ctx, stream_index, current_schedule->second.key_frame_pts,
                                AVSEEK_FLAG_BACKWARD),
                  "failed to seek");
@@ -112,28 +198,13 @@ class video_packet_scheduler {
 
   public:
     video_packet_scheduler(const std::vector<size_t> &frame_indices_requested,
-                           const std::vector<packet_index_entry> &index, AVFormatContext *fmt_ctx,
+                           const shared_frame_index &index, avformat &format,
                            int stream_index)
-        : fmt_ctx(fmt_ctx), stream_index(stream_index), packet(new_avpacket()) {
-        for (size_t f : frame_indices_requested) {
-            auto &pkt_index = index[f];
-            auto &entry = schedule[pkt_index.key_frame_index];
-            entry.key_frame_pts = index[pkt_index.key_frame_index].pts;
-            entry.needed_pts.insert(pkt_index.pts);
-            entry.last_packet_index = std::max(entry.last_packet_index, pkt_index.packet_index);
-        }
-        if (!schedule.empty()) {
-            // Merge adjecent schedule.
-            for (auto it = std::next(schedule.begin()); it != schedule.end();) {
-                auto &previous_entry = std::prev(it)->second;
-                auto key_pkt_idx = index[it->first].packet_index;
-                if (key_pkt_idx - 1 == previous_entry.last_packet_index) {
-                    previous_entry.needed_pts.merge(it->second.needed_pts);
-                    previous_entry.last_packet_index = it->second.last_packet_index;
-                    it = schedule.erase(it);
-                } else {
-                    ++it;
-                }
+        : fmt_ctx(format.format_context()), stream_index(stream_index), packet(new_avpacket()),
+          schedule(make_packet_schedule(frame_indices_requested, index)) {
+        for (auto &[_, entry] : schedule) {
+            if (has_byte_range(entry)) {
+                format.will_need(entry.begin_pos, entry.end_pos - entry.begin_pos);
             }
         }
         current_schedule = schedule.begin();
@@ -154,7 +225,10 @@ class video_packet_scheduler {
             return packet.get();
         }
 
-        CHECK_AV(av_read_frame(fmt_ctx, packet.get()), "read frame failed");
+        {
+            VIDEOLOADER_STAGE_TIMER(demux);
+            CHECK_AV(av_read_frame(fmt_ctx, packet.get()), "read frame failed");
+        }
 
         auto &needed_pts = current_schedule->second.needed_pts;
         auto pts_it = needed_pts.find(packet->pts);
@@ -188,36 +262,58 @@ struct frame_request {
     int64_t pts;
 };
 
-video_dlpack::ptr video::get_batch(const std::vector<size_t> &frame_indices, dlpack_pool *pool) {
-    this->wake_up();
-
-    std::vector<frame_request> request(frame_indices.size());
-    for (size_t i = 0; i < frame_indices.size(); i++) {
-        auto frame_index = frame_indices[i];
+void video::check_frame_indices(const std::vector<size_t> &frame_indices) const {
+    for (auto frame_index : frame_indices) {
         if (frame_index >= this->packet_index.size()) {
             std::ostringstream msg;
             msg << "Specified frame index " << frame_index << " is out of range";
             throw std::out_of_range(msg.str());
         }
+    }
+}
+
+std::vector<file_range> video::byte_ranges(const std::vector<size_t> &frame_indices) const {
+    check_frame_indices(frame_indices);
+    std::vector<file_range> ranges;
+    for (auto &[_, entry] : make_packet_schedule(frame_indices, packet_index)) {
+        if (has_byte_range(entry)) {
+            ranges.push_back(
+                format.input_range(entry.begin_pos, entry.end_pos - entry.begin_pos));
+        }
+    }
+    return ranges;
+}
+
+file_range video::file_location() const {
+    return format.input_range(0, std::numeric_limits<int64_t>::max());
+}
+
+file_io::file_spec video::reopen_spec() const { return format.input_spec(); }
+
+void video::decode_frames(const std::vector<size_t> &frame_indices,
+                          const std::vector<output_spec> &outputs,
+                          const std::function<void(avfilter_graph &, size_t)> &on_frame) {
+    std::vector<frame_request> request(frame_indices.size());
+    for (size_t i = 0; i < frame_indices.size(); i++) {
+        auto frame_index = frame_indices[i];
         request[i].request_index = i;
         request[i].pts = this->packet_index[frame_index].pts;
     }
     std::sort(request.begin(), request.end(),
               [](frame_request &a, frame_request &b) { return a.pts < b.pts; });
 
-    auto fmt_ctx = format.format_context();
-
-    video_packet_scheduler packet_scheduler(frame_indices, packet_index, fmt_ctx,
+    video_packet_scheduler packet_scheduler(frame_indices, packet_index, this->format,
                                             this->stream_index);
 
+    stage_timer decoder_init_timer(stage::decoder_init);
     auto decode_context = new_avcodec_context(decoder);
 
     CHECK_AV(avcodec_parameters_to_context(decode_context.get(), current_stream().codecpar),
              "failed to set codec parameters");
     CHECK_AV(avcodec_open2(decode_context.get(), decoder, nullptr), "open decoder failed");
 
-    avfilter_graph fg(*decode_context.get(), current_stream().time_base);
-    video_dlpack_builder pack_builder(request.size(), pool);
+    avfilter_graph fg(*decode_context.get(), current_stream().time_base, outputs);
+    decoder_init_timer.stop();
     auto next_request = request.cbegin();
 
     auto frame = new_avframe();
@@ -226,6 +322,7 @@ video_dlpack::ptr video::get_batch(const std::vector<size_t> &frame_indices, dlp
     while (!eof) {
         if (!packet_scheduler.finished()) {
             auto packet = packet_scheduler.next();
+            VIDEOLOADER_STAGE_TIMER(decode);
             CHECK_AV(avcodec_send_packet(decode_context.get(), packet),
                      "send packet to decoder failed");
             SPDLOG_TRACE("Send packet DTS {} PTS {}", packet->dts, packet->pts);
@@ -233,7 +330,9 @@ video_dlpack::ptr video::get_batch(const std::vector<size_t> &frame_indices, dlp
         }
 
         while (true) {
+            stage_timer decode_timer(stage::decode);
             int ret = avcodec_receive_frame(decode_context.get(), frame.get());
+            decode_timer.stop();
             if (ret == AVERROR(EAGAIN)) {
                 break;
             }
@@ -245,15 +344,20 @@ video_dlpack::ptr video::get_batch(const std::vector<size_t> &frame_indices, dlp
             SPDLOG_TRACE("Received frame PTS {}", frame->pts);
 
             if (frame->pts == next_request->pts) {
+                stage_timer filter_timer(stage::filter);
                 auto filtered_frame = fg.process_frame(frame.get());
+                filter_timer.stop();
                 SPDLOG_TRACE("Filtered frame PTS {}", filtered_frame->pts);
                 do {
-                    pack_builder.copy_from_frame(filtered_frame, next_request->request_index);
+                    VIDEOLOADER_STAGE_TIMER(copy);
+                    on_frame(fg, next_request->request_index);
                     SPDLOG_TRACE("Copied to index {}", next_request->request_index);
                     next_request++;
                 } while (next_request != request.cend() &&
                          filtered_frame->pts == next_request->pts);
-                av_frame_unref(filtered_frame);
+                for (size_t i = 0; i < fg.num_outputs(); i++) {
+                    av_frame_unref(fg.output(i));
+                }
                 if (next_request == request.cend()) {
                     eof = true;
                     break;
@@ -262,12 +366,244 @@ video_dlpack::ptr video::get_batch(const std::vector<size_t> &frame_indices, dlp
         }
     }
     assert(next_request == request.cend());
+}
+
+video_dlpack::ptr video::get_batch(const std::vector<size_t> &frame_indices, dlpack_pool *pool) {
+    VIDEOLOADER_STAGE_TIMER(get_batch);
+    this->wake_up();
+    check_frame_indices(frame_indices);
+
+    video_dlpack_builder pack_builder(frame_indices.size(), pool);
+    this->decode_frames(frame_indices, {output_spec{}},
+                        [&pack_builder](avfilter_graph &fg, size_t i) {
+                            pack_builder.copy_from_frame(fg.output(0), i);
+                        });
     return pack_builder.result();
 }
 
-void video::sleep() { this->format.sleep(); }
+std::vector<video_dlpack::ptr> video::get_batch(const std::vector<size_t> &frame_indices,
+                                               const std::vector<output_spec> &outputs,
+                                               dlpack_pool *pool) {
+    VIDEOLOADER_STAGE_TIMER(get_batch);
+    this->wake_up();
+    check_frame_indices(frame_indices);
+
+    std::vector<video_dlpack_builder> pack_builders;
+    pack_builders.reserve(outputs.size());
+    for (size_t o = 0; o < outputs.size(); o++) {
+        pack_builders.emplace_back(frame_indices.size(), pool);
+    }
+    this->decode_frames(frame_indices, outputs, [&pack_builders](avfilter_graph &fg, size_t i) {
+        for (size_t o = 0; o < pack_builders.size(); o++) {
+            pack_builders[o].copy_from_frame(fg.output(o), i);
+        }
+    });
+    std::vector<video_dlpack::ptr> results;
+    results.reserve(pack_builders.size());
+    for (auto &builder : pack_builders) {
+        results.push_back(builder.result());
+    }
+    return results;
+}
 
-void video::wake_up() { this->format.wake_up(); }
+std::vector<video_dlpack::ptr>
+video::get_batches(const std::vector<std::vector<size_t>> &frame_indices, dlpack_pool *pool) {
+    VIDEOLOADER_STAGE_TIMER(get_batch);
+    this->wake_up();
+
+    // Decode frames of all batches as one request, each requested frame is copied to its slot.
+    std::vector<size_t> all_indices;
+    std::vector<std::pair<size_t, size_t>> slots;
+    std::vector<video_dlpack_builder> pack_builders;
+    pack_builders.reserve(frame_indices.size());
+    for (size_t b = 0; b < frame_indices.size(); b++) {
+        if (frame_indices[b].empty()) {
+            throw std::invalid_argument("Each batch should have at least one frame");
+        }
+        check_frame_indices(frame_indices[b]);
+        for (size_t i = 0; i < frame_indices[b].size(); i++) {
+            all_indices.push_back(frame_indices[b][i]);
+            slots.emplace_back(b, i);
+        }
+        pack_builders.emplace_back(frame_indices[b].size(), pool);
+    }
+
+    this->decode_frames(all_indices, {output_spec{}}, [&](avfilter_graph &fg, size_t i) {
+        auto [b, slot] = slots[i];
+        pack_builders[b].copy_from_frame(fg.output(0), slot);
+    });
+    std::vector<video_dlpack::ptr> results;
+    results.reserve(pack_builders.size());
+    for (auto &builder : pack_builders) {
+        results.push_back(builder.result());
+    }
+    return results;
+}
+
+struct frame_reader::state {
+    ffavcodec_context_ptr decode_context;
+    std::optional<avfilter_graph> fg;
+    avpacket_ptr packet = new_avpacket();
+    avframe_ptr frame = new_avframe();
+    /** End of stream is sent to the decoder */
+    bool flushed = false;
+};
+
+frame_reader::frame_reader(video &v, size_t start_frame, size_t chunk_size)
+    : v(&v), chunk_size(chunk_size), s(std::make_unique<state>()) {
+    if (chunk_size == 0) {
+        throw std::logic_error("chunk_size should be greater than 0");
+    }
+    v.wake_up();
+    stage_timer decoder_init_timer(stage::decoder_init);
+    s->decode_context = new_avcodec_context(v.decoder);
+    CHECK_AV(avcodec_parameters_to_context(s->decode_context.get(), v.current_stream().codecpar),
+             "failed to set codec parameters");
+    CHECK_AV(avcodec_open2(s->decode_context.get(), v.decoder, nullptr), "open decoder failed");
+    s->fg.emplace(*s->decode_context, v.current_stream().time_base);
+    decoder_init_timer.stop();
+    // Always seek first, the demuxer may be anywhere after other reads.
+    this->position = v.num_frames();
+    this->seek(start_frame);
+}
+
+frame_reader::frame_reader(frame_reader &&) noexcept = default;
+frame_reader &frame_reader::operator=(frame_reader &&) noexcept = default;
+frame_reader::~frame_reader() = default;
+
+void frame_reader::seek(size_t frame_index) {
+    auto &index = v->packet_index;
+    if (frame_index > index.size()) {
+        std::ostringstream msg;
+        msg << "Specified frame index " << frame_index << " is out of range";
+        throw std::out_of_range(msg.str());
+    }
+    if (frame_index >= position && position < index.size() && frame_index < index.size() &&
+        index[frame_index].key_frame_index == index[position].key_frame_index) {
+        // Frames before it are decoded and skipped by `next()`.
+        position = frame_index;
+        return;
+    }
+    position = frame_index;
+    if (frame_index == index.size()) {
+        return;
+    }
+    v->wake_up();
+    {
+        VIDEOLOADER_STAGE_TIMER(seek);
+        auto &key_frame = index[index[frame_index].key_frame_index];
+        CHECK_AV(av_seek_frame(v->format.format_context(), v->stream_index, key_frame.pts,
+                               AVSEEK_FLAG_BACKWARD),
+                 "failed to seek");
+    }
+    avcodec_flush_buffers(s->decode_context.get());
+    s->flushed = false;
+}
+
+void frame_reader::send_packet() {
+    if (s->flushed) {
+        throw std::runtime_error("Decoder finished before all indexed frames are decoded");
+    }
+    auto packet = s->packet.get();
+    while (true) {
+        int ret;
+        {
+            VIDEOLOADER_STAGE_TIMER(demux);
+            ret = av_read_frame(v->format.format_context(), packet);
+        }
+        if (ret == AVERROR_EOF) {
+            VIDEOLOADER_STAGE_TIMER(decode);
+            CHECK_AV(avcodec_send_packet(s->decode_context.get(), nullptr),
+                     "send packet to decoder failed");
+            s->flushed = true;
+            return;
+        }
+        CHECK_AV(ret, "read frame failed");
+        if (packet->stream_index == v->stream_index) {
+            break;
+        }
+        av_packet_unref(packet);
+    }
+    VIDEOLOADER_STAGE_TIMER(decode);
+    SPDLOG_TRACE("Send packet DTS {} PTS {}", packet->dts, packet->pts);
+    int ret = avcodec_send_packet(s->decode_context.get(), packet);
+    av_packet_unref(packet);
+    CHECK_AV(ret, "send packet to decoder failed");
+}
+
+video_dlpack::ptr frame_reader::next(dlpack_pool *pool) {
+    auto &index = v->packet_index;
+    if (position >= index.size()) {
+        return nullptr;
+    }
+    if (v->is_sleeping()) {
+        // The demuxer restarts after wake up.
+        auto resume = position;
+        position = index.size();
+        this->seek(resume);
+    }
+
+    auto num_frames = std::min(chunk_size, index.size() - position);
+    video_dlpack_builder pack_builder(num_frames, pool);
+    size_t filled = 0;
+    auto frame = s->frame.get();
+    while (filled < num_frames) {
+        stage_timer decode_timer(stage::decode);
+        int ret = avcodec_receive_frame(s->decode_context.get(), frame);
+        decode_timer.stop();
+        if (ret == AVERROR(EAGAIN)) {
+            this->send_packet();
+            continue;
+        }
+        if (ret == AVERROR_EOF) {
+            throw std::runtime_error("Decoder finished before all indexed frames are decoded");
+        }
+        CHECK_AV(ret, "receive frame from decoder failed");
+        SPDLOG_TRACE("Received frame PTS {}", frame->pts);
+        if (frame->pts < index[position].pts) {
+            continue; // Decoded from the key frame, before the requested one.
+        }
+        if (frame->pts != index[position].pts) {
+            std::ostringstream msg;
+            msg << "Frame " << position << " is not decoded, got PTS " << frame->pts
+                << " instead of " << index[position].pts;
+            throw std::runtime_error(msg.str());
+        }
+        stage_timer filter_timer(stage::filter);
+        auto filtered_frame = s->fg->process_frame(frame);
+        filter_timer.stop();
+        {
+            VIDEOLOADER_STAGE_TIMER(copy);
+            pack_builder.copy_from_frame(filtered_frame, filled);
+        }
+        av_frame_unref(filtered_frame);
+        filled++;
+        position++;
+    }
+    return pack_builder.result();
+}
+
+void video::sleep() {
+    this->format.sleep();
+    this->update_memory_account();
+}
+
+void video::wake_up() {
+    if (this->is_sleeping()) {
+        this->format.wake_up();
+        this->update_memory_account();
+    }
+}
+
+void video::update_memory_account() noexcept {
+    this->memory_account.update(
+        {
+            .index_bytes = packet_index.owned_bytes(),
+            .demuxer_bytes = format.demuxer_memory_usage(),
+            .io_buffer_bytes = format.io_buffer_size(),
+        },
+        this->is_sleeping());
+}
 
 bool video::is_sleeping() { return this->format.is_sleeping(); }
 
@@ -277,6 +613,10 @@ AVStream &video::current_stream() noexcept {
 
 AVRational video::average_frame_rate() noexcept { return this->current_stream().avg_frame_rate; }
 
+int video::width() noexcept { return this->current_stream().codecpar->width; }
+
+int video::height() noexcept { return this->current_stream().codecpar->height; }
+
 void init() {
 #if (LIBAVFORMAT_VERSION_INT < AV_VERSION_INT(58, 9, 100))
     av_register_all();
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <functional>
+#include <memory>
 #include <stdexcept>
 #include <string>
 #include <vector>
@@ -10,6 +12,7 @@ extern "C" {
 
 #include "avfilter_graph.h"
 #include "avformat.h"
+#include "memory_stats.h"
 #include "video_dlpack.h"
 
 namespace huww {
@@ -21,10 +24,51 @@ struct packet_index_entry {
     int64_t pts;
     int key_frame_index;
     int packet_index;
+    int64_t pos; /**< Byte offset of the packet in the input, -1 if unknown */
+    int size;    /**< Bytes of the packet */
 };
 
+/**
+ * Frame index of a video, either owned or a view of a buffer kept alive by `owner`, e.g. a mapped
+ * catalog. Videos opened from the same mapping, even in different processes, share its pages in
+ * page cache instead of each copying the index. Copies share the same entries.
+ */
+class shared_frame_index {
+    std::shared_ptr<const void> owner;
+    const packet_index_entry *entries = nullptr;
+    size_t count = 0;
+    size_t allocated_bytes = 0;
+
+  public:
+    shared_frame_index() = default;
+    /** Own the entries */
+    shared_frame_index(std::vector<packet_index_entry> entries) {
+        auto owned = std::make_shared<const std::vector<packet_index_entry>>(std::move(entries));
+        this->entries = owned->data();
+        this->count = owned->size();
+        this->allocated_bytes = owned->capacity() * sizeof(packet_index_entry);
+        this->owner = std::move(owned);
+    }
+    /** View `size` entries at `data`, without copying them. */
+    shared_frame_index(std::shared_ptr<const void> owner, const packet_index_entry *data,
+                       size_t size) noexcept
+        : owner(std::move(owner)), entries(data), count(size) {}
+
+    size_t size() const noexcept { return count; }
+    bool empty() const noexcept { return count == 0; }
+    const packet_index_entry &operator[](size_t i) const noexcept { return entries[i]; }
+    const packet_index_entry *begin() const noexcept { return entries; }
+    const packet_index_entry *end() const noexcept { return entries + count; }
+    /** Heap bytes of owned entries, 0 for a view */
+    size_t owned_bytes() const noexcept { return allocated_bytes; }
+};
+
+class frame_reader;
+
 class video {
   private:
+    friend class frame_reader;
+
     avformat format;
     AVCodec *decoder = nullptr;
     int stream_index = -1;
@@ -35,13 +79,28 @@ class video {
      * - It's not guaranteed to be presented.
      * - Whether the timestamp is PTS or DTS is not defined, it is internal to demuxer. mp4 use DTS
      */
-    std::vector<packet_index_entry> packet_index;
+    shared_frame_index packet_index;
+    video_memory_account memory_account;
 
     AVStream &current_stream() noexcept;
+    void update_memory_account() noexcept;
+    void check_frame_indices(const std::vector<size_t> &frame_indices) const;
+    /**
+     * Decode requested frames in one pass, seeking to each GOP at most once. `on_frame(fg, i)` is
+     * called when `fg` holds the outputs of `frame_indices[i]`, in PTS order.
+     */
+    void decode_frames(const std::vector<size_t> &frame_indices,
+                       const std::vector<output_spec> &outputs,
+                       const std::function<void(avfilter_graph &, size_t)> &on_frame);
 
   public:
     explicit video(std::string url);
     video(const file_io::file_spec &spec);
+    /**
+     * Open a video with an index previously built from the same file, see `frame_index()`. The
+     * file is not demuxed, only its header is read.
+     */
+    video(const file_io::file_spec &spec, int stream_index, shared_frame_index frame_index);
 
     /**
      * Indicate this video will not be read recently. Discard all buffer to save memory. Close IO
@@ -50,12 +109,86 @@ class video {
     void sleep();
     void wake_up();
     bool is_sleeping();
+    /** As of the last construction, `sleep()` or `wake_up()` */
+    const video_memory_usage &memory_usage() const noexcept { return memory_account.get(); }
 
     size_t num_frames() const noexcept { return packet_index.size(); }
+    int video_stream_index() const noexcept { return stream_index; }
+    /** Index of frames sorted by PTS, which can be saved to reopen this video faster. */
+    const shared_frame_index &frame_index() const noexcept { return packet_index; }
     AVRational average_frame_rate() noexcept;
+    int width() noexcept;
+    int height() noexcept;
+
+    /**
+     * Byte ranges of the file that `get_batch(frame_indices)` will read, for prefetching.
+     *
+     * Thread safe, can be called while another thread is reading this video.
+     */
+    std::vector<file_range> byte_ranges(const std::vector<size_t> &frame_indices) const;
+    /** Path and byte range of the whole video, e.g. its entry in a tar. Thread safe. */
+    file_range file_location() const;
+    /**
+     * Spec to reopen this video, e.g. with `frame_index()` in another process. Preloaded content
+     * and opened descriptors are not included. Thread safe.
+     */
+    file_io::file_spec reopen_spec() const;
 
     video_dlpack::ptr get_batch(const std::vector<std::size_t> &frame_indices,
                                 dlpack_pool *pool = nullptr);
+    /**
+     * One tensor per output spec, e.g. the same frames at several resolutions. Each frame is
+     * decoded once and converted to every output from the decoded frame, not from another output.
+     *
+     * \throw std::invalid_argument if `outputs` is empty or has an unsupported pixel format.
+     */
+    std::vector<video_dlpack::ptr> get_batch(const std::vector<std::size_t> &frame_indices,
+                                             const std::vector<output_spec> &outputs,
+                                             dlpack_pool *pool = nullptr);
+    /**
+     * One tensor per batch of frame indices, e.g. several clips of a video. Frames of all batches
+     * are decoded in one pass, so GOPs shared by batches are decoded once, and frames shared by
+     * batches are copied to each of them.
+     *
+     * \throw std::invalid_argument if a batch is empty.
+     */
+    std::vector<video_dlpack::ptr>
+    get_batches(const std::vector<std::vector<size_t>> &frame_indices, dlpack_pool *pool = nullptr);
+};
+
+/**
+ * Decode consecutive frames of a video in display order, a chunk at a time.
+ *
+ * The decoder and filter graph are kept between chunks, so memory is bounded by one chunk and the
+ * decoder regardless of the video length, and the first chunk is ready after decoding at most one
+ * GOP. The video should not be read otherwise while reading, unless `seek()` is called after.
+ */
+class frame_reader {
+    struct state;
+    video *v;
+    size_t chunk_size;
+    size_t position = 0;
+    std::unique_ptr<state> s;
+
+    /** Send the next packet of the video stream to the decoder, or flush it at the end. */
+    void send_packet();
+
+  public:
+    /** \param chunk_size Max frames returned by each `next()`. */
+    frame_reader(video &v, size_t start_frame = 0, size_t chunk_size = 1);
+    frame_reader(frame_reader &&) noexcept;
+    frame_reader &operator=(frame_reader &&) noexcept;
+    ~frame_reader();
+
+    /** Up to `chunk_size` frames from `tell()`, null after the last frame. */
+    video_dlpack::ptr next(dlpack_pool *pool = nullptr);
+    /**
+     * Continue from `frame_index`, which may equal `num_frames()` to stop. Frames ahead in the same
+     * GOP are reached by decoding on, without seeking.
+     */
+    void seek(size_t frame_index);
+    /** Index of the next frame to be returned */
+    size_t tell() const noexcept { return position; }
 };
 
 } // namespace videoloader
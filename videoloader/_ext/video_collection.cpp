@@ -0,0 +1,147 @@
+#include "video_collection.h"
+
+#include <array>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+
+#include <spdlog/spdlog.h>
+
+namespace huww {
+namespace videoloader {
+
+/** Frame index file of many videos, see `frame_index_file.h`. */
+constexpr std::array<char, 8> video_collection_magic = {'V', 'L', 'V', 'I', 'D', 'C', 'O', 'L'};
+constexpr uint32_t video_collection_version = 2;
+
+/** `frame_index_file_record::flags` of a video collection */
+enum video_record_flags : uint32_t {
+    record_memory_map = 1,
+    record_direct_io = 2,
+};
+
+struct video_collection::mapping_cache {
+    std::mutex m;
+    std::unordered_map<std::string, std::weak_ptr<const mapped_file>> mappings;
+
+    std::shared_ptr<const mapped_file> get(const std::string &path) {
+        std::lock_guard lk(m);
+        auto &cached = mappings[path];
+        auto mapping = cached.lock();
+        if (!mapping) {
+            mapping = std::make_shared<const mapped_file>(path);
+            cached = mapping;
+        }
+        return mapping;
+    }
+};
+
+video_collection video_collection::from_buffer(std::shared_ptr<const void> owner,
+                                               const uint8_t *data, size_t size) {
+    video_collection collection;
+    try {
+        collection.file =
+            frame_index_file(data, size, video_collection_magic, video_collection_version);
+    } catch (std::invalid_argument &e) {
+        throw std::invalid_argument(std::string("Invalid video collection: ") + e.what());
+    }
+    for (size_t i = 0; i < collection.file.size(); i++) {
+        if (collection.file.record(i).stream_index < 0) {
+            throw std::invalid_argument("Invalid video collection: video without frame index");
+        }
+    }
+    collection.owner = std::move(owner);
+    collection.data = data;
+    collection.data_size = size;
+    collection.mappings = std::make_shared<mapping_cache>();
+    return collection;
+}
+
+video_collection video_collection::from_bytes(std::string bytes) {
+    // `std::string` storage is allocated by `operator new`, aligned for any fundamental type.
+    auto owner = std::make_shared<const std::string>(std::move(bytes));
+    auto data = reinterpret_cast<const uint8_t *>(owner->data());
+    auto size = owner->size();
+    return from_buffer(std::move(owner), data, size);
+}
+
+video_collection video_collection::map(const std::string &path) {
+    auto mapping = std::make_shared<const mapped_file>(path);
+    auto data = mapping->data();
+    auto size = mapping->size();
+    return from_buffer(std::move(mapping), data, size);
+}
+
+const frame_index_file_record &video_collection::record(size_t i) const {
+    if (i >= size()) {
+        throw std::out_of_range("video collection index out of range");
+    }
+    return file.record(i);
+}
+
+std::string video_collection::path(size_t i) const {
+    record(i); // Throws if out of range
+    return file.path(i);
+}
+
+size_t video_collection::num_frames(size_t i) const { return record(i).num_packets; }
+
+file_range video_collection::location(size_t i) const {
+    auto &r = record(i);
+    return {
+        .path = file.path(i),
+        .offset = r.start_pos,
+        .size = r.file_size,
+    };
+}
+
+video video_collection::open(size_t i) const {
+    auto &r = record(i);
+    file_io::file_spec spec{
+        .path = file.path(i),
+        .start_pos = r.start_pos,
+        .file_size = r.file_size,
+        .direct_io = (r.flags & record_direct_io) != 0,
+    };
+    if (r.flags & record_memory_map) {
+        spec.mapping = mappings->get(spec.path);
+    }
+    return video(spec, r.stream_index, file.frame_index(i, owner));
+}
+
+size_t video_collection_builder::add(const video &v) {
+    entries.push_back({
+        .spec = v.reopen_spec(),
+        .stream_index = v.video_stream_index(),
+        .frame_index = v.frame_index(),
+    });
+    return entries.size() - 1;
+}
+
+std::string video_collection_builder::build() const {
+    frame_index_file_builder builder(video_collection_magic, video_collection_version);
+    for (auto &e : entries) {
+        uint32_t flags = 0;
+        if (e.spec.mapping) {
+            flags |= record_memory_map;
+        } else if (e.spec.direct_io) {
+            flags |= record_direct_io;
+        }
+        frame_index_file_record record{
+            .stream_index = e.stream_index,
+            .start_pos = e.spec.start_pos,
+            .file_size = e.spec.file_size,
+            .flags = flags,
+        };
+        builder.add(record, e.spec.path, e.frame_index);
+    }
+    return builder.build();
+}
+
+void video_collection_builder::write(const std::string &path) const {
+    write_file_atomically(path, build());
+    SPDLOG_DEBUG("Wrote video collection \"{}\" with {} videos", path, entries.size());
+}
+
+} // namespace videoloader
+} // namespace huww
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "frame_index_file.h"
+#include "video.h"
+
+namespace huww {
+namespace videoloader {
+
+/**
+ * Metadata of many videos, i.e. how to reopen each of them and their frame indices, in one flat
+ * buffer.
+ *
+ * Compared to a list of `video`, it has no per-video heap allocation, so it is cheap to pickle,
+ * to send to worker processes and to share across `fork()` without touching many pages. Videos are
+ * opened on demand by `open()`, reading only their headers.
+ *
+ * The buffer is in native byte order, it is rejected by hosts with another byte order.
+ */
+class video_collection {
+    struct mapping_cache;
+
+    /** Keeps `data` alive */
+    std::shared_ptr<const void> owner;
+    const uint8_t *data = nullptr;
+    size_t data_size = 0;
+    frame_index_file file;
+    std::shared_ptr<mapping_cache> mappings;
+
+    video_collection() = default;
+    const frame_index_file_record &record(size_t i) const;
+
+  public:
+    /**
+     * Use a buffer written by `video_collection_builder`, without copying it.
+     *
+     * \param owner Keeps `data` alive as long as the collection or any copy of it.
+     * \throw std::invalid_argument if the buffer is truncated or in another format.
+     */
+    static video_collection from_buffer(std::shared_ptr<const void> owner, const uint8_t *data,
+                                        size_t size);
+    static video_collection from_bytes(std::string bytes);
+    /**
+     * Map a catalog file written by `video_collection_builder::write()`. Processes mapping the same
+     * file share its pages in page cache, instead of each keeping a copy of every frame index.
+     */
+    static video_collection map(const std::string &path);
+
+    /** The whole buffer, which can be passed to `from_bytes()` in another process. */
+    std::string_view bytes() const noexcept {
+        return {reinterpret_cast<const char *>(data), data_size};
+    }
+    size_t size() const noexcept { return file.size(); }
+    std::string path(size_t i) const;
+    size_t num_frames(size_t i) const;
+    /** Byte range of the i-th video in its file, e.g. its entry in a tar. */
+    file_range location(size_t i) const;
+
+    /**
+     * Open the i-th video without demuxing it. Its frame index is read in place from the buffer,
+     * which it keeps alive. Videos of the same file opened with memory mapping share one mapping,
+     * as long as any of them is alive.
+     */
+    video open(size_t i) const;
+};
+
+/** Collect videos into a `video_collection`. */
+class video_collection_builder {
+    struct entry {
+        file_io::file_spec spec;
+        int stream_index;
+        shared_frame_index frame_index;
+    };
+    std::vector<entry> entries;
+
+  public:
+    /** Add a video, its position in the collection is returned. */
+    size_t add(const video &v);
+    size_t size() const noexcept { return entries.size(); }
+    std::string build() const;
+    /** Atomically replace the file at `path` with the built collection. */
+    void write(const std::string &path) const;
+};
+
+} // namespace videoloader
+} // namespace huww
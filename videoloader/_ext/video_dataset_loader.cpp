@@ -1,12 +1,18 @@
 #include "video_dataset_loader.h"
 
+#include <algorithm>
 #include <atomic>
 #include <chrono>
+#include <iterator>
 
 #include <assert.h>
 #include <pthread.h>
 #include <spdlog/spdlog.h>
 
+#include "memory_stats.h"
+#include "stage_stats.h"
+#include "trace.h"
+
 namespace huww {
 
 #if defined __linux__
@@ -67,42 +73,70 @@ auto speed_estimator::speed() -> duration_t {
 class batch_output_buffer {
     std::vector<video_dlpack::ptr> buffer;
     std::atomic<size_t> num_filled = 0;
+    /** Guarded by `full_cv_m`. Matches no batch until the first `reset()`. */
+    size_t batch_index = std::numeric_limits<size_t>::max();
+    size_t _predicted_bytes = 0;
+    int64_t _predicted_decode_ns = 0;
     std::condition_variable full_cv;
     std::mutex full_cv_m;
 
   public:
-    explicit batch_output_buffer(int num_videos) : buffer(num_videos) {}
     bool full() { return num_filled.load(std::memory_order_acquire) == buffer.size(); }
-    void wait_until_full() {
-        if (full()) {
-            return;
+
+    /** Reuse this buffer for batch `batch_index`. Previous data should have been transferred. */
+    void reset(size_t batch_index, size_t num_videos) {
+        {
+            std::lock_guard lk(full_cv_m);
+            this->batch_index = batch_index;
+            buffer.clear();
+            buffer.resize(num_videos);
+            num_filled.store(0, std::memory_order_relaxed);
+            _predicted_bytes = 0;
+            _predicted_decode_ns = 0;
+        }
+        if (num_videos == 0) {
+            full_cv.notify_all();
         }
+    }
+
+    /**
+     * Wait until batch `batch_index` is fully loaded into this buffer.
+     *
+     * \return false if `no_more_batch()` becomes true first.
+     */
+    template <typename Pred> bool wait_until_full(size_t batch_index, Pred no_more_batch) {
         std::unique_lock lk(full_cv_m);
-        full_cv.wait(lk, [this] { return this->full(); });
+        full_cv.wait(lk, [&] {
+            return (this->batch_index == batch_index && this->full()) || no_more_batch();
+        });
+        return this->batch_index == batch_index && this->full();
     }
+
+    /** Wake up the consumer to re-check its condition. */
+    void notify() {
+        { std::lock_guard lk(full_cv_m); }
+        full_cv.notify_all();
+    }
+
     void add(int index, video_dlpack::ptr &&data) {
         assert(!buffer[index]);
         buffer[index] = std::move(data);
         auto previous_filled = num_filled.fetch_add(1, std::memory_order_release);
         if (previous_filled + 1 == buffer.size()) {
-            {
-                std::lock_guard lk(full_cv_m);
-            }
-            full_cv.notify_all();
+            this->notify();
         }
     }
     std::vector<video_dlpack::ptr> transfer_data() { return std::move(this->buffer); }
     auto size() const noexcept { return this->buffer.size(); }
-};
 
-static std::vector<batch_output_buffer> init_output_buffer(const dataset_load_schedule &schedule) {
-    std::vector<size_t> batch_sizes;
-    batch_sizes.reserve(schedule.size());
-    for (auto &s : schedule) {
-        batch_sizes.push_back(s.size());
+    /** Record the predicted cost of one video in this batch, before it is handed to a worker. */
+    void add_prediction(size_t bytes, int64_t decode_ns) {
+        _predicted_bytes += bytes;
+        _predicted_decode_ns += decode_ns;
     }
-    return std::vector<batch_output_buffer>(batch_sizes.begin(), batch_sizes.end());
-}
+    auto predicted_bytes() const noexcept { return _predicted_bytes; }
+    auto predicted_decode_ns() const noexcept { return _predicted_decode_ns; }
+};
 
 struct load_task {
     dataset_load_schedule_detail::video video;
@@ -110,44 +144,102 @@ struct load_task {
     size_t video_index;
 };
 
-static std::vector<load_task> init_load_task(const dataset_load_schedule &schedule) {
-    int num_tasks = 0;
-    for (auto &s : schedule) {
-        num_tasks += s.size();
-    }
-    std::vector<load_task> tasks;
-    tasks.reserve(num_tasks);
-    for (size_t i = 0; i < schedule.size(); i++) {
-        auto &s = schedule[i];
-        for (size_t j = 0; j < s.size(); j++) {
-            tasks.push_back({
-                .video = s[j],
-                .batch_index = i,
-                .video_index = j,
-            });
+static dataset_batch_producer schedule_producer(const dataset_load_schedule &schedule) {
+    return [schedule, next = size_t(0)]() mutable -> std::optional<dataset_load_batch> {
+        if (next >= schedule.size()) {
+            return std::nullopt;
         }
-    }
-    return tasks;
+        return std::move(schedule[next++]);
+    };
 }
 
 video_dataset_loader::video_dataset_loader(const dataset_load_schedule &schedule)
-    : output_buffer(init_output_buffer(schedule)), load_tasks(init_load_task(schedule)),
-      consume_speed(10s) {}
+    : video_dataset_loader(schedule_producer(schedule),
+                           std::clamp(schedule.size(), size_t(1), default_max_preload)) {}
+
+video_dataset_loader::video_dataset_loader(dataset_batch_producer producer,
+                                           size_t preload_batches)
+    : producer(std::move(producer)), consume_speed(10s) {
+    if (preload_batches == 0) {
+        throw std::logic_error("preload_batches should be greater than 0");
+    }
+    this->output_buffer = std::vector<batch_output_buffer>(preload_batches);
+}
+
+video_dataset_loader::video_dataset_loader(bounded_queue<dataset_load_batch> &queue,
+                                           size_t preload_batches)
+    : video_dataset_loader([&queue] { return queue.pop(); }, preload_batches) {}
 
 video_dataset_loader::~video_dataset_loader() {
     if (this->running) {
         this->stop();
     }
+    memory_detail::add_loader_preload_bytes(
+        -static_cast<ptrdiff_t>(this->preload_bytes.load(std::memory_order_relaxed)));
 };
 
 struct video_dataset_loader::worker {
     std::thread thread;
     std::condition_variable active_cv;
     speed_estimator speed;
+    speed_estimator frame_speed; /**< Decode time per frame */
 
-    worker() : speed(3s) {}
+    worker() : speed(3s), frame_speed(3s) {}
 };
 
+class video_dataset_loader::video_lock {
+    video_dataset_loader &loader;
+    const video *v;
+
+  public:
+    /** Wait until no other worker is loading `v`. */
+    video_lock(video_dataset_loader &loader, const video &v) : loader(loader), v(&v) {
+        std::unique_lock lk(loader.loading_videos_m);
+        loader.loading_videos_cv.wait(
+            lk, [this] { return !this->loader.loading_videos.count(this->v); });
+        loader.loading_videos.insert(this->v);
+    }
+    ~video_lock() {
+        {
+            std::lock_guard lk(this->loader.loading_videos_m);
+            this->loader.loading_videos.erase(this->v);
+        }
+        this->loader.loading_videos_cv.notify_all();
+    }
+    video_lock(const video_lock &) = delete;
+    video_lock &operator=(const video_lock &) = delete;
+};
+
+void video_dataset_loader::set_preload_limits(const preload_limits &limits) {
+    if (this->running.load(std::memory_order_relaxed)) {
+        throw std::logic_error("Cannot change preload limits while running");
+    }
+    if (limits.max_clips == 0) {
+        throw std::logic_error("max_clips should be greater than 0");
+    }
+    this->limits = limits;
+}
+
+void video_dataset_loader::set_prefetcher(std::shared_ptr<prefetcher> prefetcher) {
+    if (this->is_running()) {
+        throw std::logic_error("Cannot change prefetcher while running");
+    }
+    this->batch_prefetcher = std::move(prefetcher);
+}
+
+void video_dataset_loader::prefetch_current_batch() {
+    std::vector<file_range> ranges;
+    for (auto &video : *this->current_batch) {
+        try {
+            auto video_ranges = video.byte_ranges();
+            std::move(video_ranges.begin(), video_ranges.end(), std::back_inserter(ranges));
+        } catch (std::exception &) {
+            // Invalid clip, its error will be reported by the worker loading it.
+        }
+    }
+    this->batch_prefetcher->prefetch(std::move(ranges));
+}
+
 void video_dataset_loader::start(int max_threads) {
     if (this->running.exchange(true, std::memory_order_relaxed)) {
         throw std::logic_error("This loader is already running");
@@ -176,6 +268,8 @@ void video_dataset_loader::stop() {
     for (auto &w : this->workers) {
         w.active_cv.notify_one();
     }
+    { std::lock_guard lk(this->slot_free_m); }
+    this->slot_free_cv.notify_all();
 
     for (auto &w : this->workers) {
         w.thread.join();
@@ -183,13 +277,47 @@ void video_dataset_loader::stop() {
     this->workers.clear();
 }
 
+/**
+ * How many more videos can be loaded before hitting `limit`, assume they cost the same as the
+ * average of `preloaded` videos.
+ */
+static size_t remaining_preload(size_t preloaded, double used, double limit) {
+    if (used >= limit) {
+        return 0;
+    }
+    if (preloaded == 0 || used <= 0) {
+        return std::numeric_limits<size_t>::max();
+    }
+    return static_cast<size_t>(std::ceil((limit - used) * preloaded / used));
+}
+
 int video_dataset_loader::calc_needed_workers() {
     int active_worker_count = this->active_worker_count.load(std::memory_order_relaxed);
 
     auto consumed = this->consumed.load(std::memory_order_relaxed);
     auto loaded = this->next_task_index.load(std::memory_order_relaxed);
-    auto can_load = this->max_preload - (loaded - consumed);
-    if (can_load <= 0) {
+    size_t preloaded = loaded - consumed;
+    size_t can_load = remaining_preload(preloaded, preloaded, limits.max_clips);
+    if (limits.max_bytes > 0) {
+        can_load = std::min(can_load,
+                            remaining_preload(preloaded,
+                                              this->preload_bytes.load(std::memory_order_relaxed),
+                                              limits.max_bytes));
+    }
+    if (limits.max_decode_time.count() > 0) {
+        std::chrono::duration<double> decode_time =
+            std::chrono::nanoseconds(this->preload_decode_ns.load(std::memory_order_relaxed));
+        can_load = std::min(can_load, remaining_preload(preloaded, decode_time.count(),
+                                                        limits.max_decode_time.count()));
+    }
+    if (can_load == 0) {
+        if (this->num_fully_fetched_batches.load(std::memory_order_relaxed) <=
+            this->num_consumed_batches.load(std::memory_order_relaxed)) {
+            // The batch to be consumed next is larger than the limit. Keep loading it, or the
+            // consumer will wait forever.
+            SPDLOG_DEBUG("Hit max preload limit, but next batch is incomplete");
+            return 1;
+        }
         // Hit max preload limit, pause all workers.
         SPDLOG_DEBUG("Hit max preload limit");
         return 0;
@@ -226,7 +354,8 @@ int video_dataset_loader::calc_needed_workers() {
     // We want load speed slightly faster than comsume.
     int new_active_worker_count = static_cast<int>(std::ceil(load_speed / (consume_speed * 0.95)));
     // Don't overshoot preload limit too much.
-    new_active_worker_count = std::min(new_active_worker_count, (int)can_load);
+    new_active_worker_count =
+        static_cast<int>(std::min<size_t>(new_active_worker_count, can_load));
     new_active_worker_count = std::min(new_active_worker_count, (int)workers.size());
     SPDLOG_DEBUG("Scheduling workers. consume speed: {:.3f} ms; load speed: {:.3f} ms; workers: {}",
                  consume_speed.count(), load_speed.count(), new_active_worker_count);
@@ -236,33 +365,174 @@ int video_dataset_loader::calc_needed_workers() {
 void video_dataset_loader::schedule_workers() {
     int new_active_worker_count = this->calc_needed_workers();
     this->active_worker_count.store(new_active_worker_count, std::memory_order_relaxed);
+    if (trace_enabled()) {
+        trace_counter("active_workers", new_active_worker_count);
+        trace_counter("preloaded_clips", this->next_task_index.load(std::memory_order_relaxed) -
+                                             this->consumed.load(std::memory_order_relaxed));
+        trace_counter("preload_bytes", this->preload_bytes.load(std::memory_order_relaxed));
+    }
     { std::lock_guard lk(this->active_worker_m); }
     for (int i = 0; i < new_active_worker_count; i++) {
         workers[i].active_cv.notify_one();
     }
 }
 
+loader_status video_dataset_loader::status() const noexcept {
+    auto consumed = this->consumed.load(std::memory_order_relaxed);
+    auto loaded = this->next_task_index.load(std::memory_order_relaxed);
+    return {
+        .active_workers = this->active_worker_count.load(std::memory_order_relaxed),
+        .preloaded_clips = loaded > consumed ? loaded - consumed : 0,
+        .preload_bytes = this->preload_bytes.load(std::memory_order_relaxed),
+        .consumed_batches = this->num_consumed_batches.load(std::memory_order_relaxed),
+    };
+}
+
+std::chrono::duration<double> video_dataset_loader::predict_decode_time(size_t num_frames) {
+    speed_estimator::duration_t frame_speed{};
+    int num_estimated = 0;
+    for (auto &w : this->workers) {
+        auto s = w.frame_speed.speed();
+        if (!std::isnan(s.count())) {
+            frame_speed += s;
+            num_estimated++;
+        }
+    }
+    if (num_estimated == 0) {
+        return {}; // Not measured yet.
+    }
+    return frame_speed / num_estimated * num_frames;
+}
+
+void video_dataset_loader::notify_no_more_batch() {
+    for (auto &output : this->output_buffer) {
+        output.notify();
+    }
+}
+
+std::optional<load_task> video_dataset_loader::fetch_task() {
+    std::lock_guard lk(this->task_m);
+    while (!this->current_batch || this->next_video_index >= this->current_batch->size()) {
+        this->num_fully_fetched_batches.store(this->num_produced_batches,
+                                              std::memory_order_relaxed);
+        if (this->num_batches.load(std::memory_order_relaxed) <= this->num_produced_batches) {
+            return std::nullopt;
+        }
+        auto batch_index = this->num_produced_batches;
+        {
+            std::unique_lock slot_lk(this->slot_free_m);
+            this->slot_free_cv.wait(slot_lk, [this, batch_index] {
+                return !this->running.load(std::memory_order_relaxed) ||
+                       batch_index < this->num_consumed_batches.load(std::memory_order_relaxed) +
+                                         this->output_buffer.size();
+            });
+        }
+        if (!this->running.load(std::memory_order_relaxed)) {
+            return std::nullopt;
+        }
+
+        try {
+            this->current_batch = this->producer();
+        } catch (...) {
+            // Batches already produced can still be consumed.
+            this->worker_error = std::current_exception();
+            this->num_batches.store(batch_index, std::memory_order_relaxed);
+            this->notify_no_more_batch();
+            return std::nullopt;
+        }
+        if (!this->current_batch) {
+            SPDLOG_DEBUG("Producer exhausted after {} batches", batch_index);
+            this->num_batches.store(batch_index, std::memory_order_relaxed);
+            this->notify_no_more_batch();
+            return std::nullopt;
+        }
+        this->num_produced_batches++;
+        this->current_batch_index = batch_index;
+        this->next_video_index = 0;
+        this->output_buffer[batch_index % this->output_buffer.size()].reset(
+            batch_index, this->current_batch->size());
+        if (this->batch_prefetcher) {
+            this->prefetch_current_batch();
+        }
+    }
+
+    auto video_index = this->next_video_index++;
+    if (this->next_video_index == this->current_batch->size()) {
+        this->num_fully_fetched_batches.store(this->current_batch_index + 1,
+                                              std::memory_order_relaxed);
+    }
+    auto &video = (*this->current_batch)[video_index];
+    auto bytes = video.predicted_output_bytes();
+    auto decode_ns =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            this->predict_decode_time(video.frame_indices.size()))
+            .count();
+    this->output_buffer[this->current_batch_index % this->output_buffer.size()].add_prediction(
+        bytes, decode_ns);
+    this->preload_bytes.fetch_add(bytes, std::memory_order_relaxed);
+    memory_detail::add_loader_preload_bytes(bytes);
+    this->preload_decode_ns.fetch_add(decode_ns, std::memory_order_relaxed);
+    this->next_task_index.fetch_add(1, std::memory_order_relaxed);
+    return load_task{
+        .video = std::move(video),
+        .batch_index = this->current_batch_index,
+        .video_index = video_index,
+    };
+}
+
+void video_dataset_loader::set_worker_error(std::exception_ptr error, size_t batch_index) {
+    {
+        std::lock_guard lk(this->task_m);
+        if (batch_index >= this->num_batches.load(std::memory_order_relaxed)) {
+            return; // Only keep the earliest error.
+        }
+        this->worker_error = error;
+        this->num_batches.store(batch_index, std::memory_order_relaxed);
+    }
+    this->notify_no_more_batch();
+}
+
 void video_dataset_loader::load_worker_main(int worker_index) {
     auto &worker = this->workers[worker_index];
     dlpack_pool pool;
     while (this->running.load(std::memory_order_relaxed)) {
-        auto task_index = this->next_task_index.fetch_add(1, std::memory_order_relaxed);
-        if (task_index >= this->load_tasks.size()) {
+        auto next_task = this->fetch_task();
+        if (!next_task) {
             break;
         }
 
+        stage_timer task_timer(stage::load_task);
         worker.speed.start();
-        auto &task = this->load_tasks[task_index];
-        auto &output = this->output_buffer[task.batch_index];
-        output.add(task.video_index, task.video.get_batch(&pool));
-        task.video.video.sleep();
+        worker.frame_speed.start();
+        auto &task = *next_task;
+        auto &output = this->output_buffer[task.batch_index % this->output_buffer.size()];
+        {
+            // Released before pausing, so a paused worker never blocks others on its video.
+            video_lock lock(*this, task.video.video);
+            try {
+                output.add(task.video_index, task.video.get_batch(&pool));
+                task.video.video.sleep();
+            } catch (...) {
+                this->set_worker_error(std::current_exception(), task.batch_index);
+                // Release its descriptor and decoder buffers as after a successful load.
+                try {
+                    task.video.video.sleep();
+                } catch (std::exception &e) {
+                    SPDLOG_WARN("Failed to sleep video after error: {}", e.what());
+                }
+                break;
+            }
+        }
         worker.speed.finish(1);
+        worker.frame_speed.finish(task.video.frame_indices.size());
+        task_timer.stop();
 
         this->schedule_workers();
         auto is_active = [this, worker_index] {
             return this->active_worker_count.load(std::memory_order_relaxed) > worker_index;
         };
         if (!is_active()) {
+            VIDEOLOADER_STAGE_TIMER(worker_pause);
             std::unique_lock lk(this->active_worker_m);
             worker.active_cv.wait(lk, is_active);
         }
@@ -270,19 +540,43 @@ void video_dataset_loader::load_worker_main(int worker_index) {
 }
 
 std::vector<video_dlpack::ptr> video_dataset_loader::get_next_batch() {
-    auto batch_index = this->next_batch_index++;
-    if (batch_index >= this->output_buffer.size()) {
+    auto batch_index = this->next_batch_index;
+    auto no_more = [this, batch_index] {
+        return batch_index >= this->num_batches.load(std::memory_order_relaxed);
+    };
+    auto throw_no_more = [this] {
+        std::lock_guard lk(this->task_m);
+        if (this->worker_error) {
+            std::rethrow_exception(this->worker_error);
+        }
         throw no_more_batch();
+    };
+    if (no_more()) {
+        throw_no_more();
     }
     this->consume_speed.finish(last_batch_size);
 
-    auto &output = this->output_buffer[batch_index];
-    output.wait_until_full();
+    auto &output = this->output_buffer[batch_index % this->output_buffer.size()];
+    stage_timer wait_timer(stage::batch_wait);
+    if (!output.wait_until_full(batch_index, no_more)) {
+        throw_no_more();
+    }
+    wait_timer.stop();
+    this->next_batch_index++;
+    this->preload_bytes.fetch_sub(output.predicted_bytes(), std::memory_order_relaxed);
+    memory_detail::add_loader_preload_bytes(-static_cast<ptrdiff_t>(output.predicted_bytes()));
+    this->preload_decode_ns.fetch_sub(output.predicted_decode_ns(), std::memory_order_relaxed);
     this->consumed.fetch_add(output.size(), std::memory_order_relaxed);
     this->schedule_workers(); // should goes after `consumed` updated
 
     this->last_batch_size = output.size();
     auto loaded_batch = output.transfer_data();
+
+    // Release the output slot for a new batch.
+    this->num_consumed_batches.fetch_add(1, std::memory_order_relaxed);
+    { std::lock_guard lk(this->slot_free_m); }
+    this->slot_free_cv.notify_all();
+
     this->consume_speed.start();
     return loaded_batch;
 }
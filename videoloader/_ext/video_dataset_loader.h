@@ -1,12 +1,18 @@
 #pragma once
 
+#include "bounded_queue.h"
+#include "prefetcher.h"
 #include "video.h"
 #include <atomic>
 #include <chrono>
 #include <condition_variable>
 #include <deque>
+#include <exception>
+#include <functional>
+#include <limits>
 #include <optional>
 #include <thread>
+#include <unordered_set>
 #include <vector>
 
 namespace huww {
@@ -26,16 +32,57 @@ struct video {
     std::optional<scale_schedule> scale;
 
     auto get_batch(dlpack_pool *pool = nullptr) { return video.get_batch(frame_indices, pool); }
+
+    auto byte_ranges() const { return video.byte_ranges(frame_indices); }
+
+    /** Size of the RGB24 output, ignoring row padding. */
+    size_t predicted_output_bytes() const {
+        return frame_indices.size() * size_t(video.width()) * size_t(video.height()) * 3;
+    }
 };
 using batch = std::vector<video>;
 using schedule = std::vector<batch>;
 }; // namespace dataset_load_schedule_detail
 using dataset_load_schedule = dataset_load_schedule_detail::schedule;
+using dataset_load_batch = dataset_load_schedule_detail::batch;
+
+/**
+ * Produce the next batch to load, return `std::nullopt` when there is no more batch.
+ *
+ * Called from worker threads, but never concurrently. May block.
+ */
+using dataset_batch_producer = std::function<std::optional<dataset_load_batch>()>;
 
 class video_batch_dlpack {};
+
+/**
+ * Limit how much data is loaded ahead of `video_dataset_loader::get_next_batch()`.
+ *
+ * Workers are paused when any limit is hit, and resumed when the consumer catches up.
+ */
+struct preload_limits {
+    size_t max_clips = 512;
+    /** Predicted bytes of decoded output. 0 for unlimited. */
+    size_t max_bytes = 0;
+    /**
+     * Predicted time to decode all preloaded clips, based on measured per-frame decode time. 0 for
+     * unlimited.
+     */
+    std::chrono::duration<double> max_decode_time{0};
+};
 class batch_output_buffer;
 struct load_task;
 
+/** Scheduling state of `video_dataset_loader`, for monitoring. */
+struct loader_status {
+    int active_workers;
+    /** Clips handed out to workers but not yet consumed */
+    size_t preloaded_clips;
+    /** Predicted output bytes of preloaded clips */
+    size_t preload_bytes;
+    size_t consumed_batches;
+};
+
 /**
  * Estimate how fast an event happens.
  * 
@@ -72,9 +119,25 @@ class speed_estimator {
 };
 
 class video_dataset_loader {
+    /** Ring of output buffers. Batch `i` goes to `output_buffer[i % output_buffer.size()]` */
     std::vector<batch_output_buffer> output_buffer;
-    std::vector<load_task> load_tasks;
-    std::atomic<size_t> next_task_index = 0;
+
+    dataset_batch_producer producer;
+    std::mutex task_m; /**< Guards `producer` and the current batch below */
+    std::optional<dataset_load_batch> current_batch;
+    size_t current_batch_index = 0;
+    size_t next_video_index = 0;
+    size_t num_produced_batches = 0;
+    /** Total number of batches, known after `producer` exhausted. */
+    std::atomic<size_t> num_batches = std::numeric_limits<size_t>::max();
+
+    std::mutex slot_free_m;
+    std::condition_variable slot_free_cv;
+    std::atomic<size_t> num_consumed_batches = 0;
+    /** Number of batches whose videos are all handed out to workers */
+    std::atomic<size_t> num_fully_fetched_batches = 0;
+
+    std::atomic<size_t> next_task_index = 0; /**< Number of tasks handed out to workers */
     std::atomic<bool> running = false;
 
     std::atomic<int> active_worker_count = 0;
@@ -82,11 +145,29 @@ class video_dataset_loader {
     struct worker;
     std::vector<worker> workers;
 
+    std::mutex loading_videos_m;
+    std::condition_variable loading_videos_cv;
+    /**
+     * Videos being loaded by workers, guarded by `loading_videos_m`. A video can not be read from
+     * multiple threads, but its clips may be in batches loaded at the same time.
+     */
+    std::unordered_set<const video *> loading_videos;
+    /** Hold a video in `loading_videos` while a worker loads it. */
+    class video_lock;
+
     using clock_t = std::chrono::steady_clock;
     clock_t::time_point start_time;
     clock_t::duration warmup_duration = std::chrono::seconds(1);
-    size_t max_preload = 512;
+    static constexpr size_t default_max_preload = preload_limits().max_clips;
+    preload_limits limits;
     std::atomic<size_t> consumed = 0; /**< Number of videos comsumed by `get_next_batch()` */
+    /** Predicted output size of videos handed out but not yet comsumed */
+    std::atomic<size_t> preload_bytes = 0;
+    /** Predicted decode time (in nanoseconds) of videos handed out but not yet comsumed */
+    std::atomic<int64_t> preload_decode_ns = 0;
+
+    std::exception_ptr worker_error; /**< Guarded by `task_m` */
+    std::shared_ptr<prefetcher> batch_prefetcher;
 
     size_t next_batch_index = 0;
     size_t last_batch_size = 0;
@@ -95,6 +176,22 @@ class video_dataset_loader {
     /** Main entrypoint of worker threads. */
     void load_worker_main(int worker_index);
 
+    /**
+     * Take the next video to load, pulling a new batch from `producer` if needed.
+     *
+     * Will block until the output buffer slot of the new batch is consumed.
+     */
+    std::optional<load_task> fetch_task();
+    void notify_no_more_batch();
+    /** Submit byte ranges of all clips in `current_batch` to `batch_prefetcher`. */
+    void prefetch_current_batch();
+    /**
+     * Batch `batch_index` failed to load. Batches before it are still delivered, then
+     * `get_next_batch()` will rethrow this error.
+     */
+    void set_worker_error(std::exception_ptr error, size_t batch_index);
+    std::chrono::duration<double> predict_decode_time(size_t num_frames);
+
     /**
      * Determine the number of active workers
      *
@@ -113,8 +210,34 @@ class video_dataset_loader {
     };
 
     video_dataset_loader(const dataset_load_schedule &schedule);
+
+    /**
+     * Load batches produced on demand, for unbounded or very large epochs.
+     *
+     * At most `preload_batches` batches are held at a time, output buffers are recycled.
+     */
+    video_dataset_loader(dataset_batch_producer producer, size_t preload_batches);
+
+    /**
+     * Load batches pushed to `queue`. Close `queue` to end the epoch.
+     *
+     * \note `stop()` will wait for workers blocked on an empty `queue`.
+     */
+    video_dataset_loader(bounded_queue<dataset_load_batch> &queue, size_t preload_batches);
+
     ~video_dataset_loader();
     void start(int max_threads);
+    bool is_running() const noexcept { return this->running.load(std::memory_order_relaxed); }
+
+    /** Can only be called when not running */
+    void set_preload_limits(const preload_limits &limits);
+    const preload_limits &get_preload_limits() const noexcept { return this->limits; }
+
+    /**
+     * Read byte ranges of every batch ahead with `prefetcher` once the batch is taken by workers.
+     * nullptr to disable. Can only be called when not running.
+     */
+    void set_prefetcher(std::shared_ptr<prefetcher> prefetcher);
 
     /**
      * Join all worker threads
@@ -129,9 +252,13 @@ class video_dataset_loader {
      * Get next batch of data
      *
      * Will block until at least one batch of data avaliable. Can only used in one thread.
+     * If a batch failed to load, the error is rethrown here when that batch is reached.
      */
     std::vector<video_dlpack::ptr> get_next_batch();
 
+    /** Thread safe, cheap enough to be sampled frequently. */
+    loader_status status() const noexcept;
+
     /** Not implemented yet */
     video_batch_dlpack get_next_scaled_batch();
 };
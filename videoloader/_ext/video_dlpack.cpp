@@ -4,6 +4,9 @@
 #include <assert.h>
 #include <spdlog/spdlog.h>
 
+#include "av_utils.h"
+#include "memory_stats.h"
+
 namespace huww {
 namespace videoloader {
 
@@ -12,7 +15,6 @@ video_dlpack_builder::video_dlpack_builder(int num_frames, dlpack_pool *pool)
 
 void video_dlpack_builder::copy_from_frame(AVFrame *frame, int index) {
     assert(index < num_frames);
-    assert(frame->format == AVPixelFormat::AV_PIX_FMT_RGB24);
     auto linesize = frame->linesize[0];
     auto frame_size = linesize * frame->height;
 
@@ -23,8 +25,9 @@ void video_dlpack_builder::copy_from_frame(AVFrame *frame, int index) {
         } else {
             dlpack = video_dlpack::alloc(size);
         }
-        std::array<int64_t, 4> shape = {num_frames, frame->width, frame->height, 3};
-        std::array<int64_t, 4> strides = {frame_size, 3, linesize, 1};
+        int64_t channels = packed_pixel_size(static_cast<AVPixelFormat>(frame->format));
+        std::array<int64_t, 4> shape = {num_frames, frame->width, frame->height, channels};
+        std::array<int64_t, 4> strides = {frame_size, channels, linesize, 1};
         auto &dl = dlpack->dl_tensor;
         std::copy(shape.begin(), shape.end(), dl.shape);
         std::copy(strides.begin(), strides.end(), dl.strides);
@@ -33,39 +36,61 @@ void video_dlpack_builder::copy_from_frame(AVFrame *frame, int index) {
     assert(linesize == dl.strides[2]);
     assert(frame->width == dl.shape[1]);
     assert(frame->height == dl.shape[2]);
+    assert(packed_pixel_size(static_cast<AVPixelFormat>(frame->format)) == dl.shape[3]);
 
     auto dest = static_cast<uint8_t *>(dl.data) + frame_size * index;
     memcpy(dest, frame->data[0], frame_size);
 }
 
+/** Tensor, shape and strides allocated at once */
+struct video_dlpack_storage {
+    DLManagedTensor tensor;
+    int64_t shape[4];
+    int64_t strides[4];
+    size_t size;
+};
+
 auto video_dlpack::alloc(size_t size) -> video_dlpack::ptr {
-    return video_dlpack::ptr(new DLManagedTensor{
-        .dl_tensor =
+    auto storage = new video_dlpack_storage{
+        .tensor =
             {
-                .data = std::aligned_alloc(64, size),
-                .ctx = {.device_type = kDLCPU},
-                .ndim = 4, // frame, width, height, channel
-                .dtype =
+                .dl_tensor =
                     {
-                        .code = kDLUInt,
-                        .bits = 8,
-                        .lanes = 1,
+                        .data = std::aligned_alloc(64, size),
+                        .ctx = {.device_type = kDLCPU},
+                        .ndim = 4, // frame, width, height, channel
+                        .dtype =
+                            {
+                                .code = kDLUInt,
+                                .bits = 8,
+                                .lanes = 1,
+                            },
+                        .shape = nullptr,
+                        .strides = nullptr,
+                        .byte_offset = 0,
                     },
-                .shape = new int64_t[4],
-                .strides = new int64_t[4],
-                .byte_offset = 0,
+                .manager_ctx = nullptr,
+                .deleter = &video_dlpack::free,
             },
-        .manager_ctx = nullptr,
-        .deleter = &video_dlpack::free,
-    });
+        .shape = {},
+        .strides = {},
+        .size = size,
+    };
+    storage->tensor.dl_tensor.shape = storage->shape;
+    storage->tensor.dl_tensor.strides = storage->strides;
+    memory_detail::add_allocated_tensor_bytes(size);
+    return video_dlpack::ptr(&storage->tensor);
+}
+
+size_t video_dlpack::allocated_size(const DLManagedTensor *dlpack) noexcept {
+    return reinterpret_cast<const video_dlpack_storage *>(dlpack)->size;
 }
 
 void video_dlpack::free(DLManagedTensor *dlpack) {
-    auto &dl = dlpack->dl_tensor;
-    delete[] dl.shape;
-    delete[] dl.strides;
-    std::free(dl.data);
-    delete dlpack;
+    auto storage = reinterpret_cast<video_dlpack_storage *>(dlpack);
+    memory_detail::add_allocated_tensor_bytes(-static_cast<ptrdiff_t>(storage->size));
+    std::free(dlpack->dl_tensor.data);
+    delete storage;
 }
 
 struct pooled_dlpack_state {
@@ -117,7 +142,8 @@ dlpack_pool::~dlpack_pool() {
         std::lock_guard lk(context->m);
         context->pool_alive = false;
         context->pool = nullptr;
-        for (auto &[_, dlpack] : this->pool) {
+        for (auto &[size, dlpack] : this->pool) {
+            memory_detail::add_dlpack_pool_bytes(-static_cast<ptrdiff_t>(size));
             free_pooled_dlpack(dlpack);
         }
         delete_context = context->num_handed_out_pack == 0;
@@ -134,6 +160,7 @@ video_dlpack::ptr dlpack_pool::get(size_t size) {
     if (it != pool.end() && it->first < size * 2) {
         SPDLOG_TRACE("Reusing DLTensor of size {} for request of size {}", it->first, size);
         auto reused_tensor = it->second;
+        memory_detail::add_dlpack_pool_bytes(-static_cast<ptrdiff_t>(it->first));
         pool.erase(it);
         return video_dlpack::ptr(reused_tensor);
     }
@@ -156,6 +183,7 @@ void dlpack_pool::return_pack_internal(DLManagedTensor *dlpack) {
 
     auto it = pool.lower_bound(ctx->size);
     pool.insert(it, {ctx->size, dlpack});
+    memory_detail::add_dlpack_pool_bytes(ctx->size);
     SPDLOG_TRACE("Returned DLTensor of size {}", ctx->size);
 }
 
@@ -22,6 +22,8 @@ class video_dlpack {
     static void free(DLManagedTensor *);
     using ptr = std::unique_ptr<DLManagedTensor, dlpack_deleter>;
     static ptr alloc(size_t size);
+    /** \param dlpack Allocated by `alloc` */
+    static size_t allocated_size(const DLManagedTensor *dlpack) noexcept;
 };
 
 class dlpack_pool_context;
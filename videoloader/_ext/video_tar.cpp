@@ -1,5 +1,8 @@
 #include "video_tar.h"
 
+#include <pthread.h>
+#include <spdlog/spdlog.h>
+
 namespace huww {
 namespace videoloader {
 
@@ -11,5 +14,159 @@ std::vector<video> open_video_tar(std::string tar_path, int max_threads) {
     return open_video_tar(tar_path, [](const tar_entry &_) { return true; }, max_threads);
 }
 
+static size_t checked_max_threads(int max_threads) {
+    if (max_threads <= 0) {
+        throw std::logic_error("max_threads should be greater than 0");
+    }
+    return max_threads;
+}
+
+video_tar_stream::video_tar_stream(std::string tar_path, filter_type filter, int max_threads,
+                                   tar_options options, size_t max_pending)
+    : tar_path(std::move(tar_path)), filter(std::move(filter)), options(options),
+      tasks(checked_max_threads(max_threads)),
+      results(max_pending > 0 ? max_pending : 2 * checked_max_threads(max_threads)) {
+    SPDLOG_TRACE("Open tar file with max {} threads", max_threads);
+    // Shared by all workers, reading with explicit offset.
+    tar_spec = tar_file_spec(this->tar_path, options);
+    direct_pool = tar_direct_pool(tar_spec);
+    use_index = (options & tar_options::sidecar_index) != tar_options::none;
+    if (use_index) {
+        index = tar_index::open(this->tar_path);
+        if (!index) {
+            index_writer.emplace();
+            index_updated = true;
+        }
+    }
+
+    reader = std::thread([this] { this->read_main(); });
+    pthread_setname_np(reader.native_handle(), "vl_tar_read");
+    for (int i = 0; i < max_threads; i++) {
+        workers.emplace_back([this] { this->worker_main(); });
+        pthread_setname_np(workers.back().native_handle(), "vl_tar_open");
+    }
+}
+
+video_tar_stream::~video_tar_stream() { this->shutdown(); }
+
+bool video_tar_stream::submit(file_io::file_spec spec, size_t index_pos, bool indexed) {
+    open_task task{
+        .spec = std::move(spec),
+        .index_pos = index_pos,
+        .indexed = indexed,
+    };
+    // Queue the result first, so that `next()` waits for videos in tar order.
+    if (!results.push(task.result.get_future())) {
+        return false;
+    }
+    return tasks.push(std::move(task));
+}
+
+void video_tar_stream::read_main() {
+    try {
+        if (index) {
+            for (size_t i = 0; i < index->size(); i++) {
+                auto entry = index->entry(i);
+                if (!filter(entry)) {
+                    continue;
+                }
+                auto indexed = index->has_frame_index(i);
+                // Entries already indexed only need headers, not worth reading ahead.
+                auto spec = tar_entry_spec(tar_spec, entry, indexed ? nullptr : direct_pool.get());
+                if (!submit(std::move(spec), i, indexed)) {
+                    break; // Stopped
+                }
+            }
+        } else {
+            for (auto &entry : tar_iterator(tar_path, options)) {
+                if (entry.type() != huww::tar_entry_type::file) {
+                    continue;
+                }
+                size_t index_pos = 0;
+                if (use_index) {
+                    std::lock_guard lk(index_m);
+                    index_pos = index_writer->add_entry(entry);
+                }
+                if (!filter(entry)) {
+                    continue;
+                }
+                SPDLOG_TRACE("Processing entry {}", entry.path());
+                if (!direct_pool &&
+                    (options & tar_options::advise_sequential) != tar_options::none) {
+                    entry.prefetch_content();
+                }
+                if (!submit(tar_entry_spec(tar_spec, entry, direct_pool.get()), index_pos, false)) {
+                    break; // Stopped
+                }
+            }
+        }
+    } catch (...) {
+        std::promise<video> failed;
+        failed.set_exception(std::current_exception());
+        results.push(failed.get_future());
+    }
+    SPDLOG_TRACE("All tar entry processed.");
+    tasks.close();
+    results.close();
+}
+
+void video_tar_stream::worker_main() {
+    while (auto task = tasks.pop()) {
+        try {
+            auto v = task->indexed ? index->open_video(task->index_pos, task->spec)
+                                   : video(task->spec);
+            v.sleep();
+            if (!task->indexed && use_index) {
+                std::lock_guard lk(index_m);
+                if (!index_writer) {
+                    index_writer.emplace(*index);
+                }
+                index_writer->set_frame_index(task->index_pos, v);
+                index_updated = true;
+            }
+            task->result.set_value(std::move(v));
+        } catch (...) {
+            task->result.set_exception(std::current_exception());
+        }
+    }
+}
+
+std::optional<video> video_tar_stream::next() {
+    if (finished) {
+        return std::nullopt;
+    }
+    auto result = results.pop();
+    if (!result) {
+        this->shutdown();
+        std::lock_guard lk(index_m);
+        if (index_updated) {
+            index_writer->write(tar_path);
+        }
+        return std::nullopt;
+    }
+    try {
+        return result->get();
+    } catch (...) {
+        this->shutdown();
+        throw;
+    }
+}
+
+void video_tar_stream::stop() { this->shutdown(); }
+
+void video_tar_stream::shutdown() {
+    finished = true;
+    tasks.close();
+    results.close();
+    if (reader.joinable()) {
+        reader.join();
+    }
+    for (auto &w : workers) {
+        if (w.joinable()) {
+            w.join();
+        }
+    }
+}
+
 } // namespace videoloader
 } // namespace huww
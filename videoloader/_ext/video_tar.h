@@ -1,160 +1,214 @@
 #pragma once
 
-#include <atomic>
-#include <condition_variable>
-#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
 #include <optional>
 #include <string>
 #include <thread>
 #include <vector>
 
-#include <fcntl.h>
-#include <spdlog/spdlog.h>
-#include <unistd.h>
-
+#include "bounded_queue.h"
+#include "fd_cache.h"
+#include "tar_index.h"
 #include "tar_iterator.h"
 #include "video.h"
 
 namespace huww {
 namespace videoloader {
 
-template <typename Filter> std::vector<video> open_video_tar(std::string tar_path, Filter filter) {
+/** Max bytes of entries read ahead with O_DIRECT and not yet opened */
+constexpr size_t direct_scan_buffer_bytes = 256 << 20;
+
+/** Descriptor or mapping shared by all videos in the tar */
+inline file_io::file_spec tar_file_spec(const std::string &tar_path, tar_options options) {
+    if ((options & tar_options::memory_map) != tar_options::none) {
+        return {.path = tar_path, .mapping = std::make_shared<const mapped_file>(tar_path)};
+    }
+    if ((options & tar_options::direct_io) != tar_options::none) {
+        return {
+            .path = tar_path,
+            .shared_fd = fd_cache::global().open(tar_path, true),
+            .direct_io = true,
+        };
+    }
+    return {.path = tar_path, .shared_fd = fd_cache::global().open(tar_path)};
+}
+
+/** Buffers for entries read with O_DIRECT, null if `tar_spec` is not for direct reads. */
+inline std::shared_ptr<aligned_buffer_pool> tar_direct_pool(const file_io::file_spec &tar_spec) {
+    if (!tar_spec.direct_io || tar_spec.mapping) {
+        return nullptr;
+    }
+    return std::make_shared<aligned_buffer_pool>(direct_scan_buffer_bytes);
+}
+
+/**
+ * Spec of an entry, sharing the descriptor or mapping of the tar.
+ *
+ * \param direct_pool If set, the whole entry is read sequentially with O_DIRECT now, so that the
+ * video is indexed from memory. Blocks if too many entries are read but not opened yet.
+ */
+inline file_io::file_spec tar_entry_spec(const file_io::file_spec &tar_spec,
+                                         const tar_entry &entry,
+                                         aligned_buffer_pool *direct_pool = nullptr) {
+    auto spec = tar_spec;
+    spec.start_pos = entry.content_start_position();
+    spec.file_size = entry.file_size();
+    if (direct_pool) {
+        spec.preloaded = std::make_shared<const preloaded_range>(
+            read_direct(*tar_spec.shared_fd, spec.start_pos, spec.file_size, *direct_pool));
+    }
+    return spec;
+}
+
+/**
+ * Open videos listed in the sidecar index of a tar, without reading the tar headers. Entries
+ * without frame index in the sidecar are demuxed, and their frame indices are added to it.
+ */
+template <typename Filter>
+std::vector<video> open_indexed_video_tar(const std::string &tar_path, const tar_index &index,
+                                          Filter &filter, const file_io::file_spec &tar_spec) {
+    auto direct_pool = tar_direct_pool(tar_spec);
+    std::optional<tar_index_writer> index_writer;
     std::vector<video> videos;
-    for (auto &entry : tar_iterator(tar_path, tar_options::advise_sequential)) {
-        if (entry.type() != huww::tar_entry_type::file) {
-            continue;
-        }
+    for (size_t i = 0; i < index.size(); i++) {
+        auto entry = index.entry(i);
         if (!filter(entry)) {
             continue;
         }
-        entry.will_need_content();
-        auto v = video({
-            .path = tar_path,
-            .start_pos = entry.content_start_position(),
-            .file_size = entry.file_size(),
-            .external_stream = &entry.begin_read_content(),
-        });
-        v.sleep();
-        videos.push_back(std::move(v));
+        if (index.has_frame_index(i)) {
+            videos.push_back(index.open_video(i, tar_spec));
+        } else {
+            videos.push_back(video(tar_entry_spec(tar_spec, entry, direct_pool.get())));
+            if (!index_writer) {
+                index_writer.emplace(index);
+            }
+            index_writer->set_frame_index(i, videos.back());
+        }
+        videos.back().sleep();
+    }
+    if (index_writer) {
+        index_writer->write(tar_path);
     }
     return videos;
 }
 
-std::vector<video> open_video_tar(std::string tar_path);
-
 template <typename Filter>
-std::vector<video> open_video_tar(std::string tar_path, Filter filter, int max_threads,
+std::vector<video> open_video_tar(std::string tar_path, Filter filter,
                                   tar_options options = tar_options::advise_sequential) {
-    if (max_threads <= 0) {
-        throw std::logic_error("max_threads should be greater than 0");
-    }
-    SPDLOG_TRACE("Open tar file with max {} threads", max_threads);
-    std::condition_variable task_finished;
-    std::mutex task_finished_m;
-    std::atomic<bool> all_finished = false;
-    struct worker {
-        std::condition_variable got_task;
-        std::mutex got_task_m;
-        std::atomic<bool> busy = false;
-        file_io::file_spec task;
-        std::optional<video> *output;
-        std::thread thread;
-    };
-    std::vector<worker> workers(max_threads);
-    for (auto &w : workers) {
-        w.thread = std::thread([&] {
-            std::ifstream local_tar_stream(tar_path, std::ios::binary);
-            while (true) {
-                {
-                    std::unique_lock lk(w.got_task_m);
-                    while (true) {
-                        if (w.busy.load(std::memory_order_acquire)) {
-                            SPDLOG_TRACE("Worker {} got task.", static_cast<void *>(&w));
-                            break;
-                        }
-                        if (all_finished.load(std::memory_order_relaxed)) {
-                            SPDLOG_TRACE("Worker {} exit.", static_cast<void *>(&w));
-                            return;
-                        }
-                        SPDLOG_TRACE("Worker {} waiting for task.", static_cast<void *>(&w));
-                        w.got_task.wait(lk);
-                    }
-                }
-                local_tar_stream.seekg(w.task.start_pos);
-                w.task.external_stream = &local_tar_stream;
-                *(w.output) = video(w.task);
-                w.output->value().sleep();
-                w.busy.store(false, std::memory_order_release);
-                { std::lock_guard lk(task_finished_m); }
-                task_finished.notify_one();
-            }
-        });
+    std::vector<video> videos;
+    auto tar_spec = tar_file_spec(tar_path, options);
+    bool use_index = (options & tar_options::sidecar_index) != tar_options::none;
+    if (use_index) {
+        if (auto index = tar_index::open(tar_path)) {
+            return open_indexed_video_tar(tar_path, *index, filter, tar_spec);
+        }
     }
-
-    std::deque<std::optional<video>> videos;
+    auto direct_pool = tar_direct_pool(tar_spec);
+    tar_index_writer index_writer;
     for (auto &entry : tar_iterator(tar_path, options)) {
         if (entry.type() != huww::tar_entry_type::file) {
             continue;
         }
+        auto index_pos = use_index ? index_writer.add_entry(entry) : 0;
         if (!filter(entry)) {
             continue;
         }
-        SPDLOG_TRACE("Processing entry {}", entry.path());
-        if ((options & tar_options::advise_sequential) != tar_options::none) {
-            entry.prefetch_content();
-        }
-        worker *idle_worker = nullptr;
-        auto search_idle_worker = [&idle_worker, &workers]() {
-            for (auto &w : workers) {
-                if (!w.busy) {
-                    idle_worker = &w;
-                    return true;
-                }
-            }
-            return false;
-        };
-        {
-            std::unique_lock lk(task_finished_m);
-            while (true) {
-                if (search_idle_worker()) {
-                    break;
-                }
-                SPDLOG_TRACE("Waiting for available workers.");
-                task_finished.wait(lk);
-            }
+        if (!direct_pool) {
+            entry.will_need_content();
         }
-        SPDLOG_TRACE("Distribute task to worker {}.", static_cast<void *>(idle_worker));
-        {
-            std::lock_guard(idle_worker->got_task_m);
-            idle_worker->task = {
-                .path = tar_path,
-                .start_pos = entry.content_start_position(),
-                .file_size = entry.file_size(),
-            };
-            videos.push_back({});
-            idle_worker->output = &*videos.rbegin();
-            idle_worker->busy.store(true, std::memory_order_release);
-        }
-        idle_worker->got_task.notify_one();
-    }
-    all_finished.store(true);
-    SPDLOG_TRACE("All tar entry processed. Wait for worker threads");
-    for (auto &w : workers) {
-        {
-            std::unique_lock lk(w.got_task_m);
+        auto v = video(tar_entry_spec(tar_spec, entry, direct_pool.get()));
+        v.sleep();
+        if (use_index) {
+            index_writer.set_frame_index(index_pos, v);
         }
-        w.got_task.notify_one();
+        videos.push_back(std::move(v));
     }
-    for (auto &w : workers) {
-        w.thread.join();
+    if (use_index) {
+        index_writer.write(tar_path);
     }
+    return videos;
+}
 
-    std::vector<video> output_videos;
-    output_videos.reserve(videos.size());
-    for (auto &v : videos) {
-        output_videos.push_back(std::move(v.value()));
+std::vector<video> open_video_tar(std::string tar_path);
+
+/**
+ * Open videos of a tar in background, and yield them in tar order as soon as each is opened.
+ *
+ * A reader thread scans the tar sequentially, reading the content of selected entries into page
+ * cache, and queues them to worker threads which open the videos. Both the queue of entries to open
+ * and the number of videos opened ahead of `next()` are bounded.
+ */
+class video_tar_stream {
+  public:
+    using filter_type = std::function<bool(const tar_entry &)>;
+
+  private:
+    struct open_task {
+        file_io::file_spec spec;
+        size_t index_pos; /**< Position in the sidecar index */
+        bool indexed;     /**< Open with the frame index from the sidecar index */
+        std::promise<video> result;
+    };
+
+    std::string tar_path;
+    filter_type filter;
+    tar_options options;
+    file_io::file_spec tar_spec;
+    bool use_index;
+    std::optional<tar_index> index;
+    std::mutex index_m;
+    std::optional<tar_index_writer> index_writer; /**< Guarded by `index_m` */
+    bool index_updated = false;                   /**< Guarded by `index_m` */
+    bool finished = false;
+    std::shared_ptr<aligned_buffer_pool> direct_pool;
+
+    bounded_queue<open_task> tasks;
+    /** Results in tar order */
+    bounded_queue<std::future<video>> results;
+    std::thread reader;
+    std::vector<std::thread> workers;
+
+    void read_main();
+    void worker_main();
+    bool submit(file_io::file_spec spec, size_t index_pos, bool indexed);
+    void shutdown();
+
+  public:
+    /**
+     * \param filter Called in the reader thread.
+     * \param max_threads Number of threads opening videos.
+     * \param max_pending Max number of videos opened ahead of `next()`, 0 for `2 * max_threads`.
+     */
+    video_tar_stream(std::string tar_path, filter_type filter, int max_threads,
+                     tar_options options = tar_options::advise_sequential,
+                     size_t max_pending = 0);
+    video_tar_stream(const video_tar_stream &) = delete;
+    video_tar_stream &operator=(const video_tar_stream &) = delete;
+    ~video_tar_stream();
+
+    /**
+     * Block until the next video is opened. Not thread safe.
+     *
+     * \return `std::nullopt` after the last video.
+     * \throws Errors of the filter, scanning the tar or opening the video, after which the stream
+     * is stopped.
+     */
+    std::optional<video> next();
+    /** Stop all threads, videos not yet returned are discarded. */
+    void stop();
+};
+
+template <typename Filter>
+std::vector<video> open_video_tar(std::string tar_path, Filter filter, int max_threads,
+                                  tar_options options = tar_options::advise_sequential) {
+    video_tar_stream stream(tar_path, std::move(filter), max_threads, options);
+    std::vector<video> videos;
+    while (auto v = stream.next()) {
+        videos.push_back(std::move(*v));
     }
-    return output_videos;
+    return videos;
 }
 
 std::vector<video> open_video_tar(std::string tar_path, int max_threads);